@@ -0,0 +1,156 @@
+// loads the images in a directory over and over, 10000 loads by default,
+// once with every scratch buffer coming from the heap and once from a thread
+// arena, and reports the allocator calls per image, the wall time and the
+// resident memory. the last few results stay alive like textures waiting for
+// upload, so the heap gets fragmented the way a batch load fragments it. peak
+// memory only goes up, so run each mode on its own for a fair peak. no window
+// or GL - it's left out of the build like the other standalone files, so build
+// it on its own in Release, the numbers mean nothing in Debug
+//
+//     ArenaBench textures/ [heap|arena|both] [loads]
+
+#include <cstddef>
+#include <cstdlib>
+
+// every allocation stb_image makes goes through these
+size_t mallocCalls, reallocCalls, freeCalls;
+
+void* countedMalloc(size_t size)
+{
+	mallocCalls++;
+	return std::malloc(size);
+}
+
+void* countedRealloc(void* p, size_t size)
+{
+	reallocCalls++;
+	return std::realloc(p, size);
+}
+
+void countedFree(void* p)
+{
+	if (p)
+		freeCalls++;
+	std::free(p);
+}
+
+#define STBI_MALLOC(size) countedMalloc(size)
+#define STBI_REALLOC(p, size) countedRealloc(p, size)
+#define STBI_FREE(p) countedFree(p)
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+namespace fs = std::experimental::filesystem;
+
+// results kept alive at once, like a batch waiting for the render thread
+const size_t LIVE_RESULTS = 32;
+
+// resident and peak resident memory of the process in MB
+void residentMemory(double& now, double& peak)
+{
+	now = peak = 0.0;
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		now = counters.WorkingSetSize / (1024.0 * 1024.0);
+		peak = counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+	}
+#else
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmRSS:") == 0)
+			now = std::atof(line.c_str() + 6) / 1024.0;
+		else if (line.compare(0, 6, "VmHWM:") == 0)
+			peak = std::atof(line.c_str() + 6) / 1024.0;
+	}
+#endif
+}
+
+bool isImage(const fs::path& path)
+{
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp" || extension == ".tga";
+}
+
+// the files are read into memory first so only decoding is measured
+void run(const char* name, bool arena, const std::vector<std::vector<stbi_uc>>& files, int loads)
+{
+	stbi_arena* scratch = arena ? stbi_arena_create(16 << 20) : nullptr;
+	stbi_set_thread_arena(scratch);
+	std::vector<stbi_uc*> live(LIVE_RESULTS, nullptr);
+	mallocCalls = reallocCalls = freeCalls = 0;
+	int failed = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < loads; i++) {
+		const std::vector<stbi_uc>& file = files[i % files.size()];
+		int x, y, n;
+		stbi_uc*& slot = live[i % LIVE_RESULTS];
+		stbi_image_free(slot);
+		slot = stbi_load_from_memory(file.data(), (int)file.size(), &x, &y, &n, 4);
+		if (!slot)
+			failed++;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	double now, peak;
+	residentMemory(now, peak);
+
+	for (stbi_uc* pixels : live)
+		stbi_image_free(pixels);
+	stbi_set_thread_arena(nullptr);
+	stbi_arena_destroy(scratch);
+
+	std::cout << std::fixed << std::setprecision(2) << name << ": " << (double)mallocCalls / loads << " mallocs, "
+		<< (double)reallocCalls / loads << " reallocs, " << (double)freeCalls / loads << " frees an image, "
+		<< std::setprecision(1) << seconds * 1000.0 << " ms, " << now << " MB resident, " << peak << " MB peak";
+	if (failed)
+		std::cout << ", " << failed << " FAILED";
+	std::cout << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	const char* directory = argc > 1 ? argv[1] : ".";
+	std::string mode = argc > 2 ? argv[2] : "both";
+	const int loads = argc > 3 ? std::max(1, std::atoi(argv[3])) : 10000;
+
+	std::vector<std::vector<stbi_uc>> files;
+	for (fs::directory_iterator it(directory), end; it != end; ++it) {
+		if (!fs::is_regular_file(it->status()) || !isImage(it->path()))
+			continue;
+		std::ifstream in(it->path().string(), std::ios::binary);
+		files.emplace_back((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	}
+	if (files.empty()) {
+		std::cout << "No images in " << directory << std::endl;
+		return 1;
+	}
+	std::cout << loads << " loads cycling through " << files.size() << " images" << std::endl;
+
+	if (mode != "arena")
+		run("heap ", false, files, loads);
+	if (mode != "heap")
+		run("arena", true, files, loads);
+	return 0;
+}
@@ -0,0 +1,225 @@
+#ifndef CHUNK_MESHER_H
+#define CHUNK_MESHER_H
+
+#include "VoxelWorld.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// direction a voxel face points in
+enum VoxelFace : uint8_t { FACE_POS_X, FACE_NEG_X, FACE_POS_Y, FACE_NEG_Y, FACE_POS_Z, FACE_NEG_Z };
+
+// one corner of a quad packed into 32 bits, lowest bits first:
+//   x, y, z  6 bits each, the position relative to the chunk's corner, 0 to 32
+//   face     3 bits, a VoxelFace
+//   ao       2 bits, ambient occlusion - 0 for a corner boxed in by blocks, 3 for an open one
+//   layer    9 bits, the block type, which picks the colour or texture layer
+// vVoxel.vs unpacks it with the same shifts
+struct VoxelVertex
+{
+	static const int LAYER_BITS = 9;
+	// block types past this share its layer
+	static const BlockId MAX_LAYER = (1 << LAYER_BITS) - 1;
+
+	uint32_t bits;
+
+	static VoxelVertex pack(int x, int y, int z, int face, int ao, BlockId layer)
+	{
+		return VoxelVertex{ (uint32_t)x | (uint32_t)y << 6 | (uint32_t)z << 12 | (uint32_t)face << 18
+			| (uint32_t)ao << 21 | (uint32_t)(layer < MAX_LAYER ? layer : MAX_LAYER) << 23 };
+	}
+
+	int x() const { return bits & 63; }
+	int y() const { return bits >> 6 & 63; }
+	int z() const { return bits >> 12 & 63; }
+	int face() const { return bits >> 18 & 7; }
+	int ao() const { return bits >> 21 & 3; }
+	BlockId layer() const { return (BlockId)(bits >> 23); }
+};
+
+static_assert(sizeof(VoxelVertex) == 4, "VoxelVertex is uploaded as-is");
+
+// builds the visible surface of a chunk as quads, four vertices each, wound
+// counter-clockwise seen from outside. every quad uses the same six indices
+// 0 1 2 2 3 0 offset by 4 * quad, so one shared index buffer serves every chunk.
+//
+// faces between two solid blocks are dropped - the blocks one past the
+// chunk's edges come from its neighbours - and the remaining faces of each
+// slice are merged into as few rectangles as the greedy scan finds. faces only
+// merge when both the block type and the ambient occlusion of all four corners
+// match, so merging never changes the shading. the scratch space is kept between
+// calls, so reuse one mesher per thread
+class ChunkMesher
+{
+public:
+	// false gives one quad per visible face, for comparing against greedy merging
+	bool merge = true;
+
+	// replaces vertices with the mesh of the chunk at coord. reads the chunk and
+	// its 26 neighbours, so nothing may write to the world meanwhile. World is
+	// any BasicVoxelWorld
+	template<class World>
+	void mesh(const World& world, const ChunkCoord& coord, std::vector<VoxelVertex>& vertices)
+	{
+		vertices.clear();
+		const typename World::ChunkType* center = world.chunk(coord);
+		if (!center || center->empty())
+			return;
+		gatherBlocks(world, coord);
+
+		const int size = Chunk::SIZE;
+		mask.resize(size * size);
+		for (int d = 0; d < 3; ++d) {
+			// u and v span the slice; (d, u, v) is x y z rotated, so u cross v points along +d
+			int u = (d + 1) % 3, v = (d + 2) % 3;
+			// how far one step along each axis moves in the padded array
+			const int stride[3] = { 1, PADDED * PADDED, PADDED };
+			for (int back = 0; back < 2; ++back) {
+				uint8_t face = (uint8_t)(d * 2 + back);
+				int neighbour = back ? -stride[d] : stride[d];
+				for (int layer = 0; layer < size; ++layer) {
+					// the block type and corner occlusion of every face in this slice that is
+					// open to the air, or 0 where there is none
+					const BlockId* slice = &padded[paddedIndex(0, 0, 0) + layer * stride[d]];
+					for (int j = 0; j < size; ++j) {
+						const BlockId* line = slice + j * stride[v];
+						uint32_t* out = &mask[j * size];
+						for (int i = 0; i < size; ++i) {
+							const BlockId* at = line + i * stride[u];
+							out[i] = *at != AIR && at[neighbour] == AIR
+								? *at | faceOcclusion(at + neighbour, stride[u], stride[v]) << 16 : 0;
+						}
+					}
+					emitSlice(vertices, d, u, v, layer + 1 - back, face, back != 0);
+				}
+			}
+		}
+	}
+
+private:
+	static const int PADDED = Chunk::SIZE + 2;
+
+	// the chunk plus a one block border, so neighbours never need a lookup
+	std::vector<BlockId> padded;
+	// a block type in the low 16 bits, the occlusion of its face's corners above
+	std::vector<uint32_t> mask;
+
+	static int paddedIndex(int x, int y, int z)
+	{
+		return ((y + 1) * PADDED + (z + 1)) * PADDED + (x + 1);
+	}
+
+	// 0 to 3 from the blocks beside a corner in the layer in front of its face. two
+	// sides make it as dark as it gets, whether or not the block between them is there
+	static uint32_t cornerOcclusion(bool side1, bool side2, bool between)
+	{
+		return side1 && side2 ? 0 : 3 - side1 - side2 - between;
+	}
+
+	// the occlusion of a face's four corners, two bits each in quad corner order
+	// (-u -v, +u -v, +u +v, -u +v). front is the air block the face looks into and
+	// du, dv are the padded strides along u and v
+	static uint32_t faceOcclusion(const BlockId* front, int du, int dv)
+	{
+		bool lowU = front[-du] != AIR, highU = front[du] != AIR;
+		bool lowV = front[-dv] != AIR, highV = front[dv] != AIR;
+		return cornerOcclusion(lowU, lowV, front[-du - dv] != AIR)
+			| cornerOcclusion(highU, lowV, front[du - dv] != AIR) << 2
+			| cornerOcclusion(highU, highV, front[du + dv] != AIR) << 4
+			| cornerOcclusion(lowU, highV, front[-du + dv] != AIR) << 6;
+	}
+
+	template<class World>
+	void gatherBlocks(const World& world, const ChunkCoord& coord)
+	{
+		typedef typename World::ChunkType ChunkType;
+		const int size = Chunk::SIZE;
+		padded.assign(PADDED * PADDED * PADDED, AIR);
+		// the 3x3x3 chunks around coord, looked up once
+		const ChunkType* around[27];
+		for (int dy = -1; dy <= 1; ++dy)
+			for (int dz = -1; dz <= 1; ++dz)
+				for (int dx = -1; dx <= 1; ++dx)
+					around[(dy + 1) * 9 + (dz + 1) * 3 + dx + 1] = world.chunk(ChunkCoord{ coord.x + dx, coord.y + dy, coord.z + dz });
+
+		for (int y = -1; y <= size; ++y) {
+			int cy = y < 0 ? 0 : y < size ? 1 : 2;
+			for (int z = -1; z <= size; ++z) {
+				int cz = z < 0 ? 0 : z < size ? 1 : 2;
+				BlockId* row = &padded[paddedIndex(0, y, z)];
+				const ChunkType* west = around[cy * 9 + cz * 3];
+				const ChunkType* middle = around[cy * 9 + cz * 3 + 1];
+				const ChunkType* east = around[cy * 9 + cz * 3 + 2];
+				int ly = y & Chunk::MASK, lz = z & Chunk::MASK;
+				if (west)
+					row[-1] = west->get(Chunk::MASK, ly, lz);
+				if (middle)
+					middle->copyRow(ly, lz, row);
+				if (east)
+					row[size] = east->get(0, ly, lz);
+			}
+		}
+	}
+
+	// turn the mask into quads on the plane d = depth, taking the widest run of one
+	// mask value along u and then as many rows along v as match it
+	void emitSlice(std::vector<VoxelVertex>& vertices, int d, int u, int v, int depth, uint8_t face, bool back)
+	{
+		const int size = Chunk::SIZE;
+		for (int j = 0; j < size; ++j) {
+			for (int i = 0; i < size;) {
+				uint32_t value = mask[j * size + i];
+				if (value == 0) {
+					++i;
+					continue;
+				}
+				int width = 1, height = 1;
+				if (merge) {
+					while (i + width < size && mask[j * size + i + width] == value)
+						++width;
+					for (; j + height < size; ++height) {
+						const uint32_t* row = &mask[(j + height) * size + i];
+						int k = 0;
+						while (k < width && row[k] == value)
+							++k;
+						if (k < width)
+							break;
+					}
+				}
+				for (int h = 0; h < height; ++h)
+					std::memset(&mask[(j + h) * size + i], 0, width * sizeof(uint32_t));
+
+				int corner[4][3];
+				for (int c = 0; c < 4; ++c) {
+					corner[c][d] = depth;
+					corner[c][u] = i;
+					corner[c][v] = j;
+				}
+				corner[1][u] += width;
+				corner[2][u] += width;
+				corner[2][v] += height;
+				corner[3][v] += height;
+				int ao[4];
+				for (int c = 0; c < 4; ++c)
+					ao[c] = value >> (16 + c * 2) & 3;
+				// u then v goes counter-clockwise around +d; faces pointing the other way go round backwards
+				static const int FRONT[4] = { 0, 1, 2, 3 }, BACK[4] = { 0, 3, 2, 1 };
+				const int* order = back ? BACK : FRONT;
+				// the quad is split along the diagonal from its first vertex to its third. starting
+				// one corner later splits it along the other one, keeping the lighter corners
+				// together so the occlusion doesn't smear across the quad
+				int first = ao[0] + ao[2] < ao[1] + ao[3] ? 1 : 0;
+				BlockId block = (BlockId)(value & 0xFFFF);
+				for (int k = 0; k < 4; ++k) {
+					int c = order[(first + k) & 3];
+					const int* p = corner[c];
+					vertices.push_back(VoxelVertex::pack(p[0], p[1], p[2], face, ao[c], block));
+				}
+				i += width;
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef CHUNK_STREAMER_H
+#define CHUNK_STREAMER_H
+
+#include "ChunkMesher.h"
+#include "JobSystem.h"
+#include "VoxelRenderer.h"
+#include "VoxelWorld.h"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// keeps the renderer's chunk meshes up to date without meshing on the render
+// thread. chunks marked dirty are meshed as jobs on the worker threads, nearest
+// the camera first, and the finished meshes come back through a lock-free list
+// for upload() to hand to the renderer, a few per frame so no frame stalls.
+//
+// the workers read the world while meshing, so only write to it while idle().
+// World is any BasicVoxelWorld, and ChunkStreamer is the one for a VoxelWorld
+//
+//     JobSystem jobs;
+//     ChunkStreamer streamer(world, jobs);
+//     streamer.markAllDirty();
+//     // every frame:
+//     streamer.update(cameraPosition);
+//     streamer.upload(renderer, 16);
+template<class World>
+class BasicChunkStreamer
+{
+public:
+	BasicChunkStreamer(const World& world, JobSystem& jobs)
+		: world(world), jobs(jobs)
+	{
+		for (unsigned int i = 0; i < jobs.threadCount(); ++i)
+			arenas.emplace_back(new WorkerArena());
+		// enough queued to keep every worker busy while the next few frames are drawn,
+		// few enough that the order still follows the camera when it moves
+		maxInFlight = jobs.threadCount() * 4;
+	}
+
+	// the job system has to outlive the streamer
+	~BasicChunkStreamer()
+	{
+		jobs.wait();
+	}
+
+	BasicChunkStreamer(const BasicChunkStreamer&) = delete;
+	BasicChunkStreamer& operator=(const BasicChunkStreamer&) = delete;
+
+	void markDirty(const ChunkCoord& coord)
+	{
+		dirty.insert(coord);
+	}
+
+	// the block at (x, y, z) changed: remesh its chunk, and every chunk it
+	// touches. faces against it may have opened or closed, and the ambient
+	// occlusion of the faces around it reads it across edges and corners too,
+	// so a block on a chunk's corner dirties up to seven neighbours
+	void markBlockDirty(int x, int y, int z)
+	{
+		ChunkCoord coord = World::chunkOf(x, y, z);
+		// which way the block borders another chunk along each axis, if at all
+		int side[3];
+		int local[3] = { x & Chunk::MASK, y & Chunk::MASK, z & Chunk::MASK };
+		for (int axis = 0; axis < 3; ++axis)
+			side[axis] = local[axis] == 0 ? -1 : local[axis] == Chunk::MASK ? 1 : 0;
+
+		for (int dz = 0; dz <= 1; ++dz)
+			for (int dy = 0; dy <= 1; ++dy)
+				for (int dx = 0; dx <= 1; ++dx) {
+					if ((dx && !side[0]) || (dy && !side[1]) || (dz && !side[2]))
+						continue;
+					markDirty(ChunkCoord{ coord.x + dx * side[0], coord.y + dy * side[1], coord.z + dz * side[2] });
+				}
+	}
+
+	void markAllDirty()
+	{
+		world.forEachChunk([this](const ChunkCoord& coord, const typename World::ChunkType&) { markDirty(coord); });
+	}
+
+	// send the dirty chunks nearest to camera (in blocks) to the workers, as
+	// many as there is room for
+	void update(const glm::vec3& camera)
+	{
+		if (dirty.empty() || inFlight.size() >= maxInFlight)
+			return;
+
+		candidates.clear();
+		for (const ChunkCoord& coord : dirty) {
+			// one job per chunk at a time; a chunk dirtied while it is being meshed waits its turn
+			if (inFlight.count(coord) == 0)
+				candidates.push_back(std::make_pair(distanceSquared(coord, camera), coord));
+		}
+		size_t count = std::min(candidates.size(), maxInFlight - inFlight.size());
+		std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+			[](const Candidate& a, const Candidate& b) { return a.first < b.first; });
+
+		for (size_t i = 0; i < count; ++i) {
+			ChunkCoord coord = candidates[i].second;
+			dirty.erase(coord);
+			inFlight.insert(coord);
+			jobs.submit([this, coord](unsigned int worker) { meshChunk(coord, worker); }, candidates[i].first);
+		}
+	}
+
+	// upload at most maxUploads finished meshes; returns how many it did
+	size_t upload(VoxelRenderer& renderer, size_t maxUploads)
+	{
+		// the list comes newest first; put it back in finishing order, which is
+		// close to nearest first
+		ChunkMeshResult* newest = finished.takeAll();
+		size_t before = ready.size();
+		for (ChunkMeshResult* result = newest; result; result = result->next)
+			ready.insert(ready.begin() + before, result);
+
+		size_t uploads = 0;
+		while (uploads < maxUploads && !ready.empty()) {
+			ChunkMeshResult* result = ready.front();
+			ready.pop_front();
+			renderer.upload(result->coord, result->vertices);
+			inFlight.erase(result->coord);
+			arenas[result->worker]->returned.push(result);
+			++uploads;
+		}
+		meshedCount += uploads;
+		return uploads;
+	}
+
+	// no chunk waiting, being meshed or waiting for upload
+	bool idle() const
+	{
+		return dirty.empty() && inFlight.empty();
+	}
+
+	// chunks not yet uploaded since they were marked dirty
+	size_t pending() const
+	{
+		return dirty.size() + inFlight.size();
+	}
+
+	// meshes uploaded since the streamer was created
+	size_t meshed() const
+	{
+		return meshedCount;
+	}
+
+private:
+	typedef std::pair<float, ChunkCoord> Candidate;
+
+	// a finished mesh on its way to the render thread. the vertex vector keeps
+	// its capacity when the result is reused, so once every worker has a few of
+	// these meshing allocates nothing
+	struct ChunkMeshResult
+	{
+		ChunkCoord coord;
+		std::vector<VoxelVertex> vertices;
+		unsigned int worker;
+		ChunkMeshResult* next;
+	};
+
+	// everything one worker meshes with. only that worker touches it, apart from
+	// the render thread pushing uploaded results back onto returned
+	struct WorkerArena
+	{
+		ChunkMesher mesher;
+		std::vector<std::unique_ptr<ChunkMeshResult>> results;
+		ChunkMeshResult* spare = nullptr;
+		AtomicList<ChunkMeshResult> returned;
+
+		ChunkMeshResult* acquire()
+		{
+			if (!spare)
+				spare = returned.takeAll();
+			if (spare) {
+				ChunkMeshResult* result = spare;
+				spare = spare->next;
+				return result;
+			}
+			results.emplace_back(new ChunkMeshResult());
+			return results.back().get();
+		}
+	};
+
+	const World& world;
+	JobSystem& jobs;
+	std::vector<std::unique_ptr<WorkerArena>> arenas;
+	AtomicList<ChunkMeshResult> finished;
+
+	// render thread only from here on
+	std::unordered_set<ChunkCoord, ChunkCoordHash> dirty, inFlight;
+	std::deque<ChunkMeshResult*> ready;
+	std::vector<Candidate> candidates;
+	size_t maxInFlight;
+	size_t meshedCount = 0;
+
+	static float distanceSquared(const ChunkCoord& coord, const glm::vec3& camera)
+	{
+		const float half = Chunk::SIZE * 0.5f;
+		float dx = coord.x * Chunk::SIZE + half - camera.x;
+		float dy = coord.y * Chunk::SIZE + half - camera.y;
+		float dz = coord.z * Chunk::SIZE + half - camera.z;
+		return dx * dx + dy * dy + dz * dz;
+	}
+
+	// runs on worker
+	void meshChunk(const ChunkCoord& coord, unsigned int worker)
+	{
+		WorkerArena& arena = *arenas[worker];
+		ChunkMeshResult* result = arena.acquire();
+		result->coord = coord;
+		result->worker = worker;
+		arena.mesher.mesh(world, coord, result->vertices);
+		finished.push(result);
+	}
+};
+
+typedef BasicChunkStreamer<VoxelWorld> ChunkStreamer;
+
+#endif
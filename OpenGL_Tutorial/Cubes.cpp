@@ -11,22 +11,50 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 #include "MyShader.h"
+#include "MeshBuilder.h"
+#include "PerFrame.h"
+#include "GLState.h"
+#include "ShaderLibrary.h"
+#include "StreamBuffer.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "TransformSystem.h"
 
 #include <iostream>
+#include <vector>
 #include <experimental/filesystem>
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// draw all the cubes with one instanced draw call instead of one call per cube
+const bool USE_INSTANCING = true;
+// how many cubes to draw - past the ten hand placed ones the rest go on a grid behind them
+const unsigned int CUBE_COUNT = 10;
 
 // register callback function for resizing window
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
+// create a GL texture from a decoded image and generate its mipmaps
+unsigned int uploadTexture(const LoadedImage& image);
+// where cube i sits once the ten hand placed positions run out
+glm::vec3 cubeGridPosition(unsigned int i);
+// the spinning model matrix of cube i at the given time
+glm::mat4 cubeModel(const glm::vec3& position, unsigned int i, float time);
 
 int main()
 {
 	std::cout << "Running Shaders.cpp file" << std::endl;
 
+	// start decoding the textures on worker threads right away so it overlaps
+	// with creating the window and context. the callbacks only run inside
+	// textureLoader.finish() below, on this thread, once GL is ready
+	unsigned int texture1 = 0, texture2 = 0;
+	TextureLoader textureLoader;
+	textureLoader.load("container.jpg", 0, false, [&texture1](LoadedImage& image) { texture1 = uploadTexture(image); });
+	// flip y coordinates on load - some images have (0,0) in the top left corner but opengl is (0,0) in top right corner
+	textureLoader.load("awesomeface.png", 0, true, [&texture2](LoadedImage& image) { texture2 = uploadTexture(image); });
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -57,260 +85,282 @@ int main()
 		return -1;
 	}
 
-	// configure global OpenGL state - DEPTH TESTING
-	glEnable(GL_DEPTH_TEST);
-
-	// setup the vertex shader and fragment shader
-	Shader threeDShader("vShader.vs", "fShader.fs");
-
-	// ----------------------------------------------------
-	// Gen VAO, Gen VBO, Gen Attributes, Store VBO into VAO
-	// VAO = Vertex Attribute Object
-	// VBO = Vertex Buffer Object
-	// ----------------------------------------------------
-
-	// set up vertex data (and buffer(s)) and configure vertex attributes
-	// ------------------------------------------------------------------
-	float vertices[] = {
-		-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-		 0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-		 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-		-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		-0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-		 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		 0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		 0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		 0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		 0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-		 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-		 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-		-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-		 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f, 1.0f
-	};
-
-	glm::vec3 cubePositions[] = {
-		glm::vec3(0.0f,  0.0f,  0.0f),
-		glm::vec3(2.0f,  5.0f, -15.0f),
-		glm::vec3(-1.5f, -2.2f, -2.5f),
-		glm::vec3(-3.8f, -2.0f, -12.3f),
-		glm::vec3(2.4f, -0.4f, -3.5f),
-		glm::vec3(-1.7f,  3.0f, -7.5f),
-		glm::vec3(1.3f, -2.0f, -2.5f),
-		glm::vec3(1.5f,  2.0f, -2.5f),
-		glm::vec3(1.5f,  0.2f, -1.5f),
-		glm::vec3(-1.3f,  1.0f, -1.5f)
-	};
-
-	// get id of the vertex buffer object
-	// unsigned int EBO;
-	unsigned int VBO, VAO;
-	// generate the VAO, VBO, and EBO
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-
-	// bind the VAO first, then bind VBO, then set vertex attributes
-	glBindVertexArray(VAO);
-
-	// set the type of the buffer - aka array buffer
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	// fill the buffer with the vertices' data and say static draw is infrequent update
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-	//// bind EBO and put index data into it
-	//glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	//glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-	// vertex position attribute
-	// 0 is the location
-	// 3 is the number of floats
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-
-	// vertex color attribute - 4th parameter is the offset to the color
-	// first parameters are 1 here becuase that's the location set for color in the vertex shader
-	// the last parameter is the data offset within the stride
-	/*glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);*/
-
-	// texture attribute
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-
-	// --------------
-	// LOAD TEXTURE 1
-	// --------------
-
-	// load, gen, and bind texture
-	unsigned int texture1;
-	glGenTextures(1, &texture1);
-	// now all calls to 2D texture will only effect this texture
-	glBindTexture(GL_TEXTURE_2D, texture1);
-	// set the texture wrap parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// set the texture filtering parameters - scaling texture
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// load image
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load("container.jpg", &width, &height, &nrChannels, 0);
-	// check that data loaded correctly, set the texture to the jpg, and generate mipmaps for texture
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else
-	{
-		std::cout << "ERROR::TEXTURE - Failed to load texture" << std::endl;
-	}
-	stbi_image_free(data);
-
-	// --------------
-	// LOAD TEXTURE 2
-	// --------------
-
-	// load, gen, and bind texture
-	unsigned int texture2;
-	glGenTextures(1, &texture2);
-	// now all calls to 2D texture will only effect this texture
-	glBindTexture(GL_TEXTURE_2D, texture2);
-	// set the texture wrap parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// set the texture filtering parameters - scaling texture
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// flip y coordinates on load - some images have (0,0) in the top left corner but opengl is (0,0) in top right corner
-	stbi_set_flip_vertically_on_load(true);
-	data = stbi_load("awesomeface.png", &width, &height, &nrChannels, 0);
-	// check that data loaded correctly, set the texture to the jpg, and generate mipmaps for texture
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else
-	{
-		std::cout << "ERROR::TEXTURE - Failed to load texture" << std::endl;
-	}
-	stbi_image_free(data);
-
-	// activate the shader before setting any uniforms
-	threeDShader.use();
-	// manually set the uniform for texture
-	glUniform1i(glGetUniformLocation(threeDShader.ID, "texture1"), 0);
-	// use the shader special method to set the texture
-	threeDShader.setInt("texture2", 1);
-
-	// -----------
-	// RENDER LOOP
-	// -----------
-
-	// the render loop that tells opengl to stay open unless told to exit
-	while (!glfwWindowShouldClose(window))
+	// everything in here owns GL objects that its destructors delete, so it has to
+	// go before glfwTerminate() destroys the context below
 	{
-		// check for user input every render loop
-		processInput(window);
-
-		// window rendering commands will go here
-		// set the color you want to clear the entire window with
-		// this is a state setting function
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-		// clear the window with the previously set color
-		// this is a state using function
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// activate and bind the first texture unit
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture1);
-
-		// activate and bind the second texture unit
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, texture2);
-
-		// tell GL to use the new shader program whenever render is called
+		// configure global OpenGL state - DEPTH TESTING
+		// state that changes during rendering goes through the state cache, which skips calls that change nothing
+		GLState& state = glState();
+		state.setEnabled(GL_DEPTH_TEST, true);
+
+		// setup the vertex shader and fragment shader - this only submits them to the
+		// driver, the build is finished the first time the shader is used below. linked
+		// programs are cached per user, so the next run skips the GLSL compiler
+		ShaderLibrary shaders(userShaderCacheDir());
+		// the instanced variant reads each cube's model matrix from a vertex attribute
+		Shader& threeDShader = USE_INSTANCING
+			? shaders.add("threeDInstanced", "vShaderInstanced.vs", "fShader.fs")
+			: shaders.add("threeD", "vShader.vs", "fShader.fs");
+		// rebuild the shader whenever its files are saved, see the render loop
+		threeDShader.watchSources();
+
+		// the view and projection matrices live in a uniform buffer that every shader
+		// declaring the PerFrame block reads from, so they're uploaded once per frame
+		PerFrameBuffer perFrame;
+		// everything rewritten each frame - the camera block and the cubes' model matrices -
+		// goes through a ring of three frames, so the CPU never waits on the GPU still drawing the last one
+		StreamBuffer frameStream(CUBE_COUNT * sizeof(glm::mat4) + sizeof(PerFrameData) + StreamBuffer::uniformAlignment());
+
+		// ----------------------------------------------------
+		// Gen VAO, Gen VBO, Gen Attributes, Store VBO into VAO
+		// VAO = Vertex Attribute Object
+		// VBO = Vertex Buffer Object
+		// ----------------------------------------------------
+
+		// set up vertex data (and buffer(s)) and configure vertex attributes
+		// ------------------------------------------------------------------
+		float vertices[] = {
+			-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+			 0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+			 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+			 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+			-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+			-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+
+			-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+			 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+			 0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+			 0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+			-0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
+			-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+
+			-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+			-0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+			-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+			-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+			-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+			-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+
+			 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+			 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+			 0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+			 0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+			 0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+			 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+
+			-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+			 0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
+			 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+			 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+			-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+			-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+
+			-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+			 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+			 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+			 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+			-0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
+			-0.5f,  0.5f, -0.5f,  0.0f, 1.0f
+		};
+
+		glm::vec3 cubePositions[] = {
+			glm::vec3(0.0f,  0.0f,  0.0f),
+			glm::vec3(2.0f,  5.0f, -15.0f),
+			glm::vec3(-1.5f, -2.2f, -2.5f),
+			glm::vec3(-3.8f, -2.0f, -12.3f),
+			glm::vec3(2.4f, -0.4f, -3.5f),
+			glm::vec3(-1.7f,  3.0f, -7.5f),
+			glm::vec3(1.3f, -2.0f, -2.5f),
+			glm::vec3(1.5f,  2.0f, -2.5f),
+			glm::vec3(1.5f,  0.2f, -1.5f),
+			glm::vec3(-1.3f,  1.0f, -1.5f)
+		};
+
+		std::vector<glm::vec3> positions(CUBE_COUNT);
+		for (unsigned int i = 0; i < CUBE_COUNT; i++)
+			positions[i] = i < 10 ? cubePositions[i] : cubeGridPosition(i - 10);
+
+		// the instanced path builds every cube's model matrix in batches spread over
+		// the pool's threads - the same spin cubeModel gives, cube i at 20 * i degrees a second
+		ThreadPool threadPool;
+		TransformSystem transforms(&threadPool);
+		transforms.reserve(CUBE_COUNT);
+		for (unsigned int i = 0; i < CUBE_COUNT; i++)
+			transforms.add(positions[i], glm::vec3(1.0f, 0.3f, 0.5f), glm::radians(20.0f * i));
+
+		// the 36 vertices above repeat every corner, so weld them into unique vertices and an
+		// index buffer, with the triangles ordered so the GPU reuses corners it just shaded
+		IndexedMesh cube = buildIndexedMesh(vertices, 36, 5);
+		// ACMR is vertex shader runs per triangle - glDrawArrays shades all three corners of every triangle
+		std::cout << "Cube mesh: 36 -> " << cube.vertexCount() << " vertices, ACMR 3 -> " << averageCacheMissRatio(cube.indices) << std::endl;
+
+		// get id of the vertex buffer object
+		unsigned int VBO, VAO, EBO;
+		// generate the VAO, VBO, and EBO
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+
+		// bind the VAO first, then bind VBO, then set vertex attributes
+		state.bindVertexArray(VAO);
+
+		// set the type of the buffer - aka array buffer
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		// fill the buffer with the vertices' data and say static draw is infrequent update
+		glBufferData(GL_ARRAY_BUFFER, cube.vertices.size() * sizeof(float), cube.vertices.data(), GL_STATIC_DRAW);
+
+		// bind EBO and put index data into it - the VAO remembers it
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, cube.indices.size() * sizeof(unsigned int), cube.indices.data(), GL_STATIC_DRAW);
+		GLsizei cubeIndexCount = (GLsizei)cube.indices.size();
+
+		// vertex position attribute
+		// 0 is the location
+		// 3 is the number of floats
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+
+		// vertex color attribute - 4th parameter is the offset to the color
+		// first parameters are 1 here becuase that's the location set for color in the vertex shader
+		// the last parameter is the data offset within the stride
+		/*glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);*/
+
+		// texture attribute
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+
+		// instance attribute - each cube's model matrix, refilled every frame
+		// a mat4 attribute is passed as four vec4 columns at locations 2 to 5, and the
+		// divisor of 1 moves to the next matrix once per cube instead of once per vertex
+		// the matrices sit in a different part of frameStream each frame, so the pointers are set in the render loop
+		// the per-cube loop uses the model uniform instead, so there the locations stay disabled
+		if (USE_INSTANCING) {
+			for (unsigned int column = 0; column < 4; column++) {
+				glEnableVertexAttribArray(2 + column);
+				glVertexAttribDivisor(2 + column, 1);
+			}
+		}
+
+		// ---------------
+		// UPLOAD TEXTURES
+		// ---------------
+
+		// wait for the workers and upload each texture as soon as it is decoded
+		textureLoader.finish();
+
+		// activate the shader before setting any uniforms
 		threeDShader.use();
-
-		// create the transformation matrices as identity matrices first
-		glm::mat4 model = glm::mat4(1.0f);
-		glm::mat4 view = glm::mat4(1.0f);
-		glm::mat4 projection = glm::mat4(1.0f);
-		// rotate on the x-axis to tilt image forward so you can see the top of it instead of a straight on view
-		model = glm::rotate(model, (float)glfwGetTime() * glm::radians(-55.0f), glm::vec3(0.5f, 1.0f, 0.0f));
-		// move the view backwards on z-axis so you can see more around the image
-		view = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
-		// set the "camera" projection to have view angle of 45 degrees, set screen perspective, and set view distance
-		projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		
-		// get the matrix uniform locations for the vertex shader
-		unsigned int modelLoc = glGetUniformLocation(threeDShader.ID, "model");
-		unsigned int viewLoc = glGetUniformLocation(threeDShader.ID, "view");
-		unsigned int projectionLoc = glGetUniformLocation(threeDShader.ID, "projection");
-
-		// pass the matrix views to the shaders (three different ways)
-		// using glm pointers to a matrix
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-		// using c++ memory location pointers and array de-referencing
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view[0][0]);
-		// using the built in shader function - hella useful need to go and add this into my shader.h file
-		// threeDShader.setMat4("projection", projection);
-		glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-		// bind the vertex array again? Not sure why but see if that fixes the bug?
-		glBindVertexArray(VAO);
-
-		// loop to render multiple cubes in the space
-		for (unsigned int i = 0; i < 10; i++) {
+		// manually set the uniform for texture
+		glUniform1i(glGetUniformLocation(threeDShader.ID, "texture1"), 0);
+		// use the shader special method to set the texture
+		threeDShader.setInt("texture2", 1);
+
+		// get the model matrix uniform location once, it doesn't change after linking
+		GLint modelLoc = threeDShader.uniform("model");
+
+		// -----------
+		// RENDER LOOP
+		// -----------
+
+		// the render loop that tells opengl to stay open unless told to exit
+		while (!glfwWindowShouldClose(window))
+		{
+			// check for user input every render loop
+			processInput(window);
+
+			// swap in the rebuilt shader if its files were saved. it's a new program,
+			// so the texture units and uniform locations have to be set up again
+			if (threeDShader.reloadIfChanged())
+			{
+				threeDShader.use();
+				threeDShader.setInt("texture1", 0);
+				threeDShader.setInt("texture2", 1);
+				modelLoc = threeDShader.uniform("model");
+			}
+
+			// window rendering commands will go here
+			// set the color you want to clear the entire window with
+			// this is a state setting function
+			glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+			// clear the window with the previously set color
+			// this is a state using function
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			// bind the textures to the first and second texture units - after the
+			// first frame nothing changes, so the state cache skips the GL calls
+			state.bindTexture(0, GL_TEXTURE_2D, texture1);
+			state.bindTexture(1, GL_TEXTURE_2D, texture2);
+
+			// tell GL to use the new shader program whenever render is called
+			threeDShader.use();
+
+			// create the transformation matrices as identity matrices first
 			glm::mat4 model = glm::mat4(1.0f);
-			model = glm::translate(model, cubePositions[i]);
-			float angle = 20.0f * i;
-			model = glm::rotate(model, (float)glfwGetTime() * glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-			// this overrides the model changes made on line 267 
-			unsigned int modelLoc = glGetUniformLocation(threeDShader.ID, "model");
+			glm::mat4 view = glm::mat4(1.0f);
+			glm::mat4 projection = glm::mat4(1.0f);
+			// rotate on the x-axis to tilt image forward so you can see the top of it instead of a straight on view
+			model = glm::rotate(model, (float)glfwGetTime() * glm::radians(-55.0f), glm::vec3(0.5f, 1.0f, 0.0f));
+			// move the view backwards on z-axis so you can see more around the image
+			view = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
+			// set the "camera" projection to have view angle of 45 degrees, set screen perspective, and set view distance
+			projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+
+			// pass the matrix views to the shaders
+			// using glm pointers to a matrix
 			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-			// render the triangles that make up the cube
-			glDrawArrays(GL_TRIANGLES, 0, 36);
-		}		
-
-		// swap out colors in the buffer based on updated user input
-		glfwSwapBuffers(window);
-		// check for any user input
-		glfwPollEvents();
+			// start writing this frame's part of the stream - this only waits if the GPU is three frames behind
+			frameStream.begin();
+			// view and projection go to the shared PerFrame uniform block in one write
+			perFrame.update(view, projection, frameStream);
+
+			// the VAO only has to be bound again if something else was bound since - the state cache checks
+			state.bindVertexArray(VAO);
+
+			float time = (float)glfwGetTime();
+			if (USE_INSTANCING) {
+				// write every cube's matrix straight into the stream and draw all the cubes with one call
+				StreamBuffer::Allocation models = frameStream.allocate(CUBE_COUNT * sizeof(glm::mat4));
+				transforms.computeModels(time, (glm::mat4*)models.data);
+				frameStream.end();
+				glBindBuffer(GL_ARRAY_BUFFER, frameStream.id());
+				for (unsigned int column = 0; column < 4; column++)
+					glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(models.offset + column * sizeof(glm::vec4)));
+				glDrawElementsInstanced(GL_TRIANGLES, cubeIndexCount, GL_UNSIGNED_INT, 0, CUBE_COUNT);
+			}
+			else {
+				frameStream.end();
+				// loop to render multiple cubes in the space
+				for (unsigned int i = 0; i < CUBE_COUNT; i++) {
+					// each cube's own spin replaces the model matrix set above
+					threeDShader.setMat4(modelLoc, cubeModel(positions[i], i, time));
+					// render the triangles that make up the cube
+					glDrawElements(GL_TRIANGLES, cubeIndexCount, GL_UNSIGNED_INT, 0);
+				}
+			}
+
+			// start counting the next frame's GL state calls
+			state.endFrame();
+
+			// swap out colors in the buffer based on updated user input
+			glfwSwapBuffers(window);
+			// check for any user input
+			glfwPollEvents();
+		}
+
+		// optional: de-allocate all resources after done rendering
+		state.forgetVertexArray(VAO);
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+
+		const StreamBuffer::Stats& streamStats = frameStream.stats();
+		std::cout << "Streamed " << streamStats.bytes << " bytes over " << streamStats.frames << " frames, waited on the GPU "
+			<< streamStats.stalls << " times for " << streamStats.stallMilliseconds << " ms" << std::endl;
+		std::cout << "GL state calls: " << state.total().issued << " issued, " << state.total().skipped << " skipped; last frame "
+			<< state.lastFrame().issued << " issued, " << state.lastFrame().skipped << " skipped" << std::endl;
 	}
 
-	// optional: de-allocate all resources after done rendering
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
-	// glDeleteBuffers(1, &EBO);
-
 	// delete all of glfw's resources used to render after done rendering
 	glfwTerminate();
 	return 0;
@@ -325,6 +375,56 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	glViewport(0, 0, width, height);
 }
 
+// lay the extra cubes out on a square grid of layers going away from the camera, starting behind the hand placed ones
+// -------------------------------------------------------------------------------------------------------------------
+glm::vec3 cubeGridPosition(unsigned int i)
+{
+	const unsigned int side = 50;
+	const float spacing = 2.0f;
+	unsigned int x = i % side, y = (i / side) % side, layer = i / (side * side);
+	return glm::vec3((x - side / 2.0f) * spacing, (y - side / 2.0f) * spacing, -20.0f - layer * spacing);
+}
+
+// move the cube into place and spin it about a tilted axis, each cube at its own speed
+// ------------------------------------------------------------------------------------
+glm::mat4 cubeModel(const glm::vec3& position, unsigned int i, float time)
+{
+	glm::mat4 model = glm::mat4(1.0f);
+	model = glm::translate(model, position);
+	float angle = 20.0f * i;
+	return glm::rotate(model, time * glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+}
+
+// upload a decoded image into a new texture with the tutorial's wrap and filter settings
+// -------------------------------------------------------------------------------------
+unsigned int uploadTexture(const LoadedImage& image)
+{
+	// load, gen, and bind texture
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	// now all calls to 2D texture will only effect this texture
+	// bound through the state cache, which would otherwise not know unit 0 changed
+	glState().bindTexture(0, GL_TEXTURE_2D, texture);
+	// set the texture wrap parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// set the texture filtering parameters - scaling texture
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// check that data loaded correctly, set the texture to the image, and generate mipmaps for texture
+	if (image)
+	{
+		GLenum format = image.channels == 4 ? GL_RGBA : image.channels == 3 ? GL_RGB : image.channels == 2 ? GL_RG : GL_RED;
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	else
+	{
+		std::cout << "ERROR::TEXTURE - Failed to load texture " << image.path << ": " << image.error << std::endl;
+	}
+	return texture;
+}
+
 // check if the user pressed ESC and set close window if they did
 void processInput(GLFWwindow *window)
 {
@@ -0,0 +1,152 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <experimental/filesystem>
+
+#ifdef _WIN32
+// the four Win32 calls the watcher makes, declared the way stb_image.h declares
+// its own. including <windows.h> instead would pull it into every file that uses
+// a Shader, after glad.h has already defined APIENTRY
+extern "C" {
+__declspec(dllimport) void* __stdcall FindFirstChangeNotificationA(const char* pathName, int watchSubtree, unsigned long notifyFilter);
+__declspec(dllimport) int __stdcall FindNextChangeNotification(void* handle);
+__declspec(dllimport) int __stdcall FindCloseChangeNotification(void* handle);
+__declspec(dllimport) unsigned long __stdcall WaitForSingleObject(void* handle, unsigned long milliseconds);
+}
+#else
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+// tells whether any of a fixed set of files was saved since the last check.
+// the directories are watched rather than the files, because most editors
+// save by writing a new file and renaming it over the old one. changed()
+// never blocks and costs one system call when nothing happened
+class FileWatcher
+{
+public:
+	explicit FileWatcher(const std::vector<std::string>& paths)
+	{
+		for (const std::string& path : paths) {
+			std::experimental::filesystem::path file(path);
+			std::string dir = file.parent_path().string();
+			if (dir.empty())
+				dir = ".";
+			size_t i = 0;
+			while (i < dirs.size() && dirs[i].path != dir)
+				++i;
+			if (i == dirs.size())
+				addDirectory(dir);
+			dirs[i].names.push_back(file.filename().string());
+#ifdef _WIN32
+			dirs[i].times.push_back(writeTime(dirs[i], dirs[i].names.size() - 1));
+#endif
+		}
+	}
+
+	~FileWatcher()
+	{
+#ifdef _WIN32
+		for (Directory& dir : dirs)
+			if (dir.handle != invalidHandle())
+				FindCloseChangeNotification(dir.handle);
+#else
+		if (fd >= 0)
+			close(fd);
+#endif
+	}
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	bool changed()
+	{
+		bool any = false;
+#ifdef _WIN32
+		// the notification only says something in the directory changed, so
+		// compare write times to ignore files we aren't watching
+		for (Directory& dir : dirs) {
+			if (dir.handle == invalidHandle() || WaitForSingleObject(dir.handle, 0) != WAIT_SIGNALED)
+				continue;
+			FindNextChangeNotification(dir.handle);
+			for (size_t i = 0; i < dir.names.size(); ++i) {
+				std::experimental::filesystem::file_time_type time = writeTime(dir, i);
+				if (time != dir.times[i]) {
+					dir.times[i] = time;
+					any = true;
+				}
+			}
+		}
+#else
+		if (fd < 0)
+			return false;
+		alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+		ssize_t length;
+		while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+			for (char* p = buffer; p < buffer + length;) {
+				const inotify_event* event = (const inotify_event*)p;
+				p += sizeof(inotify_event) + event->len;
+				if (event->len == 0)
+					continue;
+				for (const Directory& dir : dirs)
+					if (dir.wd == event->wd)
+						for (const std::string& name : dir.names)
+							any |= name == event->name;
+			}
+		}
+#endif
+		return any;
+	}
+
+private:
+	struct Directory
+	{
+		std::string path;
+		std::vector<std::string> names;
+#ifdef _WIN32
+		void* handle;
+		std::vector<std::experimental::filesystem::file_time_type> times;
+#else
+		int wd;
+#endif
+	};
+	std::vector<Directory> dirs;
+#ifndef _WIN32
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+	void addDirectory(const std::string& path)
+	{
+		Directory dir;
+		dir.path = path;
+#ifdef _WIN32
+		dir.handle = FindFirstChangeNotificationA(path.c_str(), 0, NOTIFY_LAST_WRITE | NOTIFY_FILE_NAME);
+#else
+		dir.wd = fd >= 0 ? inotify_add_watch(fd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) : -1;
+#endif
+		dirs.push_back(dir);
+	}
+
+#ifdef _WIN32
+	// FILE_NOTIFY_CHANGE_FILE_NAME, FILE_NOTIFY_CHANGE_LAST_WRITE and WAIT_OBJECT_0
+	enum : unsigned long { NOTIFY_FILE_NAME = 0x1, NOTIFY_LAST_WRITE = 0x10, WAIT_SIGNALED = 0 };
+
+	// INVALID_HANDLE_VALUE
+	static void* invalidHandle()
+	{
+		return (void*)(intptr_t)-1;
+	}
+
+	static std::experimental::filesystem::file_time_type writeTime(const Directory& dir, size_t i)
+	{
+		std::error_code error;
+		return std::experimental::filesystem::last_write_time(std::experimental::filesystem::path(dir.path) / dir.names[i], error);
+	}
+#endif
+};
+
+#endif
@@ -0,0 +1,117 @@
+// times loading every image in a directory three ways: unflipped, flipped by
+// the decoder writing its rows bottom-up, and unflipped followed by the
+// separate stbi__vertical_flip pass the decoders used to need. the difference
+// between the last two is the pass the decoders save; it's a copy of the whole
+// image, so point it at 4K textures to see it. the flipped loads are checked
+// against the unflipped ones flipped afterwards. it includes the stb_image
+// implementation to get at stbi__vertical_flip. no window or GL - it's left
+// out of the build like the other standalone files, so build it on its own in
+// Release, the numbers mean nothing in Debug
+//
+//     FlipBench textures/ [repeats]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fs = std::experimental::filesystem;
+
+bool isImage(const fs::path& path)
+{
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp" || extension == ".tga";
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+stbi_uc* load(const std::vector<stbi_uc>& file, bool flip, int* x, int* y, int* n)
+{
+	stbi_load_options options;
+	stbi_load_options_init(&options);
+	options.flip_vertically = flip;
+	return stbi_load_from_memory_opts(file.data(), (int)file.size(), x, y, n, &options);
+}
+
+// milliseconds a load takes, best of repeats so page faults and the first
+// touch of the allocation don't count
+template<class Load>
+double bestMilliseconds(int repeats, Load loadOnce)
+{
+	double best = 1e30;
+	for (int run = 0; run < repeats; run++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		loadOnce();
+		best = std::min(best, secondsSince(start) * 1000.0);
+	}
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	const char* directory = argc > 1 ? argv[1] : ".";
+	const int repeats = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+
+	std::cout << std::left << std::setw(24) << "image" << std::right << std::setw(11) << "size" << std::setw(11) << "unflipped"
+		<< std::setw(11) << "flipped" << std::setw(11) << "then flip" << std::setw(11) << "saved" << std::endl;
+	int images = 0, different = 0;
+	double flippedTotal = 0.0, separateTotal = 0.0;
+	for (fs::directory_iterator it(directory), end; it != end; ++it) {
+		if (!fs::is_regular_file(it->status()) || !isImage(it->path()))
+			continue;
+		std::ifstream in(it->path().string(), std::ios::binary);
+		std::vector<stbi_uc> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		int x, y, n;
+		stbi_uc* reference = load(file, false, &x, &y, &n);
+		if (!reference)
+			continue;
+		const size_t bytes = (size_t)x * y * n;
+		stbi__vertical_flip(reference, x, y, n);
+		stbi_uc* flipped = load(file, true, &x, &y, &n);
+		bool same = flipped && std::memcmp(flipped, reference, bytes) == 0;
+		stbi_image_free(flipped);
+		stbi_image_free(reference);
+
+		double unflippedMs = bestMilliseconds(repeats, [&] { stbi_image_free(load(file, false, &x, &y, &n)); });
+		double flippedMs = bestMilliseconds(repeats, [&] { stbi_image_free(load(file, true, &x, &y, &n)); });
+		double separateMs = bestMilliseconds(repeats, [&] {
+			stbi_uc* pixels = load(file, false, &x, &y, &n);
+			stbi__vertical_flip(pixels, x, y, n);
+			stbi_image_free(pixels);
+		});
+
+		std::string size = std::to_string(x) + "x" + std::to_string(y);
+		std::cout << std::fixed << std::setprecision(2) << std::left << std::setw(24) << it->path().filename().string().substr(0, 23)
+			<< std::right << std::setw(11) << size << std::setw(11) << unflippedMs << std::setw(11) << flippedMs
+			<< std::setw(11) << separateMs << std::setw(11) << separateMs - flippedMs << (same ? "" : "  DIFFER") << std::endl;
+		images++;
+		different += same ? 0 : 1;
+		flippedTotal += flippedMs;
+		separateTotal += separateMs;
+	}
+	if (!images) {
+		std::cout << "No images in " << directory << std::endl;
+		return 1;
+	}
+	std::cout << std::setprecision(1) << images << " images, flipping while decoding took " << flippedTotal << " ms against "
+		<< separateTotal << " ms with the separate pass";
+	if (different)
+		std::cout << ", " << different << " DIFFER";
+	std::cout << std::endl;
+	return different ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+#ifndef FRAME_HISTOGRAM_H
+#define FRAME_HISTOGRAM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+// frame times counted in doubling millisecond buckets - under 1, 1-2, 2-4 and
+// so on up to 128 and over - so a stall stands out from the usual frames
+class FrameHistogram
+{
+public:
+	static const int BUCKETS = 9;
+
+	void add(double milliseconds)
+	{
+		int bucket = 0;
+		double limit = 1.0;
+		while (bucket < BUCKETS - 1 && milliseconds >= limit) {
+			++bucket;
+			limit *= 2.0;
+		}
+		++counts[bucket];
+		++frames;
+		total += milliseconds;
+		slowest = std::max(slowest, milliseconds);
+	}
+
+	size_t count() const
+	{
+		return frames;
+	}
+
+	double worst() const
+	{
+		return slowest;
+	}
+
+	double average() const
+	{
+		return frames ? total / frames : 0.0;
+	}
+
+	// one line per bucket, with a bar scaled to the fullest one
+	void print(std::ostream& out) const
+	{
+		size_t fullest = *std::max_element(counts, counts + BUCKETS);
+		double low = 0.0, high = 1.0;
+		for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+			out << std::setw(5) << low << " - ";
+			if (bucket < BUCKETS - 1)
+				out << std::left << std::setw(5) << high << std::right;
+			else
+				out << "     ";
+			size_t bar = fullest ? (counts[bucket] * 40 + fullest - 1) / fullest : 0;
+			out << " ms " << std::setw(7) << counts[bucket] << " " << std::string(bar, '#') << "\n";
+			low = high;
+			high *= 2.0;
+		}
+		out << frames << " frames, average " << average() << " ms, worst " << slowest << " ms" << std::endl;
+	}
+
+private:
+	size_t counts[BUCKETS] = {};
+	size_t frames = 0;
+	double total = 0.0, slowest = 0.0;
+};
+
+#endif
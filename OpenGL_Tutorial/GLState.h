@@ -0,0 +1,225 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// shadows the GL state the render loops set every frame and only calls GL
+// when a value actually changes. everything starts out unknown, so the first
+// call for each piece of state always goes through. code that changes the same
+// state with raw GL calls has to call invalidate() afterwards, or the shadow
+// copy goes stale and a needed call gets skipped
+//
+//     GLState& state = glState();
+//     state.bindTexture(0, GL_TEXTURE_2D, texture1);
+//     state.bindVertexArray(VAO);
+//     ...
+//     state.endFrame(); // state.lastFrame() now has this frame's counts
+class GLState
+{
+public:
+	// calls made to GL and calls dropped because they would change nothing
+	struct Counters
+	{
+		unsigned int issued = 0;
+		unsigned int skipped = 0;
+	};
+
+	GLState()
+	{
+		invalidate();
+	}
+
+	GLState(const GLState&) = delete;
+	GLState& operator=(const GLState&) = delete;
+
+	// forget everything, so every next call goes through to GL
+	void invalidate()
+	{
+		program = UNKNOWN;
+		vertexArray = UNKNOWN;
+		activeUnit = UNKNOWN;
+		for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; ++unit) {
+			textures[unit].target = 0;
+			textures[unit].texture = UNKNOWN;
+		}
+		for (int cap = 0; cap < CAPABILITY_COUNT; ++cap)
+			capabilities[cap] = -1;
+		blendSource = blendDestination = UNKNOWN;
+		depthFunction = UNKNOWN;
+		polygonFill = UNKNOWN;
+	}
+
+	void useProgram(GLuint id)
+	{
+		if (changed(program, id))
+			glUseProgram(id);
+	}
+
+	// call before deleting a program, in case a new program gets its name later
+	void forgetProgram(GLuint id)
+	{
+		if (program == id)
+			program = UNKNOWN;
+	}
+
+	void bindVertexArray(GLuint id)
+	{
+		if (changed(vertexArray, id))
+			glBindVertexArray(id);
+	}
+
+	void forgetVertexArray(GLuint id)
+	{
+		if (vertexArray == id)
+			vertexArray = UNKNOWN;
+	}
+
+	// bind texture to unit, switching the active unit only when the binding changes
+	void bindTexture(GLuint unit, GLenum target, GLuint texture)
+	{
+		if (unit >= MAX_TEXTURE_UNITS) {
+			activeTexture(unit);
+			glBindTexture(target, texture);
+			++current.issued;
+			return;
+		}
+		TextureBinding& binding = textures[unit];
+		if (binding.target == target && binding.texture == texture) {
+			++current.skipped;
+			return;
+		}
+		activeTexture(unit);
+		glBindTexture(target, texture);
+		++current.issued;
+		binding.target = target;
+		binding.texture = texture;
+	}
+
+	// GL_TEXTURE0 + unit; texture uploads bind to whatever unit is active, so
+	// they should go through bindTexture() too
+	void activeTexture(GLuint unit)
+	{
+		if (changed(activeUnit, unit))
+			glActiveTexture(GL_TEXTURE0 + unit);
+	}
+
+	// glEnable or glDisable for GL_DEPTH_TEST, GL_BLEND and GL_CULL_FACE; any
+	// other capability is passed straight through
+	void setEnabled(GLenum capability, bool enabled)
+	{
+		int slot = capabilitySlot(capability);
+		if (slot >= 0) {
+			if (capabilities[slot] == (int)enabled) {
+				++current.skipped;
+				return;
+			}
+			capabilities[slot] = enabled;
+		}
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+		++current.issued;
+	}
+
+	void blendFunc(GLenum source, GLenum destination)
+	{
+		if (blendSource == source && blendDestination == destination) {
+			++current.skipped;
+			return;
+		}
+		blendSource = source;
+		blendDestination = destination;
+		glBlendFunc(source, destination);
+		++current.issued;
+	}
+
+	void depthFunc(GLenum function)
+	{
+		if (changed(depthFunction, function))
+			glDepthFunc(function);
+	}
+
+	// core profile only has GL_FRONT_AND_BACK, so one mode covers both faces
+	void polygonMode(GLenum mode)
+	{
+		if (changed(polygonFill, mode))
+			glPolygonMode(GL_FRONT_AND_BACK, mode);
+	}
+
+	// counts since the last endFrame()
+	const Counters& frame() const
+	{
+		return current;
+	}
+
+	// counts of the frame before the last endFrame()
+	const Counters& lastFrame() const
+	{
+		return previous;
+	}
+
+	// counts since the state was created
+	const Counters& total() const
+	{
+		return totals;
+	}
+
+	void endFrame()
+	{
+		totals.issued += current.issued;
+		totals.skipped += current.skipped;
+		previous = current;
+		current = Counters();
+	}
+
+private:
+	static const GLuint UNKNOWN = 0xFFFFFFFFu;
+	static const unsigned int MAX_TEXTURE_UNITS = 32;
+	enum { DEPTH_TEST, BLEND, CULL_FACE, CAPABILITY_COUNT };
+
+	struct TextureBinding
+	{
+		GLenum target;
+		GLuint texture;
+	};
+
+	GLuint program, vertexArray, activeUnit;
+	TextureBinding textures[MAX_TEXTURE_UNITS];
+	// 1 enabled, 0 disabled, -1 unknown
+	int capabilities[CAPABILITY_COUNT];
+	GLenum blendSource, blendDestination, depthFunction, polygonFill;
+	Counters current, previous, totals;
+
+	// record value and count the call; true when GL has to be called
+	bool changed(GLuint& shadow, GLuint value)
+	{
+		if (shadow == value) {
+			++current.skipped;
+			return false;
+		}
+		shadow = value;
+		++current.issued;
+		return true;
+	}
+
+	static int capabilitySlot(GLenum capability)
+	{
+		switch (capability) {
+		case GL_DEPTH_TEST: return DEPTH_TEST;
+		case GL_BLEND: return BLEND;
+		case GL_CULL_FACE: return CULL_FACE;
+		default: return -1;
+		}
+	}
+};
+
+// the state of the one context these programs create; GL state belongs to the
+// context, so there is one tracker for all of it
+inline GLState& glState()
+{
+	static GLState state;
+	return state;
+}
+
+#endif
@@ -0,0 +1,150 @@
+// times stb_image's inflate on the zlib streams of every PNG in a directory,
+// and whole PNG decodes for comparison. build it twice, as is and with
+// STBI_NO_ZLIB_FAST defined, and run both on the same directory to compare the
+// table-driven loop with the symbol at a time one; the checksum has to come
+// out the same. no window or GL - it's left out of the build like the other
+// standalone files, so build it on its own in Release, the numbers mean
+// nothing in Debug
+//
+//     InflateBench pngs/ [repeats]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::experimental::filesystem;
+
+// a PNG's IDAT chunks joined back into one zlib stream
+struct Stream
+{
+	std::vector<stbi_uc> file, zlib;
+	int inflatedGuess;
+};
+
+unsigned int bigEndian32(const stbi_uc* p)
+{
+	return (unsigned int)p[0] << 24 | (unsigned int)p[1] << 16 | (unsigned int)p[2] << 8 | p[3];
+}
+
+// false for anything that isn't a PNG with a zlib header (iphone PNGs have none)
+bool extractStream(Stream& stream)
+{
+	const std::vector<stbi_uc>& file = stream.file;
+	static const stbi_uc signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	if (file.size() < 8 || std::memcmp(file.data(), signature, 8) != 0)
+		return false;
+	stream.inflatedGuess = 0;
+	for (size_t at = 8; at + 12 <= file.size();) {
+		size_t length = bigEndian32(&file[at]);
+		const stbi_uc* type = &file[at + 4];
+		const stbi_uc* data = &file[at + 8];
+		if (at + 12 + length > file.size())
+			return false;
+		if (std::memcmp(type, "IHDR", 4) == 0 && length >= 10) {
+			// the size the PNG decoder guesses: bytes per row plus the filter byte
+			static const int channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+			unsigned int width = bigEndian32(data), height = bigEndian32(data + 4);
+			int bits = data[8], colour = data[9] < 7 ? data[9] : 0;
+			stream.inflatedGuess = (int)std::min<size_t>(((size_t)width * bits * channels[colour] + 7) / 8 * height + height, 1 << 30);
+		}
+		else if (std::memcmp(type, "IDAT", 4) == 0) {
+			stream.zlib.insert(stream.zlib.end(), data, data + length);
+		}
+		else if (std::memcmp(type, "CgBI", 4) == 0) {
+			return false;
+		}
+		at += 12 + length;
+	}
+	return stream.zlib.size() > 2 && (stream.zlib[0] & 0x0f) == 8;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	const char* directory = argc > 1 ? argv[1] : ".";
+	const int repeats = argc > 2 ? std::max(1, std::atoi(argv[2])) : 10;
+
+	std::vector<Stream> streams;
+	size_t compressed = 0;
+	for (fs::directory_iterator it(directory), end; it != end; ++it) {
+		if (!fs::is_regular_file(it->status()))
+			continue;
+		Stream stream;
+		std::ifstream in(it->path().string(), std::ios::binary);
+		stream.file.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		if (!extractStream(stream))
+			continue;
+		compressed += stream.zlib.size();
+		streams.push_back(std::move(stream));
+	}
+	if (streams.empty()) {
+		std::cout << "No PNGs in " << directory << std::endl;
+		return 1;
+	}
+
+	// one untimed pass for the checksum, which also warms the caches
+	size_t inflated = 0;
+	unsigned long long checksum = 1469598103934665603ULL;
+	for (const Stream& stream : streams) {
+		int length = 0;
+		char* out = stbi_zlib_decode_malloc_guesssize((const char*)stream.zlib.data(), (int)stream.zlib.size(), stream.inflatedGuess, &length);
+		for (int i = 0; out && i < length; i++)
+			checksum = (checksum ^ (unsigned char)out[i]) * 1099511628211ULL;
+		inflated += out ? length : 0;
+		stbi_image_free(out);
+	}
+
+#ifdef STBI_NO_ZLIB_FAST
+	const char* loop = "one symbol at a time (STBI_NO_ZLIB_FAST)";
+#else
+	const char* loop = "table-driven fast loop";
+#endif
+	std::cout << streams.size() << " PNGs, " << compressed / (1024.0 * 1024.0) << " MB compressed, "
+		<< inflated / (1024.0 * 1024.0) << " MB inflated, " << loop << std::endl;
+	std::cout << "checksum " << std::hex << checksum << std::dec << std::endl;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int run = 0; run < repeats; run++) {
+		for (const Stream& stream : streams) {
+			int length;
+			stbi_image_free(stbi_zlib_decode_malloc_guesssize((const char*)stream.zlib.data(), (int)stream.zlib.size(), stream.inflatedGuess, &length));
+		}
+	}
+	double inflateSeconds = secondsSince(start);
+
+	size_t pixels = 0;
+	start = std::chrono::steady_clock::now();
+	for (int run = 0; run < repeats; run++) {
+		for (const Stream& stream : streams) {
+			int x, y, n;
+			stbi_uc* image = stbi_load_from_memory(stream.file.data(), (int)stream.file.size(), &x, &y, &n, 0);
+			if (image && run == 0)
+				pixels += (size_t)x * y * n;
+			stbi_image_free(image);
+		}
+	}
+	double decodeSeconds = secondsSince(start);
+
+	std::cout << std::fixed << std::setprecision(1)
+		<< "inflate:    " << std::setw(8) << inflated * repeats / inflateSeconds / (1024 * 1024) << " MB/s out, "
+		<< std::setw(7) << compressed * repeats / inflateSeconds / (1024 * 1024) << " MB/s in" << std::endl
+		<< "PNG decode: " << std::setw(8) << pixels * repeats / decodeSeconds / (1024 * 1024) << " MB/s of pixels, inflate "
+		<< std::setprecision(0) << inflateSeconds / decodeSeconds * 100.0 << "% of it" << std::endl;
+	return 0;
+}
@@ -0,0 +1,234 @@
+// draws a grid of spinning cubes the two ways Cubes can - one instanced draw
+// call reading each cube's model matrix from a per-instance attribute, or a
+// loop setting the model uniform and drawing each cube on its own - for 1,
+// 10, 100 cubes and so on up to the count asked for, and reports cubes drawn
+// a second and frames a second for both. the window is small and the cubes
+// are flat-shaded so the time goes to submitting draws rather than filling
+// pixels. both paths draw the same matrices with the same vertex maths, so
+// the last frame of each is read back and has to match. it opens a hidden
+// GLFW window for the context and writes its two shaders under the temp
+// directory. it's left out of the build like the other standalone files, so
+// build it on its own in Release, the numbers mean nothing in Debug
+//
+//     InstancingBench [cubes] [frames]
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include "MyShader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::experimental::filesystem;
+
+const int WINDOW_SIZE = 256;
+
+// the same vertex maths in both, so they rasterize the same pixels
+const char* VERTEX_LOOP =
+	"#version 330 core\n"
+	"layout (location = 0) in vec3 aPos;\n"
+	"uniform mat4 viewProjection;\n"
+	"uniform mat4 model;\n"
+	"out vec3 colour;\n"
+	"void main()\n{\n"
+	"\tgl_Position = viewProjection * model * vec4(aPos, 1.0);\n"
+	"\tcolour = aPos + 0.5;\n}\n";
+const char* VERTEX_INSTANCED =
+	"#version 330 core\n"
+	"layout (location = 0) in vec3 aPos;\n"
+	"// per-instance model matrix - a mat4 attribute takes up locations 2 to 5\n"
+	"layout (location = 2) in mat4 aModel;\n"
+	"uniform mat4 viewProjection;\n"
+	"out vec3 colour;\n"
+	"void main()\n{\n"
+	"\tgl_Position = viewProjection * aModel * vec4(aPos, 1.0);\n"
+	"\tcolour = aPos + 0.5;\n}\n";
+const char* FRAGMENT =
+	"#version 330 core\n"
+	"in vec3 colour;\n"
+	"out vec4 FragColor;\n"
+	"void main()\n{\n"
+	"\tFragColor = vec4(colour, 1.0);\n}\n";
+
+// the eight corners of a unit cube and its twelve triangles
+const float CORNERS[] = {
+	-0.5f, -0.5f, -0.5f,   0.5f, -0.5f, -0.5f,   0.5f,  0.5f, -0.5f,  -0.5f,  0.5f, -0.5f,
+	-0.5f, -0.5f,  0.5f,   0.5f, -0.5f,  0.5f,   0.5f,  0.5f,  0.5f,  -0.5f,  0.5f,  0.5f
+};
+const unsigned int TRIANGLES[] = {
+	0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,  0, 1, 5, 0, 5, 4,
+	3, 6, 2, 3, 7, 6,  0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5
+};
+const GLsizei INDEX_COUNT = sizeof(TRIANGLES) / sizeof(TRIANGLES[0]);
+
+void writeFile(const fs::path& path, const char* text)
+{
+	std::ofstream file(path.string());
+	file << text;
+}
+
+// count cubes on a square grid filling the view, each turned a little further
+// than the last, like the spin Cubes gives cube i
+std::vector<glm::mat4> gridModels(unsigned int count)
+{
+	unsigned int side = (unsigned int)std::ceil(std::sqrt((double)count));
+	float spacing = 2.0f / side;
+	std::vector<glm::mat4> models(count);
+	for (unsigned int i = 0; i < count; i++) {
+		glm::vec3 position(-1.0f + spacing * (i % side + 0.5f), -1.0f + spacing * (i / side + 0.5f), 0.0f);
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+		model = glm::rotate(model, glm::radians(20.0f * i), glm::vec3(1.0f, 0.3f, 0.5f));
+		models[i] = glm::scale(model, glm::vec3(spacing * 0.6f));
+	}
+	return models;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned int maxCubes = argc > 1 ? (unsigned int)std::max(1, std::atoi(argv[1])) : 100000;
+	const int frames = argc > 2 ? std::max(1, std::atoi(argv[2])) : 20;
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(WINDOW_SIZE, WINDOW_SIZE, "InstancingBench", NULL, NULL);
+	if (window == NULL)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	// draw as fast as possible instead of at the monitor's rate
+	glfwSwapInterval(0);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+	std::cout << "cubes drawn on " << glGetString(GL_RENDERER) << ", " << frames << " frames a count" << std::endl;
+
+	bool allSame = true;
+	{
+		fs::path directory = fs::temp_directory_path() / "InstancingBench";
+		fs::create_directories(directory);
+		writeFile(directory / "loop.vs", VERTEX_LOOP);
+		writeFile(directory / "instanced.vs", VERTEX_INSTANCED);
+		writeFile(directory / "cube.fs", FRAGMENT);
+		Shader loopShader((directory / "loop.vs").string().c_str(), (directory / "cube.fs").string().c_str());
+		Shader instancedShader((directory / "instanced.vs").string().c_str(), (directory / "cube.fs").string().c_str());
+		std::error_code error;
+		fs::remove_all(directory, error);
+
+		unsigned int VAO, VBO, EBO, instanceVBO;
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+		glGenBuffers(1, &instanceVBO);
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(CORNERS), CORNERS, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(TRIANGLES), TRIANGLES, GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		// the instanced shader's matrix columns; enabled only while it draws, as in Cubes
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		for (unsigned int column = 0; column < 4; column++) {
+			glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(2 + column, 1);
+		}
+
+		glEnable(GL_DEPTH_TEST);
+		glViewport(0, 0, WINDOW_SIZE, WINDOW_SIZE);
+		glm::mat4 viewProjection = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+		std::vector<unsigned char> loopPixels(WINDOW_SIZE * WINDOW_SIZE * 4), instancedPixels(loopPixels.size());
+
+		std::cout << std::setw(8) << "cubes" << std::setw(24) << "loop cubes/s" << std::setw(10) << "fps"
+			<< std::setw(24) << "instanced cubes/s" << std::setw(10) << "fps" << std::setw(9) << "speedup" << std::endl;
+		for (unsigned int count = 1; count <= maxCubes; count *= 10) {
+			std::vector<glm::mat4> models = gridModels(count);
+
+			// per-cube loop: one uniform and one draw call per cube
+			loopShader.use();
+			glUniformMatrix4fv(loopShader.uniform("viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+			GLint modelLoc = loopShader.uniform("model");
+			auto drawLoop = [&] {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				for (unsigned int i = 0; i < count; i++) {
+					loopShader.setMat4(modelLoc, models[i]);
+					glDrawElements(GL_TRIANGLES, INDEX_COUNT, GL_UNSIGNED_INT, 0);
+				}
+				glFinish();
+			};
+			// one untimed frame first, drivers often finish compiling a program on its first draw
+			drawLoop();
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int frame = 0; frame < frames; frame++)
+				drawLoop();
+			double loopSeconds = secondsSince(start);
+			glReadPixels(0, 0, WINDOW_SIZE, WINDOW_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, loopPixels.data());
+
+			// instanced: the matrices uploaded every frame, as Cubes streams them, then one draw
+			instancedShader.use();
+			glUniformMatrix4fv(instancedShader.uniform("viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+			for (unsigned int column = 0; column < 4; column++)
+				glEnableVertexAttribArray(2 + column);
+			auto drawInstanced = [&] {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), models.data(), GL_STREAM_DRAW);
+				glDrawElementsInstanced(GL_TRIANGLES, INDEX_COUNT, GL_UNSIGNED_INT, 0, count);
+				glFinish();
+			};
+			drawInstanced();
+			start = std::chrono::steady_clock::now();
+			for (int frame = 0; frame < frames; frame++)
+				drawInstanced();
+			double instancedSeconds = secondsSince(start);
+			glReadPixels(0, 0, WINDOW_SIZE, WINDOW_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, instancedPixels.data());
+			for (unsigned int column = 0; column < 4; column++)
+				glDisableVertexAttribArray(2 + column);
+
+			bool same = loopPixels == instancedPixels;
+			allSame = allSame && same;
+			std::cout << std::fixed << std::setprecision(0) << std::setw(8) << count
+				<< std::setw(24) << count * frames / loopSeconds << std::setw(10) << frames / loopSeconds
+				<< std::setw(24) << count * frames / instancedSeconds << std::setw(10) << frames / instancedSeconds
+				<< std::setprecision(1) << std::setw(8) << loopSeconds / instancedSeconds << "x"
+				<< (same ? "" : "  IMAGES DIFFER") << std::endl;
+			if (count > maxCubes / 10)
+				break;
+		}
+
+		glDeleteBuffers(1, &instanceVBO);
+		glDeleteBuffers(1, &EBO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteProgram(instancedShader.ID);
+		glDeleteProgram(loopShader.ID);
+	}
+
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return allSame ? 0 : 1;
+}
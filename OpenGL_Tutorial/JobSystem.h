@@ -0,0 +1,187 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a lock-free list any number of threads push onto and one thread empties in
+// a single exchange. taking everything at once is what keeps it free of the
+// ABA problem a one-at-a-time pop would have. T needs a T* next member
+template<class T>
+class AtomicList
+{
+public:
+	void push(T* node)
+	{
+		node->next = head.load(std::memory_order_relaxed);
+		while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+			;
+	}
+
+	// everything pushed so far, newest first
+	T* takeAll()
+	{
+		return head.exchange(nullptr, std::memory_order_acquire);
+	}
+
+	bool empty() const
+	{
+		return head.load(std::memory_order_relaxed) == nullptr;
+	}
+
+private:
+	std::atomic<T*> head{ nullptr };
+};
+
+// fire-and-forget jobs run on a fixed set of worker threads. each worker has
+// its own queue, ordered by priority; submit() deals jobs out to the queues in
+// turn, and a worker whose queue runs dry steals the most urgent job from the
+// others before going to sleep. the worker's index is passed to the job, so
+// jobs can keep scratch memory per worker instead of sharing it:
+//
+//     JobSystem jobs;
+//     std::vector<Scratch> scratch(jobs.threadCount());
+//     jobs.submit([&](unsigned int worker) { work(scratch[worker]); }, distance);
+class JobSystem
+{
+public:
+	typedef std::function<void(unsigned int worker)> Job;
+
+	// threadCount 0 leaves one hardware thread for the render thread
+	explicit JobSystem(unsigned int threadCount = 0)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+		for (unsigned int i = 0; i < threadCount; ++i)
+			queues.emplace_back(new Queue());
+		for (unsigned int i = 0; i < threadCount; ++i)
+			workers.emplace_back(&JobSystem::workerMain, this, i);
+	}
+
+	// jobs still queued are dropped; the ones already running finish first
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	unsigned int threadCount() const
+	{
+		return (unsigned int)workers.size();
+	}
+
+	// lower priority runs sooner
+	void submit(Job job, float priority = 0.0f)
+	{
+		unfinished.fetch_add(1, std::memory_order_relaxed);
+		Queue& queue = *queues[nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(Entry{ priority, std::move(job) });
+			std::push_heap(queue.jobs.begin(), queue.jobs.end());
+		}
+		queued.fetch_add(1, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		wake.notify_one();
+	}
+
+	// jobs submitted that haven't finished running
+	size_t pending() const
+	{
+		return unfinished.load(std::memory_order_acquire);
+	}
+
+	// block until every submitted job has finished
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		idle.wait(lock, [this] { return unfinished.load(std::memory_order_acquire) == 0; });
+	}
+
+private:
+	struct Entry
+	{
+		float priority;
+		Job job;
+
+		// std heaps keep the largest on top, so the most urgent compares largest
+		bool operator<(const Entry& other) const
+		{
+			return priority > other.priority;
+		}
+	};
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::vector<Entry> jobs;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<size_t> nextQueue{ 0 };
+	// jobs sitting in a queue, and jobs queued or running
+	std::atomic<size_t> queued{ 0 }, unfinished{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wake, idle;
+	bool stopping = false;
+
+	bool pop(Queue& queue, Job& job)
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty())
+			return false;
+		std::pop_heap(queue.jobs.begin(), queue.jobs.end());
+		job = std::move(queue.jobs.back().job);
+		queue.jobs.pop_back();
+		queued.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// own queue first, then the others starting from the next one along
+	bool findJob(unsigned int worker, Job& job)
+	{
+		for (size_t i = 0; i < queues.size(); ++i)
+			if (pop(*queues[(worker + i) % queues.size()], job))
+				return true;
+		return false;
+	}
+
+	void workerMain(unsigned int worker)
+	{
+		for (;;) {
+			Job job;
+			if (!findJob(worker, job)) {
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+				if (stopping)
+					return;
+				continue;
+			}
+			job(worker);
+			if (unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				idle.notify_all();
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,210 @@
+// checks the JPEG decoder's AVX2 kernels - the two-block IDCT, YCbCr->RGB and
+// the 2x2 upsampler - give exactly the bytes the scalar and SSE2 ones give on
+// random input, then times all three versions of each. it includes the
+// stb_image implementation to get at its static kernels. no window or GL -
+// it's left out of the build like the other standalone files, so build it on
+// its own in Release, the numbers mean nothing in Debug
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// random 8x8 blocks of coefficients per IDCT measurement
+const int BLOCKS = 4096;
+// random rows per colour conversion and upsampling measurement, and their width
+const int ROWS = 256;
+const int ROW_WIDTH = 1920;
+// passes over the input per timing
+const int REPEATS = 50;
+
+std::mt19937 generator(1);
+
+// dequantized coefficients the way a real image has them: the DC term anywhere
+// in the 11-bit range the spec allows, the rest shrinking with frequency and
+// mostly zero in the high ones
+void randomBlock(short* data)
+{
+	data[0] = (short)((int)(generator() % 2048) - 1024);
+	for (int i = 1; i < 64; i++) {
+		int frequency = i / 8 + i % 8;
+		int range = 1024 >> (frequency / 2);
+		data[i] = generator() % 3 == 0 ? 0 : (short)((int)(generator() % (2 * range + 1)) - range);
+	}
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// run pass REPEATS times and return MB/s of the bytes one pass writes
+template<class Pass>
+double megabytesPerSecond(size_t bytes, Pass pass)
+{
+	pass();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int run = 0; run < REPEATS; run++)
+		pass();
+	return bytes * REPEATS / secondsSince(start) / (1024 * 1024);
+}
+
+void report(const char* kernel, const char* version, double speed, bool same)
+{
+	std::cout << std::fixed << std::setprecision(0) << "  " << std::left << std::setw(14) << kernel << std::setw(7) << version << std::right << std::setw(8) << speed
+		<< " MB/s" << (same ? "" : "  OUTPUT DIFFERS") << std::endl;
+}
+
+void measureIdct(bool sse2, bool avx2)
+{
+	// the simd versions load the coefficients with aligned loads
+	std::vector<short> blocks(BLOCKS * 64 + 16);
+	short* data = (short*)(((size_t)blocks.data() + 31) & ~(size_t)31);
+	for (int b = 0; b < BLOCKS; b++)
+		randomBlock(data + b * 64);
+	const size_t bytes = (size_t)BLOCKS * 64;
+	std::vector<stbi_uc> reference(bytes), out(bytes);
+
+	report("IDCT", "scalar", megabytesPerSecond(bytes, [&] {
+		for (int b = 0; b < BLOCKS; b++)
+			stbi__idct_block(&reference[b * 64], 8, data + b * 64);
+	}), true);
+#ifdef STBI_SSE2
+	if (sse2) {
+		double speed = megabytesPerSecond(bytes, [&] {
+			for (int b = 0; b < BLOCKS; b++)
+				stbi__idct_simd(&out[b * 64], 8, data + b * 64);
+		});
+		report("IDCT", "SSE2", speed, out == reference);
+	}
+#endif
+#ifdef STBI_AVX2
+	if (avx2) {
+		std::fill(out.begin(), out.end(), 0);
+		double speed = megabytesPerSecond(bytes, [&] {
+			for (int b = 0; b < BLOCKS; b += 2)
+				stbi__idct2_avx2(&out[b * 64], 8, data + b * 64, &out[(b + 1) * 64], 8, data + (b + 1) * 64);
+		});
+		report("IDCT", "AVX2", speed, out == reference);
+	}
+#endif
+	(void)sse2;
+	(void)avx2;
+}
+
+typedef void ColourKernel(stbi_uc* out, stbi_uc const* y, stbi_uc const* pcb, stbi_uc const* pcr, int count, int step);
+
+// every width from 1 up catches the tails the wide loops leave to scalar code
+bool sameColours(ColourKernel* kernel, const std::vector<stbi_uc>& planes)
+{
+	std::vector<stbi_uc> expected(ROW_WIDTH * 4), got(ROW_WIDTH * 4);
+	const stbi_uc* y = planes.data();
+	for (int count = 1; count <= 100; count++) {
+		stbi__YCbCr_to_RGB_row(expected.data(), y, y + ROW_WIDTH, y + 2 * ROW_WIDTH, count, 4);
+		kernel(got.data(), y, y + ROW_WIDTH, y + 2 * ROW_WIDTH, count, 4);
+		if (std::memcmp(expected.data(), got.data(), count * 4) != 0)
+			return false;
+	}
+	return true;
+}
+
+void measureColours(bool sse2, bool avx2)
+{
+	// y, cb and cr rows one after another, the decoder's four bytes a pixel out
+	std::vector<stbi_uc> planes((size_t)ROWS * 3 * ROW_WIDTH);
+	for (stbi_uc& sample : planes)
+		sample = (stbi_uc)generator();
+	const size_t bytes = (size_t)ROWS * ROW_WIDTH * 4;
+	std::vector<stbi_uc> reference(bytes), out(bytes);
+	auto pass = [&](ColourKernel* kernel, std::vector<stbi_uc>& into) {
+		for (int row = 0; row < ROWS; row++) {
+			const stbi_uc* y = &planes[(size_t)row * 3 * ROW_WIDTH];
+			kernel(&into[(size_t)row * ROW_WIDTH * 4], y, y + ROW_WIDTH, y + 2 * ROW_WIDTH, ROW_WIDTH, 4);
+		}
+	};
+
+	report("YCbCr->RGB", "scalar", megabytesPerSecond(bytes, [&] { pass(stbi__YCbCr_to_RGB_row, reference); }), true);
+#ifdef STBI_SSE2
+	if (sse2) {
+		double speed = megabytesPerSecond(bytes, [&] { pass(stbi__YCbCr_to_RGB_simd, out); });
+		report("YCbCr->RGB", "SSE2", speed, out == reference && sameColours(stbi__YCbCr_to_RGB_simd, planes));
+	}
+#endif
+#ifdef STBI_AVX2
+	if (avx2) {
+		std::fill(out.begin(), out.end(), 0);
+		double speed = megabytesPerSecond(bytes, [&] { pass(stbi__YCbCr_to_RGB_avx2, out); });
+		report("YCbCr->RGB", "AVX2", speed, out == reference && sameColours(stbi__YCbCr_to_RGB_avx2, planes));
+	}
+#endif
+	(void)sse2;
+	(void)avx2;
+}
+
+typedef stbi_uc* UpsampleKernel(stbi_uc* out, stbi_uc* in_near, stbi_uc* in_far, int w, int hs);
+
+bool sameUpsampling(UpsampleKernel* kernel, std::vector<stbi_uc>& rows)
+{
+	std::vector<stbi_uc> expected(ROW_WIDTH * 2), got(ROW_WIDTH * 2);
+	for (int w = 1; w <= 100; w++) {
+		stbi__resample_row_hv_2(expected.data(), &rows[0], &rows[ROW_WIDTH], w, 2);
+		kernel(got.data(), &rows[0], &rows[ROW_WIDTH], w, 2);
+		if (std::memcmp(expected.data(), got.data(), w * 2) != 0)
+			return false;
+	}
+	return true;
+}
+
+void measureUpsampling(bool sse2, bool avx2)
+{
+	// each output row blends a nearer and a farther chroma row, the 4:2:0 case
+	std::vector<stbi_uc> rows((size_t)(ROWS + 1) * ROW_WIDTH);
+	for (stbi_uc& sample : rows)
+		sample = (stbi_uc)generator();
+	const size_t bytes = (size_t)ROWS * ROW_WIDTH * 2;
+	std::vector<stbi_uc> reference(bytes), out(bytes);
+	auto pass = [&](UpsampleKernel* kernel, std::vector<stbi_uc>& into) {
+		for (int row = 0; row < ROWS; row++)
+			kernel(&into[(size_t)row * ROW_WIDTH * 2], &rows[(size_t)row * ROW_WIDTH], &rows[(size_t)(row + 1) * ROW_WIDTH], ROW_WIDTH, 2);
+	};
+
+	report("upsample hv_2", "scalar", megabytesPerSecond(bytes, [&] { pass(stbi__resample_row_hv_2, reference); }), true);
+#ifdef STBI_SSE2
+	if (sse2) {
+		double speed = megabytesPerSecond(bytes, [&] { pass(stbi__resample_row_hv_2_simd, out); });
+		report("upsample hv_2", "SSE2", speed, out == reference && sameUpsampling(stbi__resample_row_hv_2_simd, rows));
+	}
+#endif
+#ifdef STBI_AVX2
+	if (avx2) {
+		std::fill(out.begin(), out.end(), 0);
+		double speed = megabytesPerSecond(bytes, [&] { pass(stbi__resample_row_hv_2_avx2, out); });
+		report("upsample hv_2", "AVX2", speed, out == reference && sameUpsampling(stbi__resample_row_hv_2_avx2, rows));
+	}
+#endif
+	(void)sse2;
+	(void)avx2;
+}
+
+int main()
+{
+	bool sse2 = false, avx2 = false;
+#ifdef STBI_SSE2
+	sse2 = stbi__sse2_available() != 0;
+#endif
+#ifdef STBI_AVX2
+	avx2 = sse2 && stbi__avx2_available() != 0;
+#endif
+	std::cout << "SSE2 " << (sse2 ? "yes" : "no") << ", AVX2 " << (avx2 ? "yes" : "no") << std::endl;
+	measureIdct(sse2, avx2);
+	measureColours(sse2, avx2);
+	measureUpsampling(sse2, avx2);
+	return 0;
+}
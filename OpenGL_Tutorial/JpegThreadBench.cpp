@@ -0,0 +1,106 @@
+// times decoding one baseline JPEG with restart markers on 1 to N threads,
+// with stb_image's parallel_for running the restart intervals on a ThreadPool,
+// and checks every thread count gives the same pixels. the JPEG needs restart
+// markers, e.g. written by cjpeg -restart 1 or PIL's restart_marker_rows=1 -
+// without them every thread count decodes serially. no window or GL - it's
+// left out of the build like the other standalone files, so build it on its
+// own in Release, the numbers mean nothing in Debug
+//
+//     JpegThreadBench big_restarts.jpg [most threads, default one per hardware thread]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+// decodes per thread count, after one untimed warm up
+const int REPEATS = 10;
+
+// stbi_parallel_for on top of a ThreadPool - one task per chunk, so the pool
+// hands the intervals out as its threads free up
+void runTasks(void* user, void (*task)(void* arg, int index), void* arg, int count)
+{
+	ThreadPool* pool = (ThreadPool*)user;
+	pool->parallelFor((size_t)count, 1, [=](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			task(arg, (int)i);
+	});
+}
+
+// a DRI segment before the first scan means the image has restart intervals
+bool hasRestartMarkers(const std::vector<unsigned char>& file)
+{
+	for (size_t i = 2; i + 1 < file.size(); i++) {
+		if (file[i] != 0xFF)
+			continue;
+		if (file[i + 1] == 0xDD)
+			return true;
+		if (file[i + 1] == 0xDA)
+			return false;
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "container.jpg";
+	std::ifstream in(path, std::ios::binary);
+	std::vector<unsigned char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (file.empty()) {
+		std::cout << "Can't read " << path << std::endl;
+		return 1;
+	}
+	if (!hasRestartMarkers(file))
+		std::cout << path << " has no restart markers, so it always decodes on one thread" << std::endl;
+
+	int width = 0, height = 0, channels = 0;
+	stbi_uc* reference = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &channels, 0);
+	if (!reference) {
+		std::cout << "Can't decode " << path << ": " << stbi_failure_reason() << std::endl;
+		return 1;
+	}
+	size_t bytes = (size_t)width * height * channels;
+	std::cout << path << ": " << width << "x" << height << "x" << channels << std::endl;
+
+	// 1, 2, 4, ... and the most asked for
+	unsigned int most = argc > 2 ? (unsigned int)std::max(1, std::atoi(argv[2])) : std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int threads = 1; threads < most; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(most);
+
+	for (unsigned int threads : threadCounts) {
+		ThreadPool pool(threads);
+		stbi_load_options options;
+		stbi_load_options_init(&options);
+		options.jpeg_threads = (int)threads;
+		options.parallel_for = runTasks;
+		options.parallel_user = &pool;
+
+		bool same = true;
+		double seconds = 0.0;
+		for (int run = 0; run <= REPEATS; run++) {
+			int x, y, n;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			stbi_uc* pixels = stbi_load_from_memory_opts(file.data(), (int)file.size(), &x, &y, &n, &options);
+			if (run > 0)
+				seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			same = same && pixels && std::memcmp(pixels, reference, bytes) == 0;
+			stbi_image_free(pixels);
+		}
+		std::cout << threads << (threads == 1 ? " thread:  " : " threads: ") << bytes * REPEATS / seconds / (1024 * 1024)
+			<< " MB/s" << (same ? "" : "  OUTPUT DIFFERS") << std::endl;
+	}
+	stbi_image_free(reference);
+	return 0;
+}
@@ -0,0 +1,199 @@
+#ifndef MESH_BUILDER_H
+#define MESH_BUILDER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// a triangle list as a vertex buffer plus an index buffer for glDrawElements
+struct IndexedMesh
+{
+	// floatsPerVertex floats per vertex, laid out the same as the input was
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	unsigned int floatsPerVertex = 0;
+
+	size_t vertexCount() const
+	{
+		return floatsPerVertex ? vertices.size() / floatsPerVertex : 0;
+	}
+};
+
+// turn an expanded triangle list (three vertices per triangle, like the arrays
+// handed to glDrawArrays) into unique vertices and indices. vertices match when
+// every float matches, so a corner shared by two faces with different texture
+// coordinates stays two vertices
+inline IndexedMesh weldVertices(const float* vertices, size_t vertexCount, unsigned int floatsPerVertex)
+{
+	IndexedMesh mesh;
+	mesh.floatsPerVertex = floatsPerVertex;
+	mesh.indices.reserve(vertexCount);
+
+	// open addressed table of indices into mesh.vertices, at most half full
+	size_t tableSize = 1;
+	while (tableSize < vertexCount * 2)
+		tableSize <<= 1;
+	std::vector<unsigned int> table(tableSize, ~0u);
+
+	for (size_t i = 0; i < vertexCount; ++i) {
+		const float* vertex = vertices + i * floatsPerVertex;
+		// FNV-1a over the bits, with -0 counted as 0 so those weld too
+		uint32_t hash = 2166136261u;
+		for (unsigned int k = 0; k < floatsPerVertex; ++k) {
+			float value = vertex[k] == 0.0f ? 0.0f : vertex[k];
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			hash = (hash ^ bits) * 16777619u;
+		}
+		size_t slot = hash & (tableSize - 1);
+		for (;;) {
+			unsigned int index = table[slot];
+			if (index == ~0u) {
+				index = (unsigned int)mesh.vertexCount();
+				mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + floatsPerVertex);
+				table[slot] = index;
+				mesh.indices.push_back(index);
+				break;
+			}
+			if (std::equal(vertex, vertex + floatsPerVertex, mesh.vertices.begin() + (size_t)index * floatsPerVertex)) {
+				mesh.indices.push_back(index);
+				break;
+			}
+			slot = (slot + 1) & (tableSize - 1);
+		}
+	}
+	return mesh;
+}
+
+// average cache miss ratio: vertices the GPU has to shade per triangle with a
+// FIFO post-transform cache of cacheSize entries. 3 means nothing is reused,
+// 0.5 is the floor for large regular grids
+inline float averageCacheMissRatio(const std::vector<unsigned int>& indices, unsigned int cacheSize = 16)
+{
+	if (indices.size() < 3)
+		return 0.0f;
+	std::vector<unsigned int> cache;
+	size_t misses = 0;
+	for (unsigned int index : indices) {
+		if (std::find(cache.begin(), cache.end(), index) != cache.end())
+			continue;
+		++misses;
+		cache.push_back(index);
+		if (cache.size() > cacheSize)
+			cache.erase(cache.begin());
+	}
+	return (float)misses / (float)(indices.size() / 3);
+}
+
+// reorder the triangles so vertices are reused while they are still in the
+// post-transform cache. this is Tipsify (Sander, Nehab, Barczak 2007): fan out
+// around one vertex at a time, moving on to the neighbour that will still be in
+// the cache, or back to a recent vertex with triangles left when there is none
+inline void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// the triangles using each vertex, in one array with an offset per vertex
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (unsigned int index : indices)
+		++liveTriangles[index];
+	std::vector<size_t> adjacencyStart(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+		adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+	std::vector<unsigned int> adjacency(indices.size());
+	{
+		std::vector<size_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i)
+			adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	// when each vertex last entered the cache, counted in cache insertions
+	std::vector<size_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnds, candidates, output;
+	output.reserve(indices.size());
+	size_t time = cacheSize + 1;
+	size_t cursor = 0;
+	long long fan = indices[0];
+
+	while (fan >= 0) {
+		candidates.clear();
+		for (size_t a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; ++a) {
+			unsigned int triangle = adjacency[a];
+			if (emitted[triangle])
+				continue;
+			emitted[triangle] = true;
+			for (int k = 0; k < 3; ++k) {
+				unsigned int v = indices[triangle * 3 + k];
+				output.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				--liveTriangles[v];
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+		}
+
+		// the candidate that will still be cached after its remaining triangles are
+		// emitted, preferring the one that has been there longest
+		fan = -1;
+		long long best = -1;
+		for (unsigned int v : candidates) {
+			if (liveTriangles[v] == 0)
+				continue;
+			long long priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+				priority = (long long)(time - cacheTime[v]);
+			if (priority > best) {
+				best = priority;
+				fan = v;
+			}
+		}
+		// dead end: the most recent vertex with triangles left, else the next one in input order
+		while (fan < 0 && !deadEnds.empty()) {
+			unsigned int v = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[v] > 0)
+				fan = v;
+		}
+		while (fan < 0 && cursor < vertexCount) {
+			if (liveTriangles[cursor] > 0)
+				fan = (long long)cursor;
+			++cursor;
+		}
+	}
+	indices.swap(output);
+}
+
+// renumber the vertices in the order the index buffer first uses them, so the
+// vertex fetch walks through memory front to back
+inline void optimizeVertexFetch(IndexedMesh& mesh)
+{
+	std::vector<unsigned int> remap(mesh.vertexCount(), ~0u);
+	std::vector<float> vertices;
+	vertices.reserve(mesh.vertices.size());
+	unsigned int next = 0;
+	for (unsigned int& index : mesh.indices) {
+		if (remap[index] == ~0u) {
+			remap[index] = next++;
+			const float* vertex = mesh.vertices.data() + (size_t)index * mesh.floatsPerVertex;
+			vertices.insert(vertices.end(), vertex, vertex + mesh.floatsPerVertex);
+		}
+		index = remap[index];
+	}
+	mesh.vertices.swap(vertices);
+}
+
+// weld, reorder for the post-transform cache and then for fetch order
+inline IndexedMesh buildIndexedMesh(const float* vertices, size_t vertexCount, unsigned int floatsPerVertex, unsigned int cacheSize = 16)
+{
+	IndexedMesh mesh = weldVertices(vertices, vertexCount, floatsPerVertex);
+	optimizeVertexCache(mesh.indices, mesh.vertexCount(), cacheSize);
+	optimizeVertexFetch(mesh);
+	return mesh;
+}
+
+#endif
@@ -2,18 +2,113 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include "glm/glm.hpp"
+#include "FileWatcher.h"
+#include "GLState.h"
+#include <cstdlib>
+#include <memory>
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <iterator>
+#include <experimental/filesystem>
+
+// program binaries need GL 4.1 or ARB_get_program_binary in the glad loader;
+// without them every Shader is compiled from source
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+#define SHADER_BINARY_CACHE
+#endif
+// with KHR_parallel_shader_compile a deferred Shader can be polled for
+// completion instead of blocking on the driver's compiler threads
+#if defined(GL_KHR_parallel_shader_compile)
+#define SHADER_PARALLEL_COMPILE
+#endif
+
+// binding points of the uniform blocks every program shares. after linking,
+// Shader binds any block with one of these names to its point, so the GLSL
+// only has to declare the block (explicit bindings need GLSL 4.20)
+enum SharedUniformBlock : GLuint
+{
+	PER_FRAME_BLOCK = 0, // PerFrame.h
+	SHARED_UNIFORM_BLOCK_COUNT
+};
+static const char* const sharedUniformBlockNames[SHARED_UNIFORM_BLOCK_COUNT] = { "PerFrame" };
+
+// 32-bit FNV-1a hash of a uniform name; constexpr so literal names hash at compile time
+constexpr unsigned int uniformHash(const char* name, unsigned int hash = 2166136261u)
+{
+	return *name ? uniformHash(name + 1, (hash ^ (unsigned char)*name) * 16777619u) : hash;
+}
+
+// a uniform name with its hash. string literals convert implicitly, so
+// setInt("texture2", 1) still works; declare it constexpr to be sure the hash
+// is computed by the compiler. only the pointer is kept, so the name has to
+// outlive the call:
+//
+//     constexpr UniformName MODEL("model");
+//     shader.setMat4(MODEL, model);
+struct UniformName
+{
+	unsigned int hash;
+	const char* name;
+
+	constexpr UniformName(const char* name) : hash(uniformHash(name)), name(name) {}
+	// runtime names are hashed on every call; prefer a literal or a location
+	UniformName(const std::string& name) : hash(uniformHash(name.c_str())), name(name.c_str()) {}
+};
+
+// per-user directory for the binary shader cache - %LOCALAPPDATA% on Windows,
+// $XDG_CACHE_HOME or ~/.cache elsewhere - or NULL if there's none. the cache
+// is opt-in: pass this to Shader or ShaderLibrary to turn it on
+inline const char* userShaderCacheDir()
+{
+	static const std::string dir = [] {
+		std::experimental::filesystem::path base;
+#ifdef _WIN32
+		char* value = NULL;
+		size_t length = 0;
+		if (_dupenv_s(&value, &length, "LOCALAPPDATA") == 0 && value)
+			base = value;
+		free(value);
+#else
+		const char* xdg = std::getenv("XDG_CACHE_HOME");
+		const char* home = std::getenv("HOME");
+		if (xdg && *xdg)
+			base = xdg;
+		else if (home && *home)
+			base = std::experimental::filesystem::path(home) / ".cache";
+#endif
+		return base.empty() ? std::string() : (base / "OpenGL_Tutorial" / "shader_cache").string();
+	}();
+	return dir.empty() ? NULL : dir.c_str();
+}
 
 class Shader
 {
 public:
 	// shader program ID
 	unsigned int ID;
-	// constructor reads and builds the shader
-	Shader(const GLchar* vertexPath, const GLchar* fragmentPath)
+
+	// tag for the constructor that only submits the program to the driver
+	struct Deferred {};
+
+	// constructor reads and builds the shader. given a binaryCacheDir, such as
+	// userShaderCacheDir(), the linked program is kept there keyed by the source
+	// text and the driver, so later runs skip the GLSL compiler; without one it
+	// always compiles from source
+	Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const char* binaryCacheDir = NULL)
+		: Shader(vertexPath, fragmentPath, binaryCacheDir, Deferred())
+	{
+		finishBuild();
+	}
+
+	// starts compiling and linking but doesn't wait for the driver; the build
+	// is finished by finishBuild() or the first use(). see ShaderLibrary
+	Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const char* binaryCacheDir, Deferred)
+		: vertexPath(vertexPath), fragmentPath(fragmentPath),
+		  cacheDir(binaryCacheDir ? binaryCacheDir : ""), useCache(binaryCacheDir != NULL)
 	{
 		// #1 retrieve the vertex / fragment source code from filePath
 		std::string vertexCode;
@@ -46,54 +141,367 @@ public:
 			std::cout << "Explanatory String:\n" << e.what() << std::endl;
 		}
 
-		// #2 Compile shaders
+		// #2 load the program from the binary cache, or submit it to the compiler
+		// if the cache has no entry for this source or the driver rejects the binary
+		if (binaryCacheDir && binaryCacheSupported())
+			cachePath = (std::experimental::filesystem::path(binaryCacheDir) / (binaryCacheKey(vertexCode, fragmentCode) + ".bin")).string();
+		if (cachePath.empty() || !loadProgramBinary(cachePath))
+			compileProgram(vertexCode, fragmentCode, !cachePath.empty());
+		else
+			cachePath.clear(); // nothing to write back
+		pending = true;
+	}
+
+	// true once finishBuild() won't block. without KHR_parallel_shader_compile
+	// there is no way to ask, so a pending program always reports ready
+	bool buildReady() const
+	{
+		if (!pending)
+			return true;
+#ifdef SHADER_PARALLEL_COMPILE
+		if (GLAD_GL_KHR_parallel_shader_compile) {
+			GLint done = GL_FALSE;
+			glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+			return done == GL_TRUE;
+		}
+#endif
+		return true;
+	}
+
+	// wait for the compiler, report errors, store the binary and read the
+	// uniform table; does nothing once the program is built. returns whether
+	// the program compiled and linked
+	bool finishBuild()
+	{
+		if (!pending)
+			return linked;
+		pending = false;
+		if (vertex) {
+			// check all three so every error gets printed
+			bool compiled = checkCompileErrors(vertex, "VERTEX_SHADER");
+			compiled = checkCompileErrors(fragment, "FRAGMENT_SHADER") && compiled;
+			linked = checkCompileErrors(ID, "SHADER_PROGRAM") && compiled;
+			// delete the shaders after linking
+			glDeleteShader(vertex);
+			glDeleteShader(fragment);
+			vertex = fragment = 0;
+			if (linked && !cachePath.empty())
+				saveProgramBinary(cachePath);
+		}
+		else {
+			linked = true; // loadProgramBinary only keeps programs that linked
+		}
+		// #3 cache every active uniform location and hook up the shared blocks
+		buildUniformTable();
+		if (linked)
+			bindSharedUniformBlocks();
+		return linked;
+	}
+
+	// start watching the vertex and fragment files so reloadIfChanged() can
+	// rebuild the program whenever one of them is saved
+	void watchSources()
+	{
+		if (!watcher)
+			watcher.reset(new FileWatcher({ vertexPath, fragmentPath }));
+	}
+
+	// call once per frame, outside of any draw. after a save it submits a new
+	// build and keeps drawing with the current program until the driver has
+	// finished it, then swaps ID in. a build that fails to compile or link is
+	// thrown away and the current program stays. returns true on the frame ID
+	// changes: the new program starts with default uniform values, so set them
+	// again and look up any locations held outside the Shader
+	bool reloadIfChanged()
+	{
+		if (!watcher)
+			return false;
+		if (!rebuild) {
+			if (!watcher->changed())
+				return false;
+			rebuild.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), useCache ? cacheDir.c_str() : NULL, Deferred()));
+		}
+		if (!rebuild->buildReady())
+			return false;
+
+		std::unique_ptr<Shader> built = std::move(rebuild);
+		if (!built->finishBuild()) {
+			glDeleteProgram(built->ID);
+			std::cout << "ERROR::SHADER::RELOAD_FAILED - keeping the previous program" << std::endl;
+			return false;
+		}
+		glState().forgetProgram(ID);
+		glDeleteProgram(ID);
+		ID = built->ID;
+		uniformSlots.swap(built->uniformSlots);
+		return true;
+	}
+
+	// use and activate the shader
+	void use()
+	{
+		if (pending)
+			finishBuild();
+		// skipped when the program is already current
+		glState().useProgram(ID);
+	}
+
+	// location of an active uniform from the table built after linking. names
+	// the table doesn't hold, like "lights[2]" or a uniform the program doesn't
+	// have, go to glGetUniformLocation, which gives -1 (silently ignored by
+	// glUniform*) for the latter. locations never change after linking, so look
+	// them up once outside the render loop
+	GLint uniform(UniformName name) const
+	{
+		if (!uniformSlots.empty()) {
+			size_t mask = uniformSlots.size() - 1;
+			for (size_t i = name.hash & mask;; i = (i + 1) & mask) {
+				const UniformSlot& slot = uniformSlots[i];
+				if (slot.location == -1)
+					break;
+				if (slot.hash == name.hash && slot.name == name.name)
+					return slot.location;
+			}
+		}
+		return glGetUniformLocation(ID, name.name);
+	}
+
+	// utility uniform functions - set the value by cached location or by name
+	void setBool(GLint location, bool value) const
+	{
+		glUniform1i(location, (int) value);
+	}
+
+	void setBool(UniformName name, bool value) const
+	{
+		setBool(uniform(name), value);
+	}
+
+	void setInt(GLint location, int value) const
+	{
+		glUniform1i(location, value);
+	}
+
+	void setInt(UniformName name, int value) const
+	{
+		setInt(uniform(name), value);
+	}
+
+	void setFloat(GLint location, float value) const {
+		glUniform1f(location, value);
+	}
+
+	void setFloat(UniformName name, float value) const {
+		setFloat(uniform(name), value);
+	}
+
+	void setMat4(GLint location, const glm::mat4& value) const
+	{
+		glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+	}
+
+	void setMat4(UniformName name, const glm::mat4& value) const
+	{
+		setMat4(uniform(name), value);
+	}
+
+private:
+	// sources and settings, kept for reloading
+	std::string vertexPath, fragmentPath, cacheDir;
+	bool useCache;
+	std::unique_ptr<FileWatcher> watcher;
+	// the build reloadIfChanged() is waiting on
+	std::unique_ptr<Shader> rebuild;
+
+	// a submitted build that finishBuild() hasn't collected yet; vertex and
+	// fragment are 0 when the program came from the binary cache
+	bool pending = false;
+	bool linked = false;
+	unsigned int vertex = 0, fragment = 0;
+	// where to store the program binary once it has linked, empty for none
+	std::string cachePath;
+
+	// issues every compile and link call without querying any status, so a
+	// driver with compiler threads can work on it in the background
+	void compileProgram(const std::string& vertexCode, const std::string& fragmentCode, bool retrievable)
+	{
 		const char* vShaderCode = vertexCode.c_str();
 		const char* fShaderCode = fragmentCode.c_str();
-		unsigned int vertex, fragment;
 		// vertex shader
 		vertex = glCreateShader(GL_VERTEX_SHADER);
 		glShaderSource(vertex, 1, &vShaderCode, NULL);
 		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX_SHADER");
 		// fragment shader
 		fragment = glCreateShader(GL_FRAGMENT_SHADER);
 		glShaderSource(fragment, 1, &fShaderCode, NULL);
 		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT_SHADER");
 		// shader program
 		ID = glCreateProgram();
+#ifdef SHADER_BINARY_CACHE
+		if (retrievable)
+			glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
 		glAttachShader(ID, vertex);
 		glAttachShader(ID, fragment);
 		glLinkProgram(ID);
-		checkCompileErrors(ID, "SHADER_PROGRAM");
-		// delete the shaders after linking
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
 	}
 
-	// use and activate the shader
-	void use()
+	// cache file layout: "GLPB", binary format, binary length, then the binary itself
+	struct BinaryHeader
 	{
-		glUseProgram(ID);
+		char magic[4];
+		GLenum format;
+		GLint length;
+	};
+
+	static bool binaryCacheSupported()
+	{
+#ifdef SHADER_BINARY_CACHE
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0 && glProgramBinary && glGetProgramBinary;
+#else
+		return false;
+#endif
 	}
 
-	// utility uniform functions - query a uniform location and set the value
-	void setBool(const std::string &name, bool value) const
+	// 64-bit FNV-1a of both sources and the driver strings, as 16 hex digits;
+	// a driver update changes the key, so stale binaries are never even opened
+	static std::string binaryCacheKey(const std::string& vertexCode, const std::string& fragmentCode)
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int) value);
+		unsigned long long hash = 14695981039346656037ull;
+		auto mix = [&hash](const char* text) {
+			// the terminating zero keeps "ab"+"c" and "a"+"bc" apart
+			do {
+				hash = (hash ^ (unsigned char)*text) * 1099511628211ull;
+			} while (*text++);
+		};
+		mix(vertexCode.c_str());
+		mix(fragmentCode.c_str());
+		for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+			const GLubyte* value = glGetString(name);
+			mix(value ? (const char*)value : "");
+		}
+		char key[17];
+		for (int i = 15; i >= 0; --i, hash >>= 4)
+			key[i] = "0123456789abcdef"[hash & 15];
+		key[16] = '\0';
+		return key;
 	}
 
-	void setInt(const std::string &name, int value) const
+	bool loadProgramBinary(const std::string& path)
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+#ifdef SHADER_BINARY_CACHE
+		std::ifstream file(path, std::ios::binary);
+		BinaryHeader header;
+		if (!file.read((char*)&header, sizeof(header)) || std::string(header.magic, 4) != "GLPB" || header.length <= 0)
+			return false;
+		std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (binary.size() != (size_t)header.length)
+			return false;
+
+		ID = glCreateProgram();
+		glProgramBinary(ID, header.format, binary.data(), header.length);
+		int success;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		if (success)
+			return true;
+		// the driver changed in a way the key doesn't capture; recompile and overwrite the entry
+		glDeleteProgram(ID);
+		ID = 0;
+#endif
+		return false;
 	}
 
-	void setFloat(const std::string &name, float value) const {
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	void saveProgramBinary(const std::string& path) const
+	{
+#ifdef SHADER_BINARY_CACHE
+		int success = 0;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		BinaryHeader header = { { 'G', 'L', 'P', 'B' }, 0, 0 };
+		glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &header.length);
+		if (!success || header.length <= 0)
+			return;
+		std::vector<char> binary(header.length);
+		glGetProgramBinary(ID, header.length, &header.length, &header.format, binary.data());
+
+		std::error_code error;
+		std::experimental::filesystem::path dir = std::experimental::filesystem::path(path).parent_path();
+		if (!dir.empty())
+			std::experimental::filesystem::create_directories(dir, error);
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write((const char*)&header, sizeof(header));
+		file.write(binary.data(), header.length);
+		if (!file)
+			std::cout << "ERROR::SHADER::BINARY_CACHE_WRITE_FAILED\n" << path << std::endl;
+#endif
 	}
 
-private:
-	void checkCompileErrors(unsigned int shader, std::string type) {
+	// open-addressed hash table of name -> location, sized to a power of two
+	// and kept at most half full; an empty slot has location -1. the name is
+	// compared on a hash match, so two names with the same hash both resolve
+	struct UniformSlot
+	{
+		unsigned int hash;
+		GLint location;
+		std::string name;
+	};
+	std::vector<UniformSlot> uniformSlots;
+
+	void bindSharedUniformBlocks()
+	{
+		for (GLuint binding = 0; binding < SHARED_UNIFORM_BLOCK_COUNT; ++binding) {
+			GLuint index = glGetUniformBlockIndex(ID, sharedUniformBlockNames[binding]);
+			if (index != GL_INVALID_INDEX)
+				glUniformBlockBinding(ID, index, binding);
+		}
+	}
+
+	void buildUniformTable()
+	{
+		int count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		size_t size = 8;
+		// arrays are entered under both "name[0]" and "name"
+		while (size < (size_t)count * 4)
+			size *= 2;
+		uniformSlots.assign(size, UniformSlot{ 0, -1, std::string() });
+
+		std::vector<char> name(maxLength + 1);
+		for (int i = 0; i < count; ++i) {
+			GLsizei length = 0;
+			GLint arraySize = 0;
+			GLenum type = 0;
+			glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &arraySize, &type, name.data());
+			// members of uniform blocks have no location
+			GLint location = glGetUniformLocation(ID, name.data());
+			if (location < 0)
+				continue;
+			addUniform(name.data(), location);
+			if (length > 3 && std::string(name.data() + length - 3) == "[0]") {
+				name[length - 3] = '\0';
+				addUniform(name.data(), location);
+			}
+		}
+	}
+
+	void addUniform(const char* name, GLint location)
+	{
+		unsigned int hash = uniformHash(name);
+		size_t mask = uniformSlots.size() - 1;
+		for (size_t i = hash & mask;; i = (i + 1) & mask) {
+			UniformSlot& slot = uniformSlots[i];
+			if (slot.location == -1) {
+				slot = UniformSlot{ hash, location, name };
+				return;
+			}
+			if (slot.hash == hash && slot.name == name)
+				return;
+		}
+	}
+
+	bool checkCompileErrors(unsigned int shader, std::string type) {
 		int success;
 		char infoLog[1024];
 		// check vertex or fragment shader compilation
@@ -113,6 +521,7 @@ private:
 				std::cout << "ERROR::PROGRAM_LINKING_ERROR::" << type << "::COMPILATION_FAILED\n" << infoLog << std::endl;
 			}
 		}
+		return success != 0;
 	}
 };
 
@@ -0,0 +1,170 @@
+#ifndef OCTREE_CHUNK_H
+#define OCTREE_CHUNK_H
+
+#include "VoxelWorld.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// a chunk stored as a sparse voxel octree. each node covers a cube of blocks
+// and is either a leaf holding one block type for all of it or split into
+// eight children for its eighths. setting a block splits the leaves above it
+// and merges any eight children left holding the same type, so the tree only
+// goes deep where the contents change: an empty or solid chunk is one node, and
+// one that is mostly air with a surface through it a thousand or so. groups
+// freed by merging are reused but not returned; compact() packs the tree tight.
+//
+// a read walks down up to five levels, so this is the slowest store to access
+// and is meant for chunks that are mostly empty or uniform; a chunk whose
+// blocks vary everywhere takes more memory here than as a PaletteChunk
+class OctreeChunk
+{
+public:
+	OctreeChunk()
+		: nodes(1, LEAF | AIR)
+	{
+	}
+
+	BlockId get(int x, int y, int z) const
+	{
+		uint32_t n = 0;
+		for (int level = Chunk::SHIFT - 1; !(nodes[n] & LEAF); --level)
+			n = nodes[n] + childIndex(x, y, z, level);
+		return (BlockId)nodes[n];
+	}
+
+	void set(int x, int y, int z, BlockId block)
+	{
+		// the nodes from the root down to the block
+		uint32_t path[Chunk::SHIFT + 1];
+		uint32_t n = 0;
+		path[0] = 0;
+		for (int level = Chunk::SHIFT - 1; level >= 0; --level) {
+			if (nodes[n] & LEAF) {
+				// the leaf already holds block everywhere it covers
+				if ((BlockId)nodes[n] == block)
+					return;
+				split(n);
+			}
+			n = nodes[n] + childIndex(x, y, z, level);
+			path[Chunk::SHIFT - level] = n;
+		}
+		BlockId old = (BlockId)nodes[n];
+		if (old == block)
+			return;
+		nodes[n] = LEAF | block;
+		solidCount += (block != AIR) - (old != AIR);
+
+		// collapse the parents whose eight children now all hold block
+		for (int depth = Chunk::SHIFT - 1; depth >= 0; --depth) {
+			Node& parent = nodes[path[depth]];
+			const Node* child = &nodes[parent];
+			for (int c = 0; c < 8; ++c)
+				if (child[c] != (LEAF | block))
+					return;
+			freeGroups.push_back(parent);
+			parent = LEAF | block;
+		}
+	}
+
+	// the SIZE blocks of the row at (y, z), x from 0 up. each leaf the row
+	// passes through fills its whole width at once
+	void copyRow(int y, int z, BlockId* out) const
+	{
+		for (int x = 0; x < Chunk::SIZE;) {
+			uint32_t n = 0;
+			int level = Chunk::SHIFT;
+			while (!(nodes[n] & LEAF)) {
+				--level;
+				n = nodes[n] + childIndex(x, y, z, level);
+			}
+			int end = (x | ((1 << level) - 1)) + 1;
+			std::fill(out + x, out + end, (BlockId)nodes[n]);
+			x = end;
+		}
+	}
+
+	// copy the tree into a vector just big enough for the nodes in use
+	void compact()
+	{
+		std::vector<Node> packed(1);
+		packed.reserve(nodeCount());
+		copyNode(0, 0, packed);
+		nodes.swap(packed);
+		freeGroups.clear();
+		freeGroups.shrink_to_fit();
+	}
+
+	// blocks that aren't AIR
+	int solid() const
+	{
+		return solidCount;
+	}
+
+	bool empty() const
+	{
+		return solidCount == 0;
+	}
+
+	size_t memoryUsage() const
+	{
+		return sizeof(OctreeChunk) + nodes.capacity() * sizeof(Node) + freeGroups.capacity() * sizeof(uint32_t);
+	}
+
+	// nodes in use, leaves and split ones
+	size_t nodeCount() const
+	{
+		return nodes.size() - freeGroups.size() * 8;
+	}
+
+private:
+	// a leaf is LEAF | the block type of every block it covers; a split node is
+	// the index of the first of its eight consecutive children
+	typedef uint32_t Node;
+	static const Node LEAF = 0x80000000u;
+
+	std::vector<Node> nodes;
+	// first nodes of groups of eight freed by merging, reused before growing nodes
+	std::vector<uint32_t> freeGroups;
+	int solidCount = 0;
+
+	// which of a node's children holds (x, y, z), for children level levels above single blocks
+	static int childIndex(int x, int y, int z, int level)
+	{
+		return (x >> level & 1) | (y >> level & 1) << 1 | (z >> level & 1) << 2;
+	}
+
+	void copyNode(uint32_t from, uint32_t to, std::vector<Node>& packed) const
+	{
+		if (nodes[from] & LEAF) {
+			packed[to] = nodes[from];
+			return;
+		}
+		uint32_t first = (uint32_t)packed.size();
+		packed.resize(first + 8);
+		packed[to] = first;
+		for (int c = 0; c < 8; ++c)
+			copyNode(nodes[from] + c, first + c, packed);
+	}
+
+	void split(uint32_t n)
+	{
+		uint32_t first;
+		if (!freeGroups.empty()) {
+			first = freeGroups.back();
+			freeGroups.pop_back();
+		}
+		else {
+			first = (uint32_t)nodes.size();
+			nodes.resize(nodes.size() + 8);
+		}
+		std::fill(&nodes[first], &nodes[first] + 8, nodes[n]);
+		nodes[n] = first;
+	}
+};
+
+typedef BasicVoxelWorld<OctreeChunk> OctreeVoxelWorld;
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef PALETTE_CHUNK_H
+#define PALETTE_CHUNK_H
+
+#include "VoxelWorld.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// a chunk stored as a palette of the block types in it plus a bit-packed
+// palette index per block. indices are 0, 1, 2, 4, 8 or 16 bits wide - a power
+// of two, so none straddles two words - and widen when the palette outgrows
+// them. a chunk of one block type needs no indices at all, and one holding
+// air, stone, dirt and grass takes 2 bits a block: 8 KB where Chunk takes 64.
+//
+// a palette slot whose block type is gone gets reused by the next new type,
+// but the indices never narrow by themselves; compact() repacks them as tight
+// as the current contents allow. finding a block type in the palette is a
+// linear search, which is cheap for the handful of types a chunk usually has
+class PaletteChunk
+{
+public:
+	PaletteChunk()
+		: palette(1, AIR), counts(1, (uint16_t)Chunk::VOLUME)
+	{
+	}
+
+	BlockId get(int x, int y, int z) const
+	{
+		return palette[entryAt(Chunk::index(x, y, z))];
+	}
+
+	void set(int x, int y, int z, BlockId block)
+	{
+		int i = Chunk::index(x, y, z);
+		unsigned int old = entryAt(i);
+		if (palette[old] == block)
+			return;
+		unsigned int entry = findOrAdd(block);
+		--counts[old];
+		++counts[entry];
+		setEntry(i, entry);
+		solidCount += (block != AIR) - (palette[old] != AIR);
+	}
+
+	// the SIZE blocks of the row at (y, z), x from 0 up
+	void copyRow(int y, int z, BlockId* out) const
+	{
+		if (bits == 0) {
+			std::fill(out, out + Chunk::SIZE, palette[0]);
+			return;
+		}
+		// a row is SIZE indices, which always starts on a word
+		const uint32_t* row = &words[Chunk::index(0, y, z) >> perWordShift];
+		const uint32_t mask = (1u << bits) - 1;
+		const int perWord = 1 << perWordShift;
+		for (int x = 0; x < Chunk::SIZE; x += perWord) {
+			uint32_t word = *row++;
+			for (int k = 0; k < perWord; ++k, word >>= bits)
+				out[x + k] = palette[word & mask];
+		}
+	}
+
+	// drop unused palette slots and narrow the indices as far as they go
+	void compact()
+	{
+		std::vector<BlockId> usedPalette;
+		std::vector<uint16_t> usedCounts;
+		std::vector<uint32_t> remap(palette.size(), 0);
+		for (size_t e = 0; e < palette.size(); ++e) {
+			if (counts[e] == 0)
+				continue;
+			remap[e] = (uint32_t)usedPalette.size();
+			usedPalette.push_back(palette[e]);
+			usedCounts.push_back(counts[e]);
+		}
+		int newBits = 0;
+		while (newBits < 16 && ((size_t)1 << newBits) < usedPalette.size())
+			newBits = newBits ? newBits * 2 : 1;
+		repack(newBits, remap.data());
+		palette.swap(usedPalette);
+		counts.swap(usedCounts);
+		palette.shrink_to_fit();
+		counts.shrink_to_fit();
+	}
+
+	// blocks that aren't AIR
+	int solid() const
+	{
+		return solidCount;
+	}
+
+	bool empty() const
+	{
+		return solidCount == 0;
+	}
+
+	size_t memoryUsage() const
+	{
+		return sizeof(PaletteChunk) + palette.capacity() * sizeof(BlockId) + counts.capacity() * sizeof(uint16_t)
+			+ words.capacity() * sizeof(uint32_t);
+	}
+
+	// bits per block index, 0 when the whole chunk is one type
+	int indexBits() const
+	{
+		return bits;
+	}
+
+private:
+	std::vector<BlockId> palette;
+	// blocks using each palette slot; 0 marks a free slot
+	std::vector<uint16_t> counts;
+	std::vector<uint32_t> words;
+	int bits = 0;
+	// log2 of the indices per word, 32 / bits
+	int perWordShift = 0;
+	int solidCount = 0;
+
+	unsigned int entryAt(int i) const
+	{
+		if (bits == 0)
+			return 0;
+		uint32_t word = words[i >> perWordShift];
+		int shift = (i & ((1 << perWordShift) - 1)) * bits;
+		return (word >> shift) & ((1u << bits) - 1);
+	}
+
+	void setEntry(int i, unsigned int entry)
+	{
+		uint32_t& word = words[i >> perWordShift];
+		int shift = (i & ((1 << perWordShift) - 1)) * bits;
+		uint32_t mask = ((1u << bits) - 1) << shift;
+		word = (word & ~mask) | (entry << shift);
+	}
+
+	// the palette slot for block, adding it - and widening the indices - if it has none
+	unsigned int findOrAdd(BlockId block)
+	{
+		size_t free = palette.size();
+		for (size_t e = 0; e < palette.size(); ++e) {
+			if (palette[e] == block)
+				return (unsigned int)e;
+			if (counts[e] == 0 && free == palette.size())
+				free = e;
+		}
+		if (free < palette.size()) {
+			palette[free] = block;
+			return (unsigned int)free;
+		}
+		if (palette.size() >= ((size_t)1 << bits))
+			repack(bits ? bits * 2 : 1, nullptr);
+		palette.push_back(block);
+		counts.push_back(0);
+		return (unsigned int)(palette.size() - 1);
+	}
+
+	// rewrite every index at newBits wide, through remap when it is given
+	void repack(int newBits, const uint32_t* remap)
+	{
+		std::vector<uint32_t> old;
+		old.swap(words);
+		int oldBits = bits, oldShift = perWordShift;
+		bits = newBits;
+		perWordShift = 0;
+		while (newBits && (32 >> perWordShift) > newBits)
+			++perWordShift;
+		if (bits == 0)
+			return;
+		words.assign((size_t)Chunk::VOLUME >> perWordShift, 0);
+		for (int i = 0; i < Chunk::VOLUME; ++i) {
+			unsigned int entry = 0;
+			if (oldBits)
+				entry = (old[i >> oldShift] >> ((i & ((1 << oldShift) - 1)) * oldBits)) & ((1u << oldBits) - 1);
+			setEntry(i, remap ? remap[entry] : entry);
+		}
+	}
+};
+
+typedef BasicVoxelWorld<PaletteChunk> PaletteVoxelWorld;
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef PER_FRAME_H
+#define PER_FRAME_H
+
+#include "MyShader.h"
+#include "StreamBuffer.h"
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+// camera data shared by every program through the std140 block
+//
+//     layout (std140) uniform PerFrame
+//     {
+//         mat4 view;
+//         mat4 projection;
+//         mat4 viewProjection;
+//     };
+//
+// members and order have to match the GLSL declaration
+struct PerFrameData
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	// projection * view, so vertex shaders do one matrix multiply less per vertex
+	glm::mat4 viewProjection;
+};
+
+// std140 lays out a mat4 as four vec4 columns at 16-byte alignment, which is
+// exactly how glm stores it
+static_assert(sizeof(PerFrameData) == 3 * 64, "PerFrameData must match the std140 PerFrame block");
+static_assert(offsetof(PerFrameData, projection) == 64 && offsetof(PerFrameData, viewProjection) == 128, "PerFrameData must match the std140 PerFrame block");
+
+// the uniform buffer behind the PerFrame block; upload once per frame and every
+// program that declares the block sees the new camera without any glUniform calls
+class PerFrameBuffer
+{
+public:
+	PerFrameBuffer()
+	{
+		glGenBuffers(1, &ubo);
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(PerFrameData), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, PER_FRAME_BLOCK, ubo);
+	}
+
+	~PerFrameBuffer()
+	{
+		glDeleteBuffers(1, &ubo);
+	}
+
+	PerFrameBuffer(const PerFrameBuffer&) = delete;
+	PerFrameBuffer& operator=(const PerFrameBuffer&) = delete;
+
+	void update(const glm::mat4& view, const glm::mat4& projection)
+	{
+		PerFrameData data;
+		data.view = view;
+		data.projection = projection;
+		data.viewProjection = projection * view;
+		update(data);
+	}
+
+	void update(const PerFrameData& data)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PerFrameData), &data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		if (boundToStream) {
+			glBindBufferBase(GL_UNIFORM_BUFFER, PER_FRAME_BLOCK, ubo);
+			boundToStream = false;
+		}
+	}
+
+	// write this frame's block into the stream's current region and point the
+	// binding at it, which never waits on the GPU reading last frame's copy.
+	// falls back to the buffer of its own if the region is full
+	void update(const glm::mat4& view, const glm::mat4& projection, StreamBuffer& stream)
+	{
+		PerFrameData data;
+		data.view = view;
+		data.projection = projection;
+		data.viewProjection = projection * view;
+		update(data, stream);
+	}
+
+	void update(const PerFrameData& data, StreamBuffer& stream)
+	{
+		if (!uniformAlignment)
+			uniformAlignment = StreamBuffer::uniformAlignment();
+		StreamBuffer::Allocation slot = stream.allocate(sizeof(PerFrameData), uniformAlignment);
+		if (!slot.data) {
+			update(data);
+			return;
+		}
+		std::memcpy(slot.data, &data, sizeof(PerFrameData));
+		glBindBufferRange(GL_UNIFORM_BUFFER, PER_FRAME_BLOCK, stream.id(), slot.offset, sizeof(PerFrameData));
+		boundToStream = true;
+	}
+
+private:
+	unsigned int ubo = 0;
+	GLsizeiptr uniformAlignment = 0;
+	// the block is bound to a StreamBuffer range rather than ubo
+	bool boundToStream = false;
+};
+
+#endif
@@ -0,0 +1,185 @@
+// writes one 8-bit PNG per filter type - None, Sub, Up, Avg and Paeth on every
+// row - for RGB, RGBA and RGB loaded as RGBA, decodes each with stb_image and
+// checks the pixels come back exactly as they went in, then times the decodes.
+// the PNGs use stored deflate blocks so inflating them is little more than a
+// copy and the time is mostly unfiltering. build it as is for the SSE2/AVX2
+// kernels and again with STBI_NO_SIMD defined for the scalar path; both check
+// against the same source pixels, so they agree byte for byte. no window or
+// GL - it's left out of the build like the other standalone files, so build it
+// on its own in Release, the numbers mean nothing in Debug
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+const int WIDTH = 1024;
+const int HEIGHT = 1024;
+// decodes per image, after one untimed check
+const int REPEATS = 20;
+
+void put32(std::vector<stbi_uc>& out, unsigned int v)
+{
+	out.push_back((stbi_uc)(v >> 24));
+	out.push_back((stbi_uc)(v >> 16));
+	out.push_back((stbi_uc)(v >> 8));
+	out.push_back((stbi_uc)v);
+}
+
+unsigned int crc32(const stbi_uc* data, size_t length)
+{
+	static unsigned int table[256];
+	if (!table[1]) {
+		for (unsigned int n = 0; n < 256; n++) {
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+	}
+	unsigned int c = 0xffffffffu;
+	for (size_t i = 0; i < length; i++)
+		c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+	return c ^ 0xffffffffu;
+}
+
+void putChunk(std::vector<stbi_uc>& png, const char* type, const std::vector<stbi_uc>& data)
+{
+	put32(png, (unsigned int)data.size());
+	size_t start = png.size();
+	png.insert(png.end(), type, type + 4);
+	png.insert(png.end(), data.begin(), data.end());
+	put32(png, crc32(&png[start], png.size() - start));
+}
+
+int paeth(int a, int b, int c)
+{
+	int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc ? b : c;
+}
+
+// filter every row of pixels with one filter type, the way an encoder would
+std::vector<stbi_uc> filterRows(const std::vector<stbi_uc>& pixels, int channels, int filter)
+{
+	const size_t stride = (size_t)WIDTH * channels;
+	std::vector<stbi_uc> raw;
+	raw.reserve((stride + 1) * HEIGHT);
+	for (int y = 0; y < HEIGHT; y++) {
+		const stbi_uc* row = &pixels[y * stride];
+		const stbi_uc* prior = y ? row - stride : nullptr;
+		raw.push_back((stbi_uc)filter);
+		for (size_t i = 0; i < stride; i++) {
+			int a = i >= (size_t)channels ? row[i - channels] : 0;
+			int b = prior ? prior[i] : 0;
+			int c = prior && i >= (size_t)channels ? prior[i - channels] : 0;
+			int predicted = filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) >> 1 : filter == 4 ? paeth(a, b, c) : 0;
+			raw.push_back((stbi_uc)(row[i] - predicted));
+		}
+	}
+	return raw;
+}
+
+// a PNG whose zlib stream is stored blocks, so no deflate encoder is needed
+std::vector<stbi_uc> encodePng(const std::vector<stbi_uc>& pixels, int channels, int filter)
+{
+	std::vector<stbi_uc> raw = filterRows(pixels, channels, filter);
+	std::vector<stbi_uc> zlib = { 0x78, 0x01 };
+	for (size_t at = 0; at < raw.size();) {
+		size_t length = std::min<size_t>(raw.size() - at, 65535);
+		zlib.push_back(at + length == raw.size() ? 1 : 0);
+		zlib.push_back((stbi_uc)length);
+		zlib.push_back((stbi_uc)(length >> 8));
+		zlib.push_back((stbi_uc)~length);
+		zlib.push_back((stbi_uc)(~length >> 8));
+		zlib.insert(zlib.end(), raw.begin() + at, raw.begin() + at + length);
+		at += length;
+	}
+	unsigned int s1 = 1, s2 = 0;
+	for (stbi_uc byte : raw) {
+		s1 = (s1 + byte) % 65521;
+		s2 = (s2 + s1) % 65521;
+	}
+	put32(zlib, s2 << 16 | s1);
+
+	std::vector<stbi_uc> png = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	std::vector<stbi_uc> header;
+	put32(header, WIDTH);
+	put32(header, HEIGHT);
+	header.push_back(8);
+	header.push_back(channels == 4 ? 6 : 2);
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+	putChunk(png, "IHDR", header);
+	putChunk(png, "IDAT", zlib);
+	putChunk(png, "IEND", std::vector<stbi_uc>());
+	return png;
+}
+
+// smooth gradients with noise on top, so every filter has something to predict
+std::vector<stbi_uc> makePixels(int channels)
+{
+	std::mt19937 generator(channels);
+	std::vector<stbi_uc> pixels((size_t)WIDTH * HEIGHT * channels);
+	for (int y = 0; y < HEIGHT; y++)
+		for (int x = 0; x < WIDTH; x++)
+			for (int c = 0; c < channels; c++)
+				pixels[((size_t)y * WIDTH + x) * channels + c] = (stbi_uc)(x * (c + 1) + y * (3 - c) + generator() % 16);
+	return pixels;
+}
+
+int main()
+{
+#if defined(STBI_NO_SIMD)
+	const char* kernel = "scalar";
+#elif defined(STBI_AVX2)
+	const char* kernel = stbi__avx2_available() ? "AVX2" : stbi__sse2_available() ? "SSE2" : "scalar";
+#elif defined(STBI_SSE2)
+	const char* kernel = stbi__sse2_available() ? "SSE2" : "scalar";
+#else
+	const char* kernel = "scalar";
+#endif
+	std::cout << WIDTH << "x" << HEIGHT << " PNGs, " << kernel << " unfiltering" << std::endl;
+
+	const char* filterNames[5] = { "None", "Sub", "Up", "Avg", "Paeth" };
+	struct Layout { const char* name; int channels, loadAs; };
+	const Layout layouts[3] = { { "RGB", 3, 3 }, { "RGBA", 4, 4 }, { "RGB as RGBA", 3, 4 } };
+	bool allSame = true;
+
+	for (const Layout& layout : layouts) {
+		std::vector<stbi_uc> pixels = makePixels(layout.channels);
+		// what the decode should give: the source, with alpha added when loading RGB as RGBA
+		std::vector<stbi_uc> expected((size_t)WIDTH * HEIGHT * layout.loadAs, 255);
+		for (size_t i = 0; i < (size_t)WIDTH * HEIGHT; i++)
+			std::memcpy(&expected[i * layout.loadAs], &pixels[i * layout.channels], layout.channels);
+
+		std::cout << layout.name << ":" << std::endl;
+		for (int filter = 0; filter < 5; filter++) {
+			std::vector<stbi_uc> png = encodePng(pixels, layout.channels, filter);
+			int x, y, n;
+			stbi_uc* decoded = stbi_load_from_memory(png.data(), (int)png.size(), &x, &y, &n, layout.loadAs);
+			bool same = decoded && x == WIDTH && y == HEIGHT && std::memcmp(decoded, expected.data(), expected.size()) == 0;
+			stbi_image_free(decoded);
+			allSame = allSame && same;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int run = 0; run < REPEATS; run++)
+				stbi_image_free(stbi_load_from_memory(png.data(), (int)png.size(), &x, &y, &n, layout.loadAs));
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::cout << "  " << std::left << std::setw(6) << filterNames[filter] << std::right << std::fixed << std::setprecision(0)
+				<< std::setw(8) << expected.size() * REPEATS / seconds / (1024 * 1024) << " MB/s"
+				<< (same ? "" : "  PIXELS DIFFER") << std::endl;
+		}
+	}
+	std::cout << (allSame ? "every image decoded exactly" : "SOME IMAGES DECODED WRONG") << std::endl;
+	return allSame ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include "MyShader.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// owns a set of named shader programs whose builds overlap each other and the
+// rest of startup. add() only submits the sources to the driver; nothing waits
+// on the compiler until a program is first used or fetched with get():
+//
+//     ShaderLibrary shaders;
+//     Shader& cubes = shaders.add("cubes", "vShader.vs", "fShader.fs");
+//     ... load textures, build buffers ...
+//     cubes.use(); // finishes this one build if it is still pending
+//
+// with KHR_parallel_shader_compile the driver compiles on its own threads and
+// poll() collects whatever is done without blocking
+class ShaderLibrary
+{
+public:
+	// binaryCacheDir is passed to every Shader, NULL compiles from source
+	explicit ShaderLibrary(const char* binaryCacheDir = NULL)
+		: cacheDir(binaryCacheDir ? binaryCacheDir : ""), useCache(binaryCacheDir != NULL)
+	{
+#ifdef SHADER_PARALLEL_COMPILE
+		// let the driver use as many compiler threads as it likes
+		if (GLAD_GL_KHR_parallel_shader_compile)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+#endif
+	}
+
+	ShaderLibrary(const ShaderLibrary&) = delete;
+	ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+	// submit a program; the reference stays valid for the library's lifetime.
+	// adding a name that is already there returns the existing program
+	Shader& add(const std::string& name, const GLchar* vertexPath, const GLchar* fragmentPath)
+	{
+		std::unique_ptr<Shader>& slot = programs[name];
+		if (slot)
+			return *slot;
+		slot.reset(new Shader(vertexPath, fragmentPath, useCache ? cacheDir.c_str() : NULL, Shader::Deferred()));
+		building.push_back(slot.get());
+		return *slot;
+	}
+
+	bool contains(const std::string& name) const
+	{
+		return programs.count(name) != 0;
+	}
+
+	// the named program, waiting for its build if needed; throws std::out_of_range for unknown names
+	Shader& get(const std::string& name)
+	{
+		Shader& shader = *programs.at(name);
+		shader.finishBuild();
+		return shader;
+	}
+
+	// finish every build the driver reports done without blocking on the
+	// rest; returns how many programs are still building
+	size_t poll()
+	{
+		size_t kept = 0;
+		for (Shader* shader : building) {
+			if (shader->buildReady())
+				shader->finishBuild();
+			else
+				building[kept++] = shader;
+		}
+		building.resize(kept);
+		return kept;
+	}
+
+	// wait for every submitted program
+	void finishAll()
+	{
+		for (Shader* shader : building)
+			shader->finishBuild();
+		building.clear();
+	}
+
+	size_t size() const
+	{
+		return programs.size();
+	}
+
+private:
+	std::string cacheDir;
+	bool useCache;
+	std::unordered_map<std::string, std::unique_ptr<Shader>> programs;
+	// submitted programs poll() hasn't collected; some may have been
+	// finished by use() or get() since, which finishBuild() tolerates
+	std::vector<Shader*> building;
+};
+
+#endif
@@ -0,0 +1,184 @@
+// times building 100 synthetic shader programs the ways startup can: one
+// Shader after another, all of them submitted through a ShaderLibrary before
+// waiting on any, and the library again with the binary cache first empty and
+// then filled. every pass gets its own copy of the sources, so the driver's
+// own shader cache (Mesa keeps one on disk) can't hand a later pass the
+// earlier one's work - but a second run of the whole bench may get it, so
+// clear that cache between runs for cold numbers. it opens a hidden GLFW
+// window for the context and writes the sources and cache under the temp
+// directory. it's left out of the build like the other standalone files, so
+// build it on its own in Release, the numbers mean nothing in Debug
+//
+//     ShaderStartupBench [programs]
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "ShaderLibrary.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::experimental::filesystem;
+
+struct ShaderPair
+{
+	std::string vertexPath, fragmentPath;
+};
+
+// programs of a few dozen ALU instructions each, with loop counts and
+// uniform names varying per program so no two compile to the same thing;
+// pass is written into the source so each pass compiles text it hasn't seen
+std::vector<ShaderPair> writeShaders(const fs::path& directory, int count, int pass)
+{
+	fs::create_directories(directory);
+	std::vector<ShaderPair> pairs;
+	for (int i = 0; i < count; i++) {
+		ShaderPair pair;
+		pair.vertexPath = (directory / (std::to_string(i) + ".vs")).string();
+		pair.fragmentPath = (directory / (std::to_string(i) + ".fs")).string();
+		std::ofstream vertex(pair.vertexPath);
+		vertex << "#version 330 core\n"
+			<< "// pass " << pass << "\n"
+			<< "layout (location = 0) in vec3 aPos;\n"
+			<< "uniform mat4 model;\n"
+			<< "uniform float scale" << i << ";\n"
+			<< "out vec3 colour;\n"
+			<< "void main()\n{\n"
+			<< "\tvec3 p = aPos;\n"
+			<< "\tfor (int j = 0; j < " << 8 + i % 5 << "; ++j)\n"
+			<< "\t\tp = sin(p * scale" << i << " + float(j));\n"
+			<< "\tcolour = p;\n"
+			<< "\tgl_Position = model * vec4(p, 1.0);\n}\n";
+		std::ofstream fragment(pair.fragmentPath);
+		fragment << "#version 330 core\n"
+			<< "// pass " << pass << "\n"
+			<< "in vec3 colour;\n"
+			<< "out vec4 FragColor;\n"
+			<< "uniform sampler2D texture" << i << ";\n"
+			<< "void main()\n{\n"
+			<< "\tvec4 c = texture(texture" << i << ", colour.xy);\n"
+			<< "\tfor (int j = 0; j < " << 6 + i % 3 << "; ++j)\n"
+			<< "\t\tc = cos(c * " << 1.0 + i * 0.01 << ");\n"
+			<< "\tFragColor = c + vec4(colour, 1.0);\n}\n";
+		pairs.push_back(pair);
+	}
+	return pairs;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// a program that didn't link, or lost the uniform every one of them uses
+bool broken(const Shader& shader)
+{
+	GLint linked = 0;
+	glGetProgramiv(shader.ID, GL_LINK_STATUS, &linked);
+	return !linked || shader.uniform("model") < 0;
+}
+
+void report(const char* name, double submitMs, double totalMs, int programs, int failed)
+{
+	std::cout << std::fixed << std::setprecision(1) << "  " << std::left << std::setw(22) << name << std::right
+		<< std::setw(9) << submitMs << " ms submitting" << std::setw(9) << totalMs << " ms total"
+		<< std::setw(8) << totalMs / programs << " ms a program";
+	if (failed)
+		std::cout << "  " << failed << " FAILED";
+	std::cout << std::endl;
+}
+
+// one Shader after another, each waiting on the compiler before the next starts
+void timeOneByOne(const std::vector<ShaderPair>& pairs)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::unique_ptr<Shader>> shaders;
+	for (const ShaderPair& pair : pairs)
+		shaders.emplace_back(new Shader(pair.vertexPath.c_str(), pair.fragmentPath.c_str()));
+	double totalMs = millisecondsSince(start);
+	int failed = 0;
+	for (const std::unique_ptr<Shader>& shader : shaders)
+		failed += broken(*shader);
+	for (const std::unique_ptr<Shader>& shader : shaders)
+		glDeleteProgram(shader->ID);
+	report("one by one", totalMs, totalMs, (int)pairs.size(), failed);
+}
+
+// everything submitted first, then polled until done the way a loading screen would
+void timeLibrary(const char* name, const std::vector<ShaderPair>& pairs, const char* cacheDir)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ShaderLibrary library(cacheDir);
+	for (size_t i = 0; i < pairs.size(); i++)
+		library.add(std::to_string(i), pairs[i].vertexPath.c_str(), pairs[i].fragmentPath.c_str());
+	double submitMs = millisecondsSince(start);
+	while (library.poll())
+		;
+	double totalMs = millisecondsSince(start);
+	int failed = 0;
+	for (size_t i = 0; i < pairs.size(); i++) {
+		Shader& shader = library.get(std::to_string(i));
+		failed += broken(shader);
+		glDeleteProgram(shader.ID);
+	}
+	report(name, submitMs, totalMs, (int)pairs.size(), failed);
+}
+
+int main(int argc, char** argv)
+{
+	const int programs = argc > 1 ? std::max(1, std::atoi(argv[1])) : 100;
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "ShaderStartupBench", NULL, NULL);
+	if (window == NULL)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+
+	GLint binaryFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+	std::cout << programs << " programs on " << glGetString(GL_RENDERER) << ", parallel compile "
+#ifdef SHADER_PARALLEL_COMPILE
+		<< (GLAD_GL_KHR_parallel_shader_compile ? "yes" : "no")
+#else
+		<< "not built in"
+#endif
+		<< ", " << binaryFormats << " program binary formats" << std::endl;
+
+	fs::path root = fs::temp_directory_path() / "ShaderStartupBench";
+	std::error_code error;
+	fs::remove_all(root, error);
+	const std::string cacheDir = (root / "cache").string();
+
+	timeOneByOne(writeShaders(root / "one_by_one", programs, 0));
+	timeLibrary("library", writeShaders(root / "library", programs, 1), NULL);
+	std::vector<ShaderPair> cached = writeShaders(root / "cached", programs, 2);
+	timeLibrary("library, empty cache", cached, cacheDir.c_str());
+	timeLibrary("library, full cache", cached, cacheDir.c_str());
+
+	fs::remove_all(root, error);
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return 0;
+}
@@ -0,0 +1,238 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// persistent mapping needs GL 4.4 or ARB_buffer_storage in the glad loader;
+// without them each frame's region is mapped unsynchronized instead, which
+// the fences make just as safe but costs a map and unmap per frame
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define STREAM_BUFFER_STORAGE
+#endif
+
+// a buffer for data the CPU rewrites every frame, split into a ring of regions
+// so the CPU fills one while the GPU still reads the ones before it. a fence is
+// put down behind each frame's draws and only waited on when the ring comes
+// back around to that region, which with three regions is never unless the GPU
+// falls a whole two frames behind:
+//
+//     StreamBuffer stream(frameBytes);
+//     ...
+//     stream.begin();
+//     StreamBuffer::Allocation models = stream.allocate(count * sizeof(glm::mat4));
+//     // write models.data, point the attributes at models.offset in stream.id()
+//     stream.end();
+//     glDrawArraysInstanced(...);
+class StreamBuffer
+{
+public:
+	// a piece of the current region: write to data, have GL read from offset
+	struct Allocation
+	{
+		void* data;
+		GLintptr offset;
+	};
+
+	struct Stats
+	{
+		unsigned long long frames = 0;
+		// allocated in total, including alignment padding
+		unsigned long long bytes = 0;
+		// begin() calls that had to wait for the GPU and how long they waited
+		unsigned long long stalls = 0;
+		double stallMilliseconds = 0.0;
+		// allocate() calls that didn't fit in what was left of the region
+		unsigned long long overflows = 0;
+	};
+
+	// regionSize is rounded up so every region starts on a uniform block offset
+	explicit StreamBuffer(GLsizeiptr regionSize, unsigned int regionCount = 3)
+		: regionSize(alignUp(regionSize, regionAlignment())), fences(regionCount, (GLsync)0)
+	{
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		GLsizeiptr total = this->regionSize * regionCount;
+#ifdef STREAM_BUFFER_STORAGE
+		if (bufferStorageSupported()) {
+			// coherent, so writes reach the GPU without flushing and the mapping stays valid while drawing
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_COPY_WRITE_BUFFER, total, NULL, flags);
+			persistentData = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags);
+		}
+#endif
+		if (!persistentData)
+			glBufferData(GL_COPY_WRITE_BUFFER, total, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	~StreamBuffer()
+	{
+		for (GLsync fence : fences)
+			if (fence)
+				glDeleteSync(fence);
+		// deleting a mapped buffer unmaps it
+		glDeleteBuffers(1, &buffer);
+	}
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	unsigned int id() const
+	{
+		return buffer;
+	}
+
+	// whether the buffer stays mapped for its whole life
+	bool persistent() const
+	{
+		return persistentData != nullptr;
+	}
+
+	GLsizeiptr capacity() const
+	{
+		return regionSize;
+	}
+
+	// move on to the next region, first waiting for the GPU to finish the draws
+	// that last read it. fences the region before it, so everything issued since
+	// the last begin() counts as reading that one
+	void begin()
+	{
+		if (mapped)
+			end();
+		if (started) {
+			fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			current = (current + 1) % fences.size();
+		}
+		started = true;
+		waitFor(fences[current]);
+		used = 0;
+		++counters.frames;
+
+		if (persistentData) {
+			mapped = persistentData + regionOffset();
+		}
+		else {
+			// the fence already guarantees the GPU is done with the region
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, regionOffset(), regionSize,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+	}
+
+	// reserve size bytes of the current region at the given power of two
+	// alignment, which applies to the offset in the whole buffer; data is null
+	// when begin() wasn't called or the region is full
+	Allocation allocate(GLsizeiptr size, GLsizeiptr alignment = 16)
+	{
+		GLsizeiptr start = alignUp(regionOffset() + used, alignment) - regionOffset();
+		if (!mapped || start + size > regionSize) {
+			++counters.overflows;
+			return Allocation{ nullptr, 0 };
+		}
+		counters.bytes += start + size - used;
+		used = start + size;
+		return Allocation{ mapped + start, regionOffset() + start };
+	}
+
+	// done writing this frame; must come before the draws that read it
+	void end()
+	{
+		if (mapped && !persistentData) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		mapped = nullptr;
+	}
+
+	const Stats& stats() const
+	{
+		return counters;
+	}
+
+	void resetStats()
+	{
+		counters = Stats();
+	}
+
+	// offsets handed to glBindBufferRange(GL_UNIFORM_BUFFER, ...) must be a multiple of this
+	static GLsizeiptr uniformAlignment()
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		return alignment;
+	}
+
+private:
+	unsigned int buffer = 0;
+	GLsizeiptr regionSize;
+	// one per region, set while the GPU may still be reading it
+	std::vector<GLsync> fences;
+	size_t current = 0;
+	bool started = false;
+	// the whole buffer when persistently mapped
+	char* persistentData = nullptr;
+	// the current region while between begin() and end()
+	char* mapped = nullptr;
+	GLsizeiptr used = 0;
+	Stats counters;
+
+	GLintptr regionOffset() const
+	{
+		return (GLintptr)current * regionSize;
+	}
+
+	// regions start on a uniform block offset, and on a cache line for mapped writes
+	static GLsizeiptr regionAlignment()
+	{
+		return std::max(uniformAlignment(), (GLsizeiptr)64);
+	}
+
+	static GLsizeiptr alignUp(GLsizeiptr value, GLsizeiptr alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	void waitFor(GLsync& fence)
+	{
+		if (!fence)
+			return;
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			// flush so the fence is sure to reach the GPU, then wait a millisecond at a time
+			GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+			do {
+				status = glClientWaitSync(fence, flags, 1000000);
+				flags = 0;
+			} while (status == GL_TIMEOUT_EXPIRED);
+			++counters.stalls;
+			counters.stallMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		glDeleteSync(fence);
+		fence = (GLsync)0;
+	}
+
+	static bool bufferStorageSupported()
+	{
+#if defined(GL_VERSION_4_4)
+		if (GLAD_GL_VERSION_4_4)
+			return true;
+#endif
+#if defined(GL_ARB_buffer_storage)
+		if (GLAD_GL_ARB_buffer_storage)
+			return true;
+#endif
+		return false;
+	}
+};
+
+#endif
@@ -10,7 +10,9 @@
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
+#include "GLState.h"
 #include "MyShader.h"
+#include "TextureLoader.h"
 
 #include <iostream>
 #include <experimental/filesystem>
@@ -22,11 +24,22 @@ const unsigned int SCR_HEIGHT = 600;
 // register callback function for resizing window
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
+// create a GL texture from a decoded image and generate its mipmaps
+unsigned int uploadTexture(const LoadedImage& image);
 
 int main()
 {
 	std::cout << "Running Shaders.cpp file" << std::endl;
 
+	// start decoding the textures on worker threads right away so it overlaps
+	// with creating the window and context. the callbacks only run inside
+	// textureLoader.finish() below, on this thread, once GL is ready
+	unsigned int texture1 = 0, texture2 = 0;
+	TextureLoader textureLoader;
+	textureLoader.load("container.jpg", 0, false, [&texture1](LoadedImage& image) { texture1 = uploadTexture(image); });
+	// flip y coordinates on load - some images have (0,0) in the top left corner but opengl is (0,0) in top right corner
+	textureLoader.load("awesomeface.png", 0, true, [&texture2](LoadedImage& image) { texture2 = uploadTexture(image); });
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -88,7 +101,9 @@ int main()
 	glGenBuffers(1, &EBO);
 
 	// bind the VAO first, then bind VBO, then set vertex attributes
-	glBindVertexArray(VAO);
+	// binds that repeat every frame go through the state cache, which skips calls that change nothing
+	GLState& state = glState();
+	state.bindVertexArray(VAO);
 
 	// set the type of the buffer - aka array buffer
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
@@ -115,65 +130,12 @@ int main()
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
 	glEnableVertexAttribArray(2);
 
-	// --------------
-	// LOAD TEXTURE 1
-	// --------------
-
-	// load, gen, and bind texture
-	unsigned int texture1;
-	glGenTextures(1, &texture1);
-	// now all calls to 2D texture will only effect this texture
-	glBindTexture(GL_TEXTURE_2D, texture1);
-	// set the texture wrap parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// set the texture filtering parameters - scaling texture
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// load image
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load("container.jpg", &width, &height, &nrChannels, 0);
-	// check that data loaded correctly, set the texture to the jpg, and generate mipmaps for texture
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else
-	{
-		std::cout << "ERROR::TEXTURE - Failed to load texture" << std::endl;
-	}
-	stbi_image_free(data);
-
-	// --------------
-	// LOAD TEXTURE 2
-	// --------------
+	// ---------------
+	// UPLOAD TEXTURES
+	// ---------------
 
-	// load, gen, and bind texture
-	unsigned int texture2;
-	glGenTextures(1, &texture2);
-	// now all calls to 2D texture will only effect this texture
-	glBindTexture(GL_TEXTURE_2D, texture2);
-	// set the texture wrap parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// set the texture filtering parameters - scaling texture
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// flip y coordinates on load - some images have (0,0) in the top left corner but opengl is (0,0) in top right corner
-	stbi_set_flip_vertically_on_load(true);
-	data = stbi_load("awesomeface.png", &width, &height, &nrChannels, 0);
-	// check that data loaded correctly, set the texture to the jpg, and generate mipmaps for texture
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else
-	{
-		std::cout << "ERROR::TEXTURE - Failed to load texture" << std::endl;
-	}
-	stbi_image_free(data);
+	// wait for the workers and upload each texture as soon as it is decoded
+	textureLoader.finish();
 
 	// activate the shader before setting any uniforms
 	textureShader.use();
@@ -181,6 +143,8 @@ int main()
 	glUniform1i(glGetUniformLocation(textureShader.ID, "texture1"), 0);
 	// use the shader special method to set the texture
 	textureShader.setInt("texture2", 1);
+	// look the transform location up once, it doesn't change after linking
+	const GLint transformLoc = textureShader.uniform("transform");
 
 	// -----------
 	// RENDER LOOP
@@ -200,13 +164,10 @@ int main()
 		// this is a state using function
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		// activate and bind the first texture unit
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture1);
-
-		// activate and bind the second texture unit
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, texture2);
+		// bind the textures to the first and second texture units - after the
+		// first frame nothing changes, so the state cache skips the GL calls
+		state.bindTexture(0, GL_TEXTURE_2D, texture1);
+		state.bindTexture(1, GL_TEXTURE_2D, texture2);
 
 		// transform the texture container
 		// create the identity matrix with diagonals of only 1's
@@ -223,14 +184,16 @@ int main()
 		// tell GL to use the new shader program whenever render is called
 		textureShader.use();
 		// now that the shader is active we pass the transformation matrix to it
-		unsigned int transformLoc = glGetUniformLocation(textureShader.ID, "transform");
-		glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(transform));
+		textureShader.setMat4(transformLoc, transform);
 
-		// bind the vertex array again? Not sure why but see if that fixes the bug?
-		glBindVertexArray(VAO);
+		// the VAO only has to be bound again if something else was bound since - the state cache checks
+		state.bindVertexArray(VAO);
 		// render the triangle
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
+		// start counting the next frame's GL state calls
+		state.endFrame();
+
 		// swap out colors in the buffer based on updated user input
 		glfwSwapBuffers(window);
 		// check for any user input
@@ -238,6 +201,7 @@ int main()
 	}
 
 	// optional: de-allocate all resources after done rendering
+	state.forgetVertexArray(VAO);
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &EBO);
@@ -256,6 +220,36 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	glViewport(0, 0, width, height);
 }
 
+// upload a decoded image into a new texture with the tutorial's wrap and filter settings
+// -------------------------------------------------------------------------------------
+unsigned int uploadTexture(const LoadedImage& image)
+{
+	// load, gen, and bind texture
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	// now all calls to 2D texture will only effect this texture
+	// bound through the state cache, which would otherwise not know unit 0 changed
+	glState().bindTexture(0, GL_TEXTURE_2D, texture);
+	// set the texture wrap parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// set the texture filtering parameters - scaling texture
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// check that data loaded correctly, set the texture to the image, and generate mipmaps for texture
+	if (image)
+	{
+		GLenum format = image.channels == 4 ? GL_RGBA : image.channels == 3 ? GL_RGB : image.channels == 2 ? GL_RG : GL_RED;
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	else
+	{
+		std::cout << "ERROR::TEXTURE - Failed to load texture " << image.path << ": " << image.error << std::endl;
+	}
+	return texture;
+}
+
 // check if the user pressed ESC and set close window if they did
 void processInput(GLFWwindow *window)
 {
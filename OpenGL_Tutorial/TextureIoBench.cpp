@@ -0,0 +1,149 @@
+// times loading every image in a directory three ways - stbi_load_from_callbacks
+// reading through fread, stbi_load's FILE path and stbi_load_mmap - and checks
+// they decode the same pixels. every file is loaded once first so all three read
+// from a warm page cache; run it under strace -c to count the syscalls each
+// path makes. no window or GL - it's left out of the build like the other
+// standalone files, so build it on its own in Release, the numbers mean
+// nothing in Debug
+//
+//     TextureIoBench textures/ [repeats]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <experimental/filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::experimental::filesystem;
+
+// the io callbacks an application would write over its own FILE
+int readFile(void* user, char* data, int size)
+{
+	return (int)fread(data, 1, size, (FILE*)user);
+}
+
+void skipFile(void* user, int n)
+{
+	fseek((FILE*)user, n, SEEK_CUR);
+}
+
+int endOfFile(void* user)
+{
+	return feof((FILE*)user);
+}
+
+const stbi_io_callbacks fileCallbacks = { readFile, skipFile, endOfFile };
+
+stbi_uc* loadCallbacks(const char* path, int* x, int* y, int* n)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		return nullptr;
+	stbi_uc* pixels = stbi_load_from_callbacks(&fileCallbacks, f, x, y, n, 0);
+	fclose(f);
+	return pixels;
+}
+
+stbi_uc* loadFile(const char* path, int* x, int* y, int* n)
+{
+	return stbi_load(path, x, y, n, 0);
+}
+
+stbi_uc* loadMapped(const char* path, int* x, int* y, int* n)
+{
+	return stbi_load_mmap(path, x, y, n, 0);
+}
+
+typedef stbi_uc* LoadFunction(const char* path, int* x, int* y, int* n);
+
+// the pixels and size of every image, to check the other paths against
+struct Decoded
+{
+	std::vector<stbi_uc> pixels;
+	int x, y, n;
+};
+
+bool isImage(const fs::path& path)
+{
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp" || extension == ".tga";
+}
+
+// load every file repeats times, return the seconds taken and count the
+// images that come out different from the reference
+double timeLoads(LoadFunction* load, const std::vector<std::string>& paths, const std::vector<Decoded>& reference, int repeats, int& different)
+{
+	different = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int run = 0; run < repeats; run++) {
+		for (size_t i = 0; i < paths.size(); i++) {
+			int x, y, n;
+			stbi_uc* pixels = load(paths[i].c_str(), &x, &y, &n);
+			if (run == 0) {
+				const Decoded& expected = reference[i];
+				if (!pixels || x != expected.x || y != expected.y || n != expected.n
+					|| std::memcmp(pixels, expected.pixels.data(), expected.pixels.size()) != 0)
+					different++;
+			}
+			stbi_image_free(pixels);
+		}
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	const char* directory = argc > 1 ? argv[1] : ".";
+	const int repeats = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+
+	// the images that decode, which also warms the page cache
+	std::vector<std::string> paths;
+	std::vector<Decoded> reference;
+	size_t fileBytes = 0, pixelBytes = 0;
+	for (fs::directory_iterator it(directory), end; it != end; ++it) {
+		if (!fs::is_regular_file(it->status()) || !isImage(it->path()))
+			continue;
+		std::string path = it->path().string();
+		Decoded decoded;
+		stbi_uc* pixels = stbi_load(path.c_str(), &decoded.x, &decoded.y, &decoded.n, 0);
+		if (!pixels)
+			continue;
+		decoded.pixels.assign(pixels, pixels + (size_t)decoded.x * decoded.y * decoded.n);
+		stbi_image_free(pixels);
+		fileBytes += (size_t)fs::file_size(it->path());
+		pixelBytes += decoded.pixels.size();
+		paths.push_back(path);
+		reference.push_back(std::move(decoded));
+	}
+	if (paths.empty()) {
+		std::cout << "No images in " << directory << std::endl;
+		return 1;
+	}
+	std::cout << paths.size() << " images, " << fileBytes / (1024.0 * 1024.0) << " MB of files, "
+		<< pixelBytes / (1024.0 * 1024.0) << " MB decoded, " << repeats << " passes" << std::endl;
+
+	const char* names[] = { "callbacks", "FILE", "mmap" };
+	LoadFunction* loads[] = { loadCallbacks, loadFile, loadMapped };
+	for (int way = 0; way < 3; way++) {
+		int different;
+		double seconds = timeLoads(loads[way], paths, reference, repeats, different);
+		std::cout << std::fixed << std::setprecision(1) << "  " << std::left << std::setw(10) << names[way] << std::right
+			<< std::setw(9) << paths.size() * repeats / seconds << " images/s" << std::setw(8)
+			<< fileBytes * repeats / seconds / (1024 * 1024) << " MB/s of files";
+		if (different)
+			std::cout << "  " << different << " DIFFER";
+		std::cout << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,259 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// an image decoded by a TextureLoader worker; owns the stb_image pixel buffer
+struct LoadedImage
+{
+	std::string path;
+	unsigned char* data = nullptr;
+	// channels is the number of components in data (desiredChannels if it was set)
+	int width = 0, height = 0, channels = 0;
+	// failure reason from stb_image when data is null
+	const char* error = nullptr;
+
+	LoadedImage() = default;
+	LoadedImage(const LoadedImage&) = delete;
+	LoadedImage& operator=(const LoadedImage&) = delete;
+
+	LoadedImage(LoadedImage&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	LoadedImage& operator=(LoadedImage&& other) noexcept
+	{
+		if (this != &other) {
+			stbi_image_free(data);
+			path = std::move(other.path);
+			data = other.data;
+			width = other.width;
+			height = other.height;
+			channels = other.channels;
+			error = other.error;
+			other.data = nullptr;
+		}
+		return *this;
+	}
+
+	~LoadedImage()
+	{
+		stbi_image_free(data);
+	}
+
+	explicit operator bool() const
+	{
+		return data != nullptr;
+	}
+};
+
+// decodes images through stb_image on a pool of worker threads, so the render
+// thread only has to upload them. queue everything up front, then either wait
+// on the returned futures or let finish() run the callbacks on the GL thread:
+//
+//     TextureLoader loader;
+//     loader.load("container.jpg", 0, false, [&](LoadedImage& image) { /* glTexImage2D */ });
+//     loader.load("awesomeface.png", 0, true, [&](LoadedImage& image) { /* glTexImage2D */ });
+//     loader.finish();
+//
+// flip and desiredChannels are passed to stb_image per image, so the process-wide
+// stbi_set_flip_vertically_on_load() setting has no effect on the workers
+class TextureLoader
+{
+public:
+	typedef std::function<void(LoadedImage&)> Callback;
+
+	// threadCount 0 uses one worker per hardware thread
+	explicit TextureLoader(unsigned int threadCount = 0)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int i = 0; i < threadCount; ++i)
+			workers.emplace_back(&TextureLoader::workerMain, this);
+	}
+
+	// decodes whatever is still queued, then joins the workers; callbacks that
+	// were never dispatched are dropped along with their images
+	~TextureLoader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		jobReady.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	unsigned int threadCount() const
+	{
+		return (unsigned int)workers.size();
+	}
+
+	// queue one image; the future becomes ready as soon as a worker has decoded it
+	std::future<LoadedImage> load(const std::string& path, int desiredChannels = 0, bool flip = false)
+	{
+		std::shared_ptr<std::promise<LoadedImage>> promise = std::make_shared<std::promise<LoadedImage>>();
+		std::future<LoadedImage> future = promise->get_future();
+		submit(path, desiredChannels, flip, [promise](LoadedImage& image) { promise->set_value(std::move(image)); }, false);
+		return future;
+	}
+
+	// queue one image; onLoaded runs on the thread that calls dispatch() or
+	// finish(), so it is free to make GL calls
+	void load(const std::string& path, int desiredChannels, bool flip, Callback onLoaded)
+	{
+		submit(path, desiredChannels, flip, std::move(onLoaded), true);
+	}
+
+	// queue a list of images that all share the same settings
+	std::vector<std::future<LoadedImage>> loadBatch(const std::vector<std::string>& paths, int desiredChannels = 0, bool flip = false)
+	{
+		std::vector<std::future<LoadedImage>> futures;
+		futures.reserve(paths.size());
+		for (const std::string& path : paths)
+			futures.push_back(load(path, desiredChannels, flip));
+		return futures;
+	}
+
+	// run the callbacks of every image that has finished so far; returns how many ran
+	size_t dispatch()
+	{
+		std::deque<Finished> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ready.swap(finished);
+		}
+		return runCallbacks(ready);
+	}
+
+	// block until everything queued so far is decoded and its callback has run
+	void finish()
+	{
+		for (;;) {
+			std::deque<Finished> ready;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				imageDone.wait(lock, [this] { return !finished.empty() || inFlight == 0; });
+				if (finished.empty())
+					return;
+				ready.swap(finished);
+			}
+			runCallbacks(ready);
+		}
+	}
+
+private:
+	struct Job
+	{
+		std::string path;
+		int desiredChannels;
+		bool flip;
+		Callback done;
+		bool onCaller; // done runs in dispatch() instead of on the worker
+	};
+
+	struct Finished
+	{
+		LoadedImage image;
+		Callback done;
+	};
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable jobReady, imageDone;
+	std::deque<Job> jobs;
+	std::deque<Finished> finished;
+	// queued images whose future is not set or whose callback has not run yet
+	size_t inFlight = 0;
+	bool stopping = false;
+
+	void submit(const std::string& path, int desiredChannels, bool flip, Callback done, bool onCaller)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(Job{ path, desiredChannels, flip, std::move(done), onCaller });
+			++inFlight;
+		}
+		jobReady.notify_one();
+	}
+
+	size_t runCallbacks(std::deque<Finished>& ready)
+	{
+		for (Finished& f : ready)
+			f.done(f.image);
+		if (!ready.empty()) {
+			std::lock_guard<std::mutex> lock(mutex);
+			inFlight -= ready.size();
+		}
+		imageDone.notify_all();
+		return ready.size();
+	}
+
+	void workerMain()
+	{
+		// each worker decodes out of its own scratch arena, so workers don't
+		// fight over the heap for stb_image's temporary buffers
+		stbi_arena* arena = stbi_arena_create(1 << 20);
+		stbi_set_thread_arena(arena);
+		for (;;) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (jobs.empty())
+					break;
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			LoadedImage image = decode(job);
+			if (job.onCaller) {
+				std::lock_guard<std::mutex> lock(mutex);
+				finished.push_back(Finished{ std::move(image), std::move(job.done) });
+			}
+			else {
+				job.done(image);
+				std::lock_guard<std::mutex> lock(mutex);
+				--inFlight;
+			}
+			imageDone.notify_all();
+		}
+		stbi_set_thread_arena(NULL);
+		stbi_arena_destroy(arena);
+	}
+
+	static LoadedImage decode(const Job& job)
+	{
+		stbi_load_options options;
+		stbi_load_options_init(&options);
+		options.desired_channels = job.desiredChannels;
+		options.flip_vertically = job.flip;
+
+		LoadedImage image;
+		image.path = job.path;
+		image.data = stbi_load_mmap_opts(job.path.c_str(), &image.width, &image.height, &image.channels, &options);
+		if (!image.data)
+			image.error = stbi_failure_reason();
+		else if (job.desiredChannels)
+			image.channels = job.desiredChannels;
+		return image;
+	}
+};
+
+#endif
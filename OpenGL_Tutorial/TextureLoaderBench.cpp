@@ -0,0 +1,113 @@
+// times TextureLoader batch-loading every image in a directory with 1 worker,
+// then 2, and so on up to the thread count asked for (one per hardware thread
+// by default), against plain stbi_load in a loop on the calling thread. each
+// count gets a fresh loader, so thread start-up is part of the wall time the
+// way it is when Cubes builds its loader. every file is loaded once first so
+// all the runs read from a warm page cache. no window or GL - it's left out of
+// the build like the other standalone files, so build it on its own in
+// Release, the numbers mean nothing in Debug
+//
+//     TextureLoaderBench textures/ [threads] [repeats]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "TextureLoader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <experimental/filesystem>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::experimental::filesystem;
+
+bool isImage(const fs::path& path)
+{
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp" || extension == ".tga";
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the whole batch queued at once, then waited on in order
+double timeLoader(unsigned int threads, const std::vector<std::string>& batch, int& failed)
+{
+	failed = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	TextureLoader loader(threads);
+	std::vector<std::future<LoadedImage>> futures = loader.loadBatch(batch, 4, true);
+	for (std::future<LoadedImage>& future : futures) {
+		if (!future.get())
+			failed++;
+	}
+	return secondsSince(start);
+}
+
+void report(const char* name, double seconds, double serialSeconds, size_t images, int failed)
+{
+	std::cout << std::fixed << std::setprecision(1) << "  " << std::left << std::setw(12) << name << std::right
+		<< std::setw(9) << seconds * 1000.0 << " ms" << std::setw(9) << images / seconds << " images/s"
+		<< std::setprecision(2) << std::setw(7) << serialSeconds / seconds << "x";
+	if (failed)
+		std::cout << "  " << failed << " FAILED";
+	std::cout << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	const char* directory = argc > 1 ? argv[1] : ".";
+	const unsigned int maxThreads = argc > 2 ? (unsigned int)std::max(1, std::atoi(argv[2])) : std::max(1u, std::thread::hardware_concurrency());
+	const int repeats = argc > 3 ? std::max(1, std::atoi(argv[3])) : 4;
+
+	std::vector<std::string> paths;
+	for (fs::directory_iterator it(directory), end; it != end; ++it) {
+		if (!fs::is_regular_file(it->status()) || !isImage(it->path()))
+			continue;
+		std::string path = it->path().string();
+		int x, y, n;
+		stbi_uc* pixels = stbi_load(path.c_str(), &x, &y, &n, 4);
+		if (!pixels)
+			continue;
+		stbi_image_free(pixels);
+		paths.push_back(path);
+	}
+	if (paths.empty()) {
+		std::cout << "No images in " << directory << std::endl;
+		return 1;
+	}
+	// the directory repeats times over, so a batch is long enough to split up
+	std::vector<std::string> batch;
+	for (int run = 0; run < repeats; run++)
+		batch.insert(batch.end(), paths.begin(), paths.end());
+	std::cout << batch.size() << " loads of " << paths.size() << " images, " << std::thread::hardware_concurrency()
+		<< " hardware threads" << std::endl;
+
+	int failed = 0;
+	stbi_set_flip_vertically_on_load(1);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (const std::string& path : batch) {
+		int x, y, n;
+		stbi_uc* pixels = stbi_load(path.c_str(), &x, &y, &n, 4);
+		if (!pixels)
+			failed++;
+		stbi_image_free(pixels);
+	}
+	double serialSeconds = secondsSince(start);
+	report("stbi_load", serialSeconds, serialSeconds, batch.size(), failed);
+
+	for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+		double seconds = timeLoader(threads, batch, failed);
+		std::string name = std::to_string(threads) + (threads == 1 ? " thread" : " threads");
+		report(name.c_str(), seconds, serialSeconds, batch.size(), failed);
+	}
+	return 0;
+}
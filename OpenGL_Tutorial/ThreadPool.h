@@ -0,0 +1,132 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed set of worker threads for splitting a loop across cores. parallelFor
+// hands out chunks of the range from a shared counter, the calling thread takes
+// chunks too, and it returns once the whole range is done:
+//
+//     pool.parallelFor(count, 1024, [&](size_t begin, size_t end) {
+//         for (size_t i = begin; i < end; ++i) ...
+//     });
+//
+// one loop runs at a time; calls from several threads take turns
+class ThreadPool
+{
+public:
+	// threadCount counts the calling thread, so 1 means no workers at all;
+	// 0 uses one thread per hardware thread
+	explicit ThreadPool(unsigned int threadCount = 0)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int i = 1; i < threadCount; ++i)
+			workers.emplace_back(&ThreadPool::workerMain, this);
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		workReady.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned int threadCount() const
+	{
+		return (unsigned int)workers.size() + 1;
+	}
+
+	// run body(begin, end) over [0, count) in chunks of grain items
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+	{
+		if (count == 0)
+			return;
+		grain = std::max<size_t>(grain, 1);
+		// not worth waking anyone for a single chunk
+		if (workers.empty() || count <= grain) {
+			body(0, count);
+			return;
+		}
+
+		std::lock_guard<std::mutex> turn(loopMutex);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			loop = &body;
+			loopCount = count;
+			loopGrain = grain;
+			nextIndex = 0;
+			busyWorkers = (unsigned int)workers.size();
+			++generation;
+		}
+		workReady.notify_all();
+		runChunks(body, count, grain);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		loopDone.wait(lock, [this] { return busyWorkers == 0; });
+		loop = nullptr;
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex, loopMutex;
+	std::condition_variable workReady, loopDone;
+	// the loop in progress, valid while generation is ahead of a worker's last one
+	const std::function<void(size_t, size_t)>* loop = nullptr;
+	size_t loopCount = 0, loopGrain = 0;
+	std::atomic<size_t> nextIndex{ 0 };
+	unsigned int busyWorkers = 0;
+	unsigned long long generation = 0;
+	bool stopping = false;
+
+	void runChunks(const std::function<void(size_t, size_t)>& body, size_t count, size_t grain)
+	{
+		for (;;) {
+			size_t begin = nextIndex.fetch_add(grain);
+			if (begin >= count)
+				return;
+			body(begin, std::min(begin + grain, count));
+		}
+	}
+
+	void workerMain()
+	{
+		unsigned long long seen = 0;
+		for (;;) {
+			const std::function<void(size_t, size_t)>* body;
+			size_t count, grain;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				workReady.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+				body = loop;
+				count = loopCount;
+				grain = loopGrain;
+			}
+			runChunks(*body, count, grain);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				--busyWorkers;
+			}
+			loopDone.notify_one();
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,102 @@
+// times TransformSystem building model matrices against the glm translate and
+// rotate chain cubeModel in Cubes.cpp builds one cube at a time. no window or
+// GL - it's left out of the build like the other standalone files, so build it
+// on its own in Release, the numbers mean nothing in Debug
+
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "ThreadPool.h"
+#include "TransformSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// enough objects that the matrices don't fit in cache, like a big instance buffer
+const size_t OBJECT_COUNT = 100000;
+// times each way of building the matrices runs, at a different time each run
+const int REPEATS = 50;
+
+// the spinning model matrix the way Cubes.cpp's cubeModel builds it
+glm::mat4 glmModel(const glm::vec3& position, const glm::vec3& axis, float angle)
+{
+	glm::mat4 model = glm::mat4(1.0f);
+	model = glm::translate(model, position);
+	return glm::rotate(model, angle, axis);
+}
+
+// run build(time) REPEATS times and return millions of matrices built a second
+template<class Build>
+double millionsPerSecond(Build build)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int run = 0; run < REPEATS; run++)
+		build(0.01f * run);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return OBJECT_COUNT * REPEATS / seconds / 1e6;
+}
+
+int main()
+{
+	// the same kind of spread Cubes gives its cubes: a grid of positions, a few
+	// different axes, and spin rates from none up to a few turns a second
+	std::vector<glm::vec3> positions(OBJECT_COUNT), axes(OBJECT_COUNT);
+	std::vector<float> rates(OBJECT_COUNT);
+	for (size_t i = 0; i < OBJECT_COUNT; i++) {
+		positions[i] = glm::vec3((float)(i % 100) - 50.0f, (float)(i / 100 % 100) * 0.5f, -(float)(i / 10000));
+		axes[i] = glm::normalize(glm::vec3(1.0f, 0.3f + (i % 7) * 0.1f, 0.5f - (i % 5) * 0.2f));
+		rates[i] = glm::radians(20.0f * (i % 50));
+	}
+
+	ThreadPool pool;
+	TransformSystem single, threaded(&pool);
+	single.reserve(OBJECT_COUNT);
+	threaded.reserve(OBJECT_COUNT);
+	for (size_t i = 0; i < OBJECT_COUNT; i++) {
+		single.add(positions[i], axes[i], rates[i]);
+		threaded.add(positions[i], axes[i], rates[i]);
+	}
+	std::vector<glm::mat4> reference(OBJECT_COUNT), models(OBJECT_COUNT);
+
+	// both ways have to give the same matrices for the timings to mean anything
+	const float checkTime = 1.7f;
+	single.computeModels(checkTime, models.data());
+	float worst = 0.0f;
+	for (size_t i = 0; i < OBJECT_COUNT; i++) {
+		reference[i] = glmModel(positions[i], axes[i], checkTime * rates[i]);
+		for (int column = 0; column < 4; column++)
+			for (int row = 0; row < 4; row++)
+				worst = std::max(worst, std::fabs(models[i][column][row] - reference[i][column][row]));
+	}
+
+#if defined(TRANSFORM_SIMD_AVX2)
+	const char* kernel = "AVX2, 8 at a time";
+#elif defined(TRANSFORM_SIMD_SSE2)
+	const char* kernel = "SSE2, 4 at a time";
+#else
+	const char* kernel = "scalar";
+#endif
+	std::cout << OBJECT_COUNT << " model matrices, TransformSystem kernel: " << kernel << std::endl;
+	std::cout << "largest difference from glm: " << worst << std::endl;
+
+	double chain = millionsPerSecond([&](float time) {
+		for (size_t i = 0; i < OBJECT_COUNT; i++)
+			reference[i] = glmModel(positions[i], axes[i], time * rates[i]);
+	});
+	double batched = millionsPerSecond([&](float time) { single.computeModels(time, models.data()); });
+	double spread = millionsPerSecond([&](float time) { threaded.computeModels(time, models.data()); });
+
+	std::cout << "glm translate * rotate:       " << chain << " M matrices/s" << std::endl;
+	std::cout << "TransformSystem, 1 thread:    " << batched << " M matrices/s" << std::endl;
+	std::cout << "TransformSystem, thread pool: " << spread << " M matrices/s on " << pool.threadCount() << " threads" << std::endl;
+
+	// read the results so the optimizer can't drop the loops that wrote them
+	float sum = 0.0f;
+	for (size_t i = 0; i < OBJECT_COUNT; i += 997)
+		sum += reference[i][3][0] + models[i][3][1];
+	std::cout << "(checksum " << sum << ")" << std::endl;
+	return 0;
+}
@@ -0,0 +1,261 @@
+#ifndef TRANSFORM_SYSTEM_H
+#define TRANSFORM_SYSTEM_H
+
+#include "ThreadPool.h"
+#include "glm/glm.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// the batch kernels need SSE2, which every x64 compiler has; AVX2 and FMA widen
+// them to eight objects at a time when the build allows it (/arch:AVX2, -mavx2 -mfma)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_SIMD_SSE2
+#include <emmintrin.h>
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define TRANSFORM_SIMD_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+// positions and spin axes of a large number of objects, kept as one array per
+// component so the model matrices can be built several objects at a time:
+//
+//     ThreadPool pool;
+//     TransformSystem transforms(&pool);
+//     transforms.add(position, axis, glm::radians(20.0f));
+//     ...
+//     transforms.computeModels(time, (glm::mat4*)mappedInstanceBuffer);
+//
+// each model matrix is translate(position) * rotate(time * spinRate, axis), the
+// same matrix glm::translate and glm::rotate give. the angle is reduced against
+// pi/2 in float, so it stays accurate while time * spinRate is below about 1e5
+class TransformSystem
+{
+public:
+	// pool splits computeModels across its threads, NULL runs it on the caller
+	explicit TransformSystem(ThreadPool* pool = nullptr)
+		: pool(pool)
+	{
+	}
+
+	void reserve(size_t count)
+	{
+		for (std::vector<float>* component : components())
+			component->reserve(count);
+	}
+
+	// returns the new object's index; axis doesn't need to be normalized
+	size_t add(const glm::vec3& position, const glm::vec3& axis, float spinRate)
+	{
+		glm::vec3 unit = glm::normalize(axis);
+		px.push_back(position.x);
+		py.push_back(position.y);
+		pz.push_back(position.z);
+		ax.push_back(unit.x);
+		ay.push_back(unit.y);
+		az.push_back(unit.z);
+		rate.push_back(spinRate);
+		return px.size() - 1;
+	}
+
+	void setPosition(size_t i, const glm::vec3& position)
+	{
+		px[i] = position.x;
+		py[i] = position.y;
+		pz[i] = position.z;
+	}
+
+	size_t size() const
+	{
+		return px.size();
+	}
+
+	// write size() model matrices to out. out can be write-only memory such as
+	// a mapped buffer - every byte of it is written once and nothing is read back
+	void computeModels(float time, glm::mat4* out) const
+	{
+		float* dst = (float*)out;
+		if (pool)
+			pool->parallelFor(size(), MODELS_PER_TASK, [&](size_t begin, size_t end) { computeRange(time, dst, begin, end); });
+		else
+			computeRange(time, dst, 0, size());
+	}
+
+	// the single threaded kernel computeModels runs on each chunk
+	void computeRange(float time, float* out, size_t begin, size_t end) const
+	{
+		size_t i = begin;
+#ifdef TRANSFORM_SIMD_SSE2
+		// non-temporal stores skip reading the destination into the cache, which
+		// matters when it is uncached memory behind a mapped buffer
+		bool stream = ((uintptr_t)out & 15) == 0;
+#ifdef TRANSFORM_SIMD_AVX2
+		for (; i + 8 <= end; i += 8)
+			buildEight(time, i, out + i * 16, stream);
+#endif
+		for (; i + 4 <= end; i += 4)
+			buildFour(time, i, out + i * 16, stream);
+		if (stream)
+			_mm_sfence();
+#endif
+		for (; i < end; ++i)
+			buildOne(time, i, out + i * 16);
+	}
+
+private:
+	// big enough to amortize handing out a chunk, small enough to balance the threads
+	static const size_t MODELS_PER_TASK = 4096;
+
+	ThreadPool* pool;
+	std::vector<float> px, py, pz;
+	// unit spin axis
+	std::vector<float> ax, ay, az;
+	// radians per second
+	std::vector<float> rate;
+
+	std::vector<std::vector<float>*> components()
+	{
+		return { &px, &py, &pz, &ax, &ay, &az, &rate };
+	}
+
+	void buildOne(float time, size_t i, float* m) const
+	{
+		float angle = time * rate[i];
+		float c = std::cos(angle), s = std::sin(angle), t = 1.0f - c;
+		float x = ax[i], y = ay[i], z = az[i];
+		m[0] = c + t * x * x;      m[1] = t * x * y + s * z;  m[2] = t * x * z - s * y;  m[3] = 0.0f;
+		m[4] = t * y * x - s * z;  m[5] = c + t * y * y;      m[6] = t * y * z + s * x;  m[7] = 0.0f;
+		m[8] = t * z * x + s * y;  m[9] = t * z * y - s * x;  m[10] = c + t * z * z;     m[11] = 0.0f;
+		m[12] = px[i];             m[13] = py[i];             m[14] = pz[i];             m[15] = 1.0f;
+	}
+
+#ifdef TRANSFORM_SIMD_SSE2
+	// sine and cosine of four angles: reduce to r in [-pi/4, pi/4] around the
+	// nearest multiple q of pi/2, evaluate the cephes polynomials on r, then the
+	// low two bits of q pick which one is which and their signs
+	static void sinCos4(__m128 x, __m128& s, __m128& c)
+	{
+		__m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.636619772f)));
+		__m128 qf = _mm_cvtepi32_ps(q);
+		// pi/2 in three parts so q * part is exact and r keeps its precision
+		__m128 r = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(1.5703125f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(4.837512969970703125e-4f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(7.54978995489188216e-8f)));
+		__m128 z = _mm_mul_ps(r, r);
+
+		__m128 sinR = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), z), _mm_set1_ps(8.3321608736e-3f));
+		sinR = _mm_add_ps(_mm_mul_ps(sinR, z), _mm_set1_ps(-1.6666654611e-1f));
+		sinR = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinR, z), r), r);
+		__m128 cosR = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), z), _mm_set1_ps(-1.388731625493765e-3f));
+		cosR = _mm_add_ps(_mm_mul_ps(cosR, z), _mm_set1_ps(4.166664568298827e-2f));
+		cosR = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(cosR, z), z), _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+		__m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+		__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+		__m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+		__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+		s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, cosR), _mm_andnot_ps(swap, sinR)), sinSign);
+		c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, sinR), _mm_andnot_ps(swap, cosR)), cosSign);
+	}
+
+	// terms holds column 0 xyz, column 1 xyz, column 2 xyz and the translation of
+	// four objects, one register per element. transpose each column across the
+	// objects and store the four column-major matrices back to back
+	static void storeFour(float* m, bool stream, const __m128 terms[12])
+	{
+		__m128 columns[4][4];
+		for (int col = 0; col < 4; ++col) {
+			__m128 x = terms[col * 3], y = terms[col * 3 + 1], z = terms[col * 3 + 2];
+			__m128 w = col == 3 ? _mm_set1_ps(1.0f) : _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+			columns[col][0] = x;
+			columns[col][1] = y;
+			columns[col][2] = z;
+			columns[col][3] = w;
+		}
+		for (int object = 0; object < 4; ++object)
+			for (int col = 0; col < 4; ++col) {
+				float* dst = m + object * 16 + col * 4;
+				if (stream)
+					_mm_stream_ps(dst, columns[col][object]);
+				else
+					_mm_storeu_ps(dst, columns[col][object]);
+			}
+	}
+
+	void buildFour(float time, size_t i, float* m, bool stream) const
+	{
+		__m128 s, c;
+		sinCos4(_mm_mul_ps(_mm_set1_ps(time), _mm_loadu_ps(&rate[i])), s, c);
+		__m128 t = _mm_sub_ps(_mm_set1_ps(1.0f), c);
+		__m128 x = _mm_loadu_ps(&ax[i]), y = _mm_loadu_ps(&ay[i]), z = _mm_loadu_ps(&az[i]);
+		__m128 tx = _mm_mul_ps(t, x), ty = _mm_mul_ps(t, y), tz = _mm_mul_ps(t, z);
+		__m128 sx = _mm_mul_ps(s, x), sy = _mm_mul_ps(s, y), sz = _mm_mul_ps(s, z);
+		__m128 txy = _mm_mul_ps(tx, y), txz = _mm_mul_ps(tx, z), tyz = _mm_mul_ps(ty, z);
+		__m128 terms[12] = {
+			_mm_add_ps(c, _mm_mul_ps(tx, x)), _mm_add_ps(txy, sz), _mm_sub_ps(txz, sy),
+			_mm_sub_ps(txy, sz), _mm_add_ps(c, _mm_mul_ps(ty, y)), _mm_add_ps(tyz, sx),
+			_mm_add_ps(txz, sy), _mm_sub_ps(tyz, sx), _mm_add_ps(c, _mm_mul_ps(tz, z)),
+			_mm_loadu_ps(&px[i]), _mm_loadu_ps(&py[i]), _mm_loadu_ps(&pz[i])
+		};
+		storeFour(m, stream, terms);
+	}
+#endif
+
+#ifdef TRANSFORM_SIMD_AVX2
+	// sinCos4 on eight angles
+	static void sinCos8(__m256 x, __m256& s, __m256& c)
+	{
+		__m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(0.636619772f)));
+		__m256 qf = _mm256_cvtepi32_ps(q);
+		__m256 r = _mm256_fnmadd_ps(qf, _mm256_set1_ps(1.5703125f), x);
+		r = _mm256_fnmadd_ps(qf, _mm256_set1_ps(4.837512969970703125e-4f), r);
+		r = _mm256_fnmadd_ps(qf, _mm256_set1_ps(7.54978995489188216e-8f), r);
+		__m256 z = _mm256_mul_ps(r, r);
+
+		__m256 sinR = _mm256_fmadd_ps(_mm256_set1_ps(-1.9515295891e-4f), z, _mm256_set1_ps(8.3321608736e-3f));
+		sinR = _mm256_fmadd_ps(sinR, z, _mm256_set1_ps(-1.6666654611e-1f));
+		sinR = _mm256_fmadd_ps(_mm256_mul_ps(sinR, z), r, r);
+		__m256 cosR = _mm256_fmadd_ps(_mm256_set1_ps(2.443315711809948e-5f), z, _mm256_set1_ps(-1.388731625493765e-3f));
+		cosR = _mm256_fmadd_ps(cosR, z, _mm256_set1_ps(4.166664568298827e-2f));
+		cosR = _mm256_add_ps(_mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), _mm256_mul_ps(_mm256_mul_ps(cosR, z), z)), _mm256_set1_ps(1.0f));
+
+		__m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+		__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+		__m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+		__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+		s = _mm256_xor_ps(_mm256_blendv_ps(sinR, cosR, swap), sinSign);
+		c = _mm256_xor_ps(_mm256_blendv_ps(cosR, sinR, swap), cosSign);
+	}
+
+	void buildEight(float time, size_t i, float* m, bool stream) const
+	{
+		__m256 s, c;
+		sinCos8(_mm256_mul_ps(_mm256_set1_ps(time), _mm256_loadu_ps(&rate[i])), s, c);
+		__m256 t = _mm256_sub_ps(_mm256_set1_ps(1.0f), c);
+		__m256 x = _mm256_loadu_ps(&ax[i]), y = _mm256_loadu_ps(&ay[i]), z = _mm256_loadu_ps(&az[i]);
+		__m256 tx = _mm256_mul_ps(t, x), ty = _mm256_mul_ps(t, y), tz = _mm256_mul_ps(t, z);
+		__m256 sx = _mm256_mul_ps(s, x), sy = _mm256_mul_ps(s, y), sz = _mm256_mul_ps(s, z);
+		__m256 txy = _mm256_mul_ps(tx, y), txz = _mm256_mul_ps(tx, z), tyz = _mm256_mul_ps(ty, z);
+		__m256 terms[12] = {
+			_mm256_fmadd_ps(tx, x, c), _mm256_add_ps(txy, sz), _mm256_sub_ps(txz, sy),
+			_mm256_sub_ps(txy, sz), _mm256_fmadd_ps(ty, y, c), _mm256_add_ps(tyz, sx),
+			_mm256_add_ps(txz, sy), _mm256_sub_ps(tyz, sx), _mm256_fmadd_ps(tz, z, c),
+			_mm256_loadu_ps(&px[i]), _mm256_loadu_ps(&py[i]), _mm256_loadu_ps(&pz[i])
+		};
+		// the matrices go out four at a time, low half then high half
+		__m128 lo[12], hi[12];
+		for (int k = 0; k < 12; ++k) {
+			lo[k] = _mm256_castps256_ps128(terms[k]);
+			hi[k] = _mm256_extractf128_ps(terms[k], 1);
+		}
+		storeFour(m, stream, lo);
+		storeFour(m + 64, stream, hi);
+	}
+#endif
+};
+
+#endif
@@ -5,17 +5,36 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "ChunkStreamer.h"
+#include "FrameHistogram.h"
+#include "GLState.h"
+#include "JobSystem.h"
 #include "MyShader.h"
+#include "PaletteChunk.h"
+#include "PerFrame.h"
+#include "VoxelRenderer.h"
+#include "VoxelWorld.h"
 
+#include <cmath>
 #include <iostream>
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// how many chunks the generated terrain reaches out from the origin in x and z;
+// 13 gives 26x26 columns of hills that reach into a second layer of chunks about
+// half the time, close to 1000 chunks
+const int WORLD_RADIUS = 13;
+// finished chunk meshes handed to GL per frame, so streaming never stalls a frame
+const size_t MAX_UPLOADS_PER_FRAME = 16;
 
 // register callback function for resizing window
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
+// fill the world with rolling hills of stone, dirt and grass
+void generateTerrain(PaletteVoxelWorld& world, int radius);
 
 int main()
 {
@@ -51,112 +70,102 @@ int main()
 		return -1;
 	}
 
-	// setup the vertex shader and fragment shader
-	Shader triShader("vShader.vs", "fShader.fs");
-
-	// ----------------------------------------------------
-	// Gen VAO, Gen VBO, Gen Attributes, Store VBO into VAO
-	// VAO = Vertex Attribute Object
-	// VBO = Vertex Buffer Object
-	// ----------------------------------------------------
-
-	// setup the data for the triangle's vertices
-	float vertices[] = {
-		// 12 triangles in a cube. Each triangle has 3 verties
-		// 36 vertices total - lots of repeated vertices
-		-0.5f,-0.5f,-0.5f, // triangle 1 : begin
-		-0.5f,-0.5f, 0.5f,
-		-0.5f, 0.5f, 0.5f, // triangle 1 : end
-		0.5f, 0.5f,-0.5f, // triangle 2 : begin
-		-0.5f,-0.5f,-0.5f,
-		-0.5f, 0.5f,-0.5f, // triangle 2 : end
-		0.5f,-0.5f, 0.5f,
-		-0.5f,-0.5f,-0.5f,
-		0.5f,-0.5f,-0.5f,
-		0.5f, 0.5f,-0.5f,
-		0.5f,-0.5f,-0.5f,
-		-0.5f,-0.5f,-0.5f,
-		-0.5f,-0.5f,-0.5f,
-		-0.5f, 0.5f, 0.5f,
-		-0.5f, 0.5f,-0.5f,
-		0.5f,-0.5f, 0.5f,
-		-0.5f,-0.5f, 0.5f,
-		-0.5f,-0.5f,-0.5f,
-		-0.5f, 0.5f, 0.5f,
-		-0.5f,-0.5f, 0.5f,
-		0.5f,-0.5f, 0.5f,
-		0.5f, 0.5f, 0.5f,
-		0.5f,-0.5f,-0.5f,
-		0.5f, 0.5f,-0.5f,
-		0.5f,-0.5f,-0.5f,
-		0.5f, 0.5f, 0.5f,
-		0.5f,-0.5f, 0.5f,
-		0.5f, 0.5f, 0.5f,
-		0.5f, 0.5f,-0.5f,
-		-0.5f, 0.5f,-0.5f,
-		0.5f, 0.5f, 0.5f,
-		-0.5f, 0.5f,-0.5f,
-		-0.5f, 0.5f, 0.5f,
-		0.5f, 0.5f, 0.5f,
-		-0.5f, 0.5f, 0.5f,
-		0.5f,-0.5f, 0.5f
-	};
-
-	// get id of the vertex buffer object
-	unsigned int VBO, VAO;
-	// generate the VAO and VBO
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-
-	// bind the VAO first, then bind VBO, then set vertex attributes
-	glBindVertexArray(VAO);
-	// set the type of the buffer - aka array buffer
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	// fill the buffer with the vertices' data and say static draw is infrequent update
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-	// vertex position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-
-	// set gl to draw in wire-frame mode
-	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-
-	// -----------
-	// RENDER LOOP
-	// -----------
-
-	// the render loop that tells opengl to stay open unless told to exit
-	while (!glfwWindowShouldClose(window))
+	// build the voxel world the engine will draw. four block types fit a 2 bit
+	// palette index, so each chunk takes 8 KB instead of the 64 KB of a dense one
+	PaletteVoxelWorld world;
+	generateTerrain(world, WORLD_RADIUS);
+	std::cout << "Voxel world: " << world.chunkCount() << " chunks, " << world.memoryUsage() / (1024 * 1024) << " MB" << std::endl;
+
+	// the shader, uniform buffer and chunk meshes free their GL objects when they
+	// go out of scope, which has to happen while the context is still alive
 	{
-		// check for user input every render loop
-		processInput(window);
-
-		// window rendering commands will go here
-		// set the color you want to clear the entire window with
-		// this is a state setting function
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-		// clear the window with the previously set color
-		// this is a state using function
-		glClear(GL_COLOR_BUFFER_BIT);
-
-		// tell GL to use the new shader program whenever render is called
-		triShader.use();
-		// bind the vertex array again? Not sure why but see if that fixes the bug?
-		glBindVertexArray(VAO);
-		// render the 36 triangles
-		glDrawArrays(GL_TRIANGLES, 0, 12*3);
-
-		// swap out colors in the buffer based on updated user input
-		glfwSwapBuffers(window);
-		// check for any user input
-		glfwPollEvents();
+		// setup the voxel vertex shader and fragment shader
+		Shader voxelShader("vVoxel.vs", "fVoxel.fs");
+		GLint chunkOriginLoc = voxelShader.uniform("chunkOrigin");
+
+		// the camera matrices go to every shader through the PerFrame uniform block
+		PerFrameBuffer perFrame;
+
+		// ---------------------------------------------
+		// MESH THE CHUNKS - on the worker threads, nearest
+		// the camera first, uploaded a few per frame
+		// ---------------------------------------------
+		VoxelRenderer renderer;
+		JobSystem jobs;
+		BasicChunkStreamer<PaletteVoxelWorld> streamer(world, jobs);
+		streamer.markAllDirty();
+		std::cout << "Meshing on " << jobs.threadCount() << " worker threads" << std::endl;
+
+		// main thread time per frame, up to the buffer swap, while chunks stream in and after
+		FrameHistogram streamingFrames, steadyFrames;
+		double streamStart = glfwGetTime();
+		bool streaming = true;
+
+		// configure global OpenGL state - depth testing, and skip the back faces since every chunk mesh is closed
+		GLState& state = glState();
+		state.setEnabled(GL_DEPTH_TEST, true);
+		state.setEnabled(GL_CULL_FACE, true);
+
+		// -----------
+		// RENDER LOOP
+		// -----------
+
+		// the render loop that tells opengl to stay open unless told to exit
+		while (!glfwWindowShouldClose(window))
+		{
+			double frameStart = glfwGetTime();
+
+			// check for user input every render loop
+			processInput(window);
+
+			// circle the camera around the middle of the world, looking down at the hills
+			float angle = (float)frameStart * 0.2f;
+			float distance = WORLD_RADIUS * Chunk::SIZE * 1.2f;
+			glm::vec3 eye(std::cos(angle) * distance, 90.0f, std::sin(angle) * distance);
+			glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f, 20.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+			glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
+			perFrame.update(view, projection);
+
+			// keep the workers fed and pick up what they have finished
+			streamer.update(eye);
+			streamer.upload(renderer, MAX_UPLOADS_PER_FRAME);
+
+			// window rendering commands will go here
+			// set the color you want to clear the entire window with
+			// this is a state setting function
+			glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+			// clear the window with the previously set color
+			// this is a state using function
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			// tell GL to use the new shader program whenever render is called
+			voxelShader.use();
+			// one draw per chunk, each chunk with its own VAO
+			renderer.draw(chunkOriginLoc);
+
+			// start counting the next frame's GL state calls
+			state.endFrame();
+
+			double frameTime = (glfwGetTime() - frameStart) * 1000.0;
+			(streaming ? streamingFrames : steadyFrames).add(frameTime);
+			if (streaming && streamer.idle()) {
+				streaming = false;
+				std::cout << "Streamed " << renderer.chunkCount() << " chunks in " << (glfwGetTime() - streamStart) * 1000.0 << " ms: "
+					<< renderer.triangleCount() << " triangles, " << renderer.vertexBytes() / 1024 << " KB of vertices" << std::endl;
+			}
+
+			// swap out colors in the buffer based on updated user input
+			glfwSwapBuffers(window);
+			// check for any user input
+			glfwPollEvents();
+		}
+
+		std::cout << "Frame times while streaming:" << std::endl;
+		streamingFrames.print(std::cout);
+		std::cout << "Frame times after:" << std::endl;
+		steadyFrames.print(std::cout);
 	}
 
-	// optional: de-allocate all resources after done rendering
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
-
 	// delete all of glfw's resources used to render after done rendering
 	glfwTerminate();
 	return 0;
@@ -171,6 +180,29 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	glViewport(0, 0, width, height);
 }
 
+// block types of the generated terrain
+// ------------------------------------
+enum TerrainBlock : BlockId { STONE = 1, DIRT = 2, GRASS = 3 };
+
+void generateTerrain(PaletteVoxelWorld& world, int radius)
+{
+	const int size = Chunk::SIZE;
+	for (int cz = -radius; cz < radius; cz++) {
+		for (int cx = -radius; cx < radius; cx++) {
+			for (int lz = 0; lz < size; lz++) {
+				for (int lx = 0; lx < size; lx++) {
+					int x = cx * size + lx, z = cz * size + lz;
+					// two octaves of waves give hills between about 8 and 40 blocks high
+					float h = 24.0f + 10.0f * std::sin(x * 0.05f) * std::cos(z * 0.04f) + 6.0f * std::sin((x + z) * 0.13f);
+					int height = (int)h;
+					for (int y = 0; y < height; y++)
+						world.setBlock(x, y, z, y == height - 1 ? GRASS : y > height - 4 ? DIRT : STONE);
+				}
+			}
+		}
+	}
+}
+
 // check if the user pressed ESC and set close window if they did
 void processInput(GLFWwindow *window)
 {
@@ -0,0 +1,144 @@
+// times the voxel world on the CPU for each way of storing chunks - dense,
+// palette and octree: memory, setting and reading blocks the way VoxEngine.cpp
+// fills its world, and meshing the chunks. no window or GL - it's left out of
+// the build like the other standalone files, so build it on its own in
+// Release, the numbers mean nothing in Debug
+
+#include "ChunkMesher.h"
+#include "OctreeChunk.h"
+#include "PaletteChunk.h"
+#include "VoxelWorld.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// chunks the terrain reaches out from the origin in x and z, 16x16 columns of them
+const int WORLD_RADIUS = 8;
+// block reads per random access measurement
+const size_t RANDOM_READS = 4000000;
+
+// block types of the generated terrain
+enum TerrainBlock : BlockId { STONE = 1, DIRT = 2, GRASS = 3 };
+
+// the rolling hills VoxEngine.cpp draws
+template<class World>
+void generateTerrain(World& world, int radius)
+{
+	const int size = Chunk::SIZE;
+	for (int z = -radius * size; z < radius * size; z++) {
+		for (int x = -radius * size; x < radius * size; x++) {
+			float h = 24.0f + 10.0f * std::sin(x * 0.05f) * std::cos(z * 0.04f) + 6.0f * std::sin((x + z) * 0.13f);
+			int height = (int)h;
+			for (int y = 0; y < height; y++)
+				world.setBlock(x, y, z, y == height - 1 ? GRASS : y > height - 4 ? DIRT : STONE);
+		}
+	}
+}
+
+// the stores that can pack themselves tighter once the world is built
+void compact(Chunk&) {}
+void compact(PaletteChunk& chunk) { chunk.compact(); }
+void compact(OctreeChunk& chunk) { chunk.compact(); }
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the reads add up into here so the optimizer can't drop them
+volatile unsigned int sink;
+
+// fill a world with terrain and compact it, then time reading it back through
+// getBlock at random and through one chunk's local coordinates in memory order
+template<class World>
+void measureAccess(const char* name)
+{
+	World world;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	generateTerrain(world, WORLD_RADIUS);
+	double generate = secondsSince(start);
+	size_t generated = world.memoryUsage();
+	size_t blocks = 0;
+	world.forEachChunk([&blocks](const ChunkCoord&, typename World::ChunkType& chunk) {
+		compact(chunk);
+		blocks += chunk.solid();
+	});
+
+	// the coordinates are made up front so the generator isn't timed
+	const int span = WORLD_RADIUS * Chunk::SIZE;
+	std::mt19937 random(1);
+	std::vector<int> coords(RANDOM_READS * 3);
+	for (size_t i = 0; i < RANDOM_READS; i++) {
+		coords[i * 3] = (int)(random() % (2 * span)) - span;
+		coords[i * 3 + 1] = (int)(random() % 64);
+		coords[i * 3 + 2] = (int)(random() % (2 * span)) - span;
+	}
+	unsigned int sum = 0;
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < RANDOM_READS; i++)
+		sum += world.getBlock(coords[i * 3], coords[i * 3 + 1], coords[i * 3 + 2]);
+	double randomGet = secondsSince(start);
+
+	// x innermost, the order Chunk keeps its blocks in
+	const int passes = 40;
+	const typename World::ChunkType* chunk = world.chunk(ChunkCoord{ 0, 0, 0 });
+	start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; pass++)
+		for (int y = 0; y < Chunk::SIZE; y++)
+			for (int z = 0; z < Chunk::SIZE; z++)
+				for (int x = 0; x < Chunk::SIZE; x++)
+					sum += chunk->get(x, y, z);
+	double chunkGet = secondsSince(start);
+	sink = sum;
+
+	std::cout << std::fixed << std::setprecision(1) << name << ": " << world.chunkCount() << " chunks, "
+		<< generated / 1024.0 / world.chunkCount() << " KB a chunk, "
+		<< world.memoryUsage() / 1024.0 / world.chunkCount() << " after compacting" << std::endl;
+	std::cout << "  setBlock while generating  " << generate * 1e9 / blocks << " ns a block" << std::endl;
+	std::cout << "  getBlock at random         " << randomGet * 1e9 / RANDOM_READS << " ns a block" << std::endl;
+	std::cout << "  get within one chunk       " << std::setprecision(2) << chunkGet * 1e9 / (passes * Chunk::VOLUME) << " ns a block" << std::endl;
+}
+
+// mesh every chunk with greedy merging and with one quad per visible face
+template<class World>
+void measureMeshing(const char* name)
+{
+	World world;
+	generateTerrain(world, WORLD_RADIUS);
+	std::vector<ChunkCoord> coords;
+	world.forEachChunk([&coords](const ChunkCoord& coord, const typename World::ChunkType&) { coords.push_back(coord); });
+
+	std::cout << name << " meshing:" << std::endl;
+	ChunkMesher mesher;
+	std::vector<VoxelVertex> vertices;
+	for (int merge = 1; merge >= 0; merge--) {
+		mesher.merge = merge != 0;
+		size_t quads = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (const ChunkCoord& coord : coords) {
+			mesher.mesh(world, coord, vertices);
+			quads += vertices.size() / 4;
+		}
+		double seconds = secondsSince(start);
+		std::cout << (merge ? "  greedy                     " : "  one quad per face          ")
+			<< std::setprecision(0) << quads * 2.0 / coords.size() << " triangles a chunk, "
+			<< coords.size() / seconds << " chunks a second" << std::endl;
+	}
+}
+
+int main()
+{
+	measureAccess<VoxelWorld>("dense");
+	measureAccess<PaletteVoxelWorld>("palette");
+	measureAccess<OctreeVoxelWorld>("octree");
+	// meshing reads each chunk a row at a time through copyRow
+	measureMeshing<VoxelWorld>("dense");
+	measureMeshing<PaletteVoxelWorld>("palette");
+	measureMeshing<OctreeVoxelWorld>("octree");
+	return 0;
+}
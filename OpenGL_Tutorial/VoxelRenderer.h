@@ -0,0 +1,165 @@
+#ifndef VOXEL_RENDERER_H
+#define VOXEL_RENDERER_H
+
+#include "ChunkMesher.h"
+#include "GLState.h"
+#include "VoxelWorld.h"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// the GPU side of the chunk meshes: a VAO and vertex buffer per chunk, all
+// sharing one index buffer of quads, drawn with vVoxel.vs and fVoxel.fs
+class VoxelRenderer
+{
+public:
+	VoxelRenderer()
+	{
+		glGenBuffers(1, &quadIndices);
+	}
+
+	~VoxelRenderer()
+	{
+		for (auto& entry : meshes)
+			release(entry.second);
+		glDeleteBuffers(1, &quadIndices);
+	}
+
+	VoxelRenderer(const VoxelRenderer&) = delete;
+	VoxelRenderer& operator=(const VoxelRenderer&) = delete;
+
+	// replace the mesh of the chunk at coord with vertexCount vertices from
+	// ChunkMesher; no vertices removes it
+	void upload(const ChunkCoord& coord, const VoxelVertex* vertices, size_t vertexCount)
+	{
+		if (vertexCount == 0) {
+			remove(coord);
+			return;
+		}
+		size_t quads = vertexCount / 4;
+		reserveQuads(quads);
+
+		auto it = meshes.find(coord);
+		if (it == meshes.end())
+			it = meshes.emplace(coord, createMesh()).first;
+		ChunkMeshBuffers& mesh = it->second;
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(VoxelVertex), vertices, GL_STATIC_DRAW);
+		mesh.indexCount = (GLsizei)(quads * 6);
+		mesh.bytes = vertexCount * sizeof(VoxelVertex);
+	}
+
+	void upload(const ChunkCoord& coord, const std::vector<VoxelVertex>& vertices)
+	{
+		upload(coord, vertices.data(), vertices.size());
+	}
+
+	void remove(const ChunkCoord& coord)
+	{
+		auto it = meshes.find(coord);
+		if (it == meshes.end())
+			return;
+		release(it->second);
+		meshes.erase(it);
+	}
+
+	// draw every chunk with the voxel shader, which must be in use;
+	// chunkOriginLoc is its chunkOrigin uniform
+	void draw(GLint chunkOriginLoc) const
+	{
+		for (const auto& entry : meshes) {
+			const ChunkCoord& c = entry.first;
+			glUniform3f(chunkOriginLoc, (float)(c.x * Chunk::SIZE), (float)(c.y * Chunk::SIZE), (float)(c.z * Chunk::SIZE));
+			glState().bindVertexArray(entry.second.VAO);
+			glDrawElements(GL_TRIANGLES, entry.second.indexCount, GL_UNSIGNED_INT, 0);
+		}
+	}
+
+	size_t chunkCount() const
+	{
+		return meshes.size();
+	}
+
+	size_t triangleCount() const
+	{
+		size_t triangles = 0;
+		for (const auto& entry : meshes)
+			triangles += entry.second.indexCount / 3;
+		return triangles;
+	}
+
+	// bytes of vertex data across every chunk, not counting the shared indices
+	size_t vertexBytes() const
+	{
+		size_t bytes = 0;
+		for (const auto& entry : meshes)
+			bytes += entry.second.bytes;
+		return bytes;
+	}
+
+private:
+	struct ChunkMeshBuffers
+	{
+		unsigned int VAO, VBO;
+		GLsizei indexCount;
+		size_t bytes;
+	};
+
+	std::unordered_map<ChunkCoord, ChunkMeshBuffers, ChunkCoordHash> meshes;
+	unsigned int quadIndices = 0;
+	size_t indexedQuads = 0;
+
+	ChunkMeshBuffers createMesh()
+	{
+		ChunkMeshBuffers mesh = { 0, 0, 0, 0 };
+		glGenVertexArrays(1, &mesh.VAO);
+		glGenBuffers(1, &mesh.VBO);
+		glState().bindVertexArray(mesh.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+		// one integer attribute, so the shader gets the packed bits as they are
+		glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(VoxelVertex), (void*)0);
+		glEnableVertexAttribArray(0);
+		// the VAO keeps the index buffer binding
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndices);
+		return mesh;
+	}
+
+	void release(ChunkMeshBuffers& mesh)
+	{
+		glState().forgetVertexArray(mesh.VAO);
+		glDeleteVertexArrays(1, &mesh.VAO);
+		glDeleteBuffers(1, &mesh.VBO);
+	}
+
+	// grow the shared index buffer to cover quads quads. the buffer keeps its
+	// name, so every VAO that refers to it sees the new contents
+	void reserveQuads(size_t quads)
+	{
+		if (quads <= indexedQuads)
+			return;
+		size_t count = indexedQuads ? indexedQuads : 1024;
+		while (count < quads)
+			count *= 2;
+		std::vector<unsigned int> indices(count * 6);
+		for (size_t q = 0; q < count; ++q) {
+			unsigned int first = (unsigned int)(q * 4);
+			unsigned int* quad = &indices[q * 6];
+			quad[0] = first;
+			quad[1] = first + 1;
+			quad[2] = first + 2;
+			quad[3] = first + 2;
+			quad[4] = first + 3;
+			quad[5] = first;
+		}
+		// bound through GL_COPY_WRITE_BUFFER, which leaves the current VAO's element binding alone
+		glBindBuffer(GL_COPY_WRITE_BUFFER, quadIndices);
+		glBufferData(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		indexedQuads = count;
+	}
+};
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef VOXEL_WORLD_H
+#define VOXEL_WORLD_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+// what fills one voxel; 0 is empty space
+typedef uint16_t BlockId;
+const BlockId AIR = 0;
+
+// position of a chunk in chunk units - block (x, y, z) lives in chunk (x >> 5, y >> 5, z >> 5)
+struct ChunkCoord
+{
+	int x, y, z;
+
+	bool operator==(const ChunkCoord& other) const
+	{
+		return x == other.x && y == other.y && z == other.z;
+	}
+
+	bool operator!=(const ChunkCoord& other) const
+	{
+		return !(*this == other);
+	}
+};
+
+struct ChunkCoordHash
+{
+	size_t operator()(const ChunkCoord& c) const
+	{
+		// neighbouring chunks differ by one in a coordinate, so spread every bit
+		// of each one across the word before combining them
+		uint64_t h = (uint64_t)(uint32_t)c.x * 0x9E3779B97F4A7C15ull;
+		h ^= (uint64_t)(uint32_t)c.y * 0xC2B2AE3D27D4EB4Full;
+		h ^= (uint64_t)(uint32_t)c.z * 0x165667B19E3779F9ull;
+		return (size_t)(h ^ (h >> 31));
+	}
+};
+
+// a 32x32x32 block of voxels stored as one flat array. x is the fastest
+// moving coordinate, then z, then y, so a row along x is contiguous and a
+// horizontal slice is one 2 KB run.
+//
+// this is the dense store, the fastest to read and write. PaletteChunk.h and
+// OctreeChunk.h hold the same blocks in less memory behind the same get, set,
+// copyRow, solid, empty and memoryUsage, and every one of them works with
+// BasicVoxelWorld below
+class Chunk
+{
+public:
+	static const int SHIFT = 5;
+	static const int SIZE = 1 << SHIFT;
+	static const int MASK = SIZE - 1;
+	static const int VOLUME = SIZE * SIZE * SIZE;
+
+	Chunk()
+	{
+		std::fill(blocks, blocks + VOLUME, AIR);
+	}
+
+	// local coordinates, each 0 to SIZE - 1
+	static int index(int x, int y, int z)
+	{
+		return (((y << SHIFT) | z) << SHIFT) | x;
+	}
+
+	BlockId get(int x, int y, int z) const
+	{
+		return blocks[index(x, y, z)];
+	}
+
+	void set(int x, int y, int z, BlockId block)
+	{
+		BlockId& slot = blocks[index(x, y, z)];
+		solidCount += (block != AIR) - (slot != AIR);
+		slot = block;
+	}
+
+	// the SIZE blocks of the row at (y, z), x from 0 up
+	void copyRow(int y, int z, BlockId* out) const
+	{
+		std::memcpy(out, blocks + index(0, y, z), SIZE * sizeof(BlockId));
+	}
+
+	// the VOLUME blocks in index() order
+	const BlockId* data() const
+	{
+		return blocks;
+	}
+
+	// blocks that aren't AIR
+	int solid() const
+	{
+		return solidCount;
+	}
+
+	bool empty() const
+	{
+		return solidCount == 0;
+	}
+
+	size_t memoryUsage() const
+	{
+		return sizeof(Chunk);
+	}
+
+private:
+	BlockId blocks[VOLUME];
+	int solidCount = 0;
+};
+
+// an unbounded voxel world made of chunks that only exist where something was
+// set. getBlock and setBlock are a hash lookup plus a chunk access; to touch
+// many blocks of one chunk, look it up once with chunk() and use local coordinates.
+// reading from several threads is fine as long as nothing writes at the same time.
+// ChunkT is how each chunk stores its blocks, any class with Chunk's interface;
+// VoxelWorld uses the dense Chunk itself
+template<class ChunkT>
+class BasicVoxelWorld
+{
+public:
+	typedef ChunkT ChunkType;
+
+	BasicVoxelWorld() = default;
+	BasicVoxelWorld(const BasicVoxelWorld&) = delete;
+	BasicVoxelWorld& operator=(const BasicVoxelWorld&) = delete;
+
+	// the chunk holding block (x, y, z). the shifts floor negative coordinates
+	// too, so block -1 is in chunk -1 at local 31
+	static ChunkCoord chunkOf(int x, int y, int z)
+	{
+		return ChunkCoord{ x >> Chunk::SHIFT, y >> Chunk::SHIFT, z >> Chunk::SHIFT };
+	}
+
+	// AIR where no chunk exists
+	BlockId getBlock(int x, int y, int z) const
+	{
+		const ChunkType* c = chunk(chunkOf(x, y, z));
+		return c ? c->get(x & Chunk::MASK, y & Chunk::MASK, z & Chunk::MASK) : AIR;
+	}
+
+	// creates the chunk if needed, except when setting AIR
+	void setBlock(int x, int y, int z, BlockId block)
+	{
+		ChunkCoord coord = chunkOf(x, y, z);
+		ChunkType* c = block == AIR ? chunk(coord) : &createChunk(coord);
+		if (c)
+			c->set(x & Chunk::MASK, y & Chunk::MASK, z & Chunk::MASK, block);
+	}
+
+	ChunkType* chunk(const ChunkCoord& coord)
+	{
+		auto it = chunks.find(coord);
+		return it == chunks.end() ? nullptr : it->second.get();
+	}
+
+	const ChunkType* chunk(const ChunkCoord& coord) const
+	{
+		auto it = chunks.find(coord);
+		return it == chunks.end() ? nullptr : it->second.get();
+	}
+
+	// the chunk at coord, made empty if it didn't exist
+	ChunkType& createChunk(const ChunkCoord& coord)
+	{
+		std::unique_ptr<ChunkType>& slot = chunks[coord];
+		if (!slot)
+			slot.reset(new ChunkType());
+		return *slot;
+	}
+
+	bool removeChunk(const ChunkCoord& coord)
+	{
+		return chunks.erase(coord) != 0;
+	}
+
+	size_t chunkCount() const
+	{
+		return chunks.size();
+	}
+
+	// f(const ChunkCoord&, ChunkType&) for every chunk, in no particular order
+	template<class F>
+	void forEachChunk(F f)
+	{
+		for (auto& entry : chunks)
+			f(entry.first, *entry.second);
+	}
+
+	template<class F>
+	void forEachChunk(F f) const
+	{
+		for (const auto& entry : chunks)
+			f(entry.first, (const ChunkType&)*entry.second);
+	}
+
+	// bytes held by the chunks plus an estimate of the hash map's own nodes and buckets
+	size_t memoryUsage() const
+	{
+		size_t bytes = chunks.bucket_count() * sizeof(void*);
+		for (const auto& entry : chunks)
+			bytes += entry.second->memoryUsage() + sizeof(entry) + sizeof(void*);
+		return bytes;
+	}
+
+private:
+	std::unordered_map<ChunkCoord, std::unique_ptr<ChunkType>, ChunkCoordHash> chunks;
+};
+
+typedef BasicVoxelWorld<Chunk> VoxelWorld;
+
+#endif
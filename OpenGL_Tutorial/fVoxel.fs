@@ -0,0 +1,14 @@
+#version 330 core
+
+flat in uint Layer;
+in float Light;
+
+out vec4 FragColor;
+
+// colour per layer, which is the block type - unknown types show up magenta
+const vec3 blockColor[4] = vec3[4](vec3(1.0, 0.0, 1.0), vec3(0.5, 0.5, 0.5), vec3(0.45, 0.3, 0.18), vec3(0.3, 0.6, 0.2));
+
+void main()
+{
+	FragColor = vec4(blockColor[Layer < 4u ? Layer : 0u] * Light, 1.0);
+}
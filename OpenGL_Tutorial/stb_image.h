@@ -175,6 +175,17 @@ RECENT REVISION HISTORY:
 //
 // ===========================================================================
 //
+// Memory-mapped files
+//
+// stbi_load_mmap() takes the same arguments as stbi_load(), but maps the
+// whole file into memory (mmap on POSIX, a file mapping on Windows) and
+// decodes it like stbi_load_from_memory(), so the decoders read straight
+// from the page cache instead of through fread and the 128-byte buffer.
+// If the file cannot be mapped it falls back to stbi_load(). Define
+// STBI_NO_MMAP to always take the fallback.
+//
+// ===========================================================================
+//
 // Philosophy
 //
 // stb libraries are designed with the following priorities:
@@ -225,12 +236,109 @@ RECENT REVISION HISTORY:
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// On x86 the IDCT, YCbCr->RGB and 2x2 upsampling kernels additionally have
+// AVX2 versions (two 8x8 blocks or 16 pixels per iteration). They are only
+// used if a CPUID check at run time says the CPU and OS support AVX2, and
+// they give the same output as the SSE2 kernels. Define STBI_NO_AVX2 to
+// leave them out.
+//
+// The PNG decoder undoes the scanline filters of 8-bit RGB and RGBA images
+// with SSE2 (one pixel per step for Sub/Avg/Paeth, and AVX2 for Up when
+// available).
+//
+// Inflate decodes the bulk of each huffman block with a table-driven loop
+// that reads 8 bytes and writes up to two literals at a time. Define
+// STBI_NO_ZLIB_FAST to leave it out and decode one symbol at a time.
+//
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
 // ===========================================================================
 //
+// Multithreaded JPEG decoding
+//
+// Baseline JPEGs that were written with restart markers (DRI) can have their
+// restart intervals entropy-decoded and IDCT'd on several threads at once.
+// stb_image starts no threads of its own; it splits the intervals into
+// jpeg_threads tasks and hands them to a parallel_for you supply, which runs
+// them on whatever pool the program already has:
+//
+//     static void run_tasks(void *pool, void (*task)(void *arg, int index), void *arg, int count)
+//     {
+//        ... run task(arg, 0) .. task(arg, count-1) on the pool, return when all are done ...
+//     }
+//
+//     stbi_load_options opts;
+//     stbi_load_options_init(&opts);
+//     opts.jpeg_threads = 4;
+//     opts.parallel_for = run_tasks;
+//     opts.parallel_user = my_pool;
+//     stbi_load_opts(filename, &x, &y, &n, &opts);
+//
+// Images without restart markers, progressive images and small images are
+// always decoded on the calling thread, and the result is bit-identical to
+// the single-threaded decoder either way. Define STBI_NO_THREADS to compile
+// the split out.
+//
+// ===========================================================================
+//
+// Scratch arenas
+//
+// A decode normally makes many short-lived STBI_MALLOC/STBI_FREE calls
+// (JPEG component buffers, zlib output, PNG filter rows, ...). Programs that
+// load lots of images can give each loading thread an arena instead:
+//
+//     stbi_arena *arena = stbi_arena_create(16 << 20);
+//     stbi_set_thread_arena(arena);
+//     ... stbi_load() as many times as you like ...
+//     stbi_set_thread_arena(NULL);
+//     stbi_arena_destroy(arena);
+//
+// While an arena is set, the 8- and 16-bit loaders bump-allocate all their
+// scratch memory from it and reset it when the image is done. The pixel
+// buffer that gets returned is allocated with STBI_MALLOC in the first place,
+// so it is never copied out of the arena and stbi_image_free() works as usual.
+// The arena keeps its high-water mark, so after the first few images a decode
+// makes no allocator calls apart from the result. An
+// arena must only be used by one thread at a time. Float and animated GIF
+// loads ignore the arena.
+//
+// ===========================================================================
+//
+// Streaming PNG decoding
+//
+// stbi_load() inflates the whole PNG into one buffer and then unfilters it
+// into a second one, so peak memory is about twice the image. The streaming
+// entry points instead inflate and unfilter a band of scanlines at a time
+// (about 64KB of output per band) and hand each band over as soon as it is
+// done, either by copying it into a buffer you supply:
+//
+//     // out holds at least (h-1)*stride + w*4 bytes
+//     stbi_png_load_into(filename, out, out_size, stride, &x, &y, &n, 4, 8);
+//
+// or by calling you back with every band:
+//
+//     int my_rows(void *user, int y, int rows, const void *pixels, int stride)
+//     {
+//        ... rows [y, y+rows) are at pixels, 'stride' bytes apart ...
+//        return 1; // or 0 to stop decoding
+//     }
+//     stbi_png_load_rows(filename, my_rows, user, &x, &y, &n, 4, 8);
+//
+// Both return 1 on success and 0 on failure (see stbi_failure_reason()).
+// desired_channels works as for stbi_load, and bits_per_channel (8 or 16)
+// picks between 8-bit samples and native-endian 16-bit samples. An out_stride
+// of 0 means tightly packed rows. Call stbi_info() first if you need the size
+// up front, and pass a nonzero desired_channels when sizing the buffer from
+// it: a gray or RGB image with a tRNS chunk gains an alpha channel that
+// stbi_info() does not report. stbi_png_load_into honors
+// stbi_set_flip_vertically_on_load; the callback always sees rows top to
+// bottom. Interlaced PNGs cannot be streamed; they are decoded whole and
+// delivered as a single band.
+//
+// ===========================================================================
+//
 // HDR image support   (disable by defining STBI_NO_HDR)
 //
 // stb_image supports loading HDR images in general, and currently the Radiance
@@ -376,12 +484,24 @@ extern "C" {
 	STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
 	STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
 	// for stbi_load_from_file, file pointer is left pointing immediately after image
+	STBIDEF stbi_uc *stbi_load_mmap(char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
 #endif
 
 #ifndef STBI_NO_GIF
 	STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
 #endif
 
+#ifndef STBI_NO_PNG
+	// streaming PNG decode; see "Streaming PNG decoding" above
+	typedef int stbi_png_rows_callback(void *user, int y, int rows, const void *pixels, int stride);
+	STBIDEF int stbi_png_load_rows_from_memory(stbi_uc const *buffer, int len, stbi_png_rows_callback *cb, void *user, int *x, int *y, int *channels_in_file, int desired_channels, int bits_per_channel);
+	STBIDEF int stbi_png_load_into_from_memory(stbi_uc const *buffer, int len, void *out, size_t out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels, int bits_per_channel);
+#ifndef STBI_NO_STDIO
+	STBIDEF int stbi_png_load_rows(char const *filename, stbi_png_rows_callback *cb, void *user, int *x, int *y, int *channels_in_file, int desired_channels, int bits_per_channel);
+	STBIDEF int stbi_png_load_into(char const *filename, void *out, size_t out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels, int bits_per_channel);
+#endif
+#endif
+
 #ifdef STBI_WINDOWS_UTF8
 	STBIDEF int stbi_convert_wchar_to_utf8(char *buffer, size_t bufferlen, const wchar_t* input);
 #endif
@@ -432,8 +552,7 @@ extern "C" {
 #endif // STBI_NO_STDIO
 
 
-	// get a VERY brief reason for failure
-	// NOT THREADSAFE
+	// get a VERY brief reason for the calling thread's last failure
 	STBIDEF const char *stbi_failure_reason(void);
 
 	// free the loaded image -- this is just free()
@@ -466,6 +585,44 @@ extern "C" {
 	// flip the image vertically, so the first pixel in the output array is the bottom left
 	STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+	// runs task(arg, 0) .. task(arg, count-1), in parallel where it can, and
+	// returns once all of them are done; see "Multithreaded JPEG decoding" above
+	typedef void stbi_parallel_for(void *user, void (*task)(void *arg, int index), void *arg, int count);
+
+	// the three settings above are process-wide, so threads loading at the same
+	// time can't disagree about them. the *_opts loaders take them per call
+	// instead; stbi_load_options_init fills in the current global settings and
+	// single-threaded JPEG decoding. passing NULL for opts is the same as
+	// calling the plain loader
+	typedef struct
+	{
+		int desired_channels;  // as for stbi_load; 0 keeps the file's channels
+		int flip_vertically;   // see stbi_set_flip_vertically_on_load
+		int unpremultiply;     // see stbi_set_unpremultiply_on_load
+		int convert_iphone;    // see stbi_convert_iphone_png_to_rgb
+		int jpeg_threads;      // split JPEG restart intervals into this many tasks; 1 decodes serially
+		stbi_parallel_for *parallel_for; // runs those tasks; NULL decodes serially
+		void *parallel_user;   // passed to parallel_for
+	} stbi_load_options;
+
+	STBIDEF void     stbi_load_options_init(stbi_load_options *opts);
+	STBIDEF stbi_uc *stbi_load_from_memory_opts(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, stbi_load_options const *opts);
+	STBIDEF stbi_uc *stbi_load_from_callbacks_opts(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *channels_in_file, stbi_load_options const *opts);
+	STBIDEF stbi_us *stbi_load_16_from_memory_opts(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, stbi_load_options const *opts);
+#ifndef STBI_NO_STDIO
+	STBIDEF stbi_uc *stbi_load_opts(char const *filename, int *x, int *y, int *channels_in_file, stbi_load_options const *opts);
+	STBIDEF stbi_uc *stbi_load_from_file_opts(FILE *f, int *x, int *y, int *channels_in_file, stbi_load_options const *opts);
+	STBIDEF stbi_uc *stbi_load_mmap_opts(char const *filename, int *x, int *y, int *channels_in_file, stbi_load_options const *opts);
+	STBIDEF stbi_us *stbi_load_16_opts(char const *filename, int *x, int *y, int *channels_in_file, stbi_load_options const *opts);
+#endif
+
+	// reusable scratch memory for decoding; see "Scratch arenas" above.
+	// stbi_set_thread_arena only affects the calling thread
+	typedef struct stbi_arena stbi_arena;
+	STBIDEF stbi_arena *stbi_arena_create(size_t initial_size);
+	STBIDEF void stbi_arena_destroy(stbi_arena *arena);
+	STBIDEF void stbi_set_thread_arena(stbi_arena *arena);
+
 	// ZLIB client - used by PNG, available for other purposes
 
 	STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -486,7 +643,9 @@ extern "C" {
 ////   end header file   /////////////////////////////////////////////////////
 #endif // STBI_INCLUDE_STB_IMAGE_H
 
-#ifdef STB_IMAGE_IMPLEMENTATION
+// helper headers include stb_image.h too, so only expand the implementation once
+#if defined(STB_IMAGE_IMPLEMENTATION) && !defined(STBI_IMPLEMENTATION_INCLUDED)
+#define STBI_IMPLEMENTATION_INCLUDED
 
 #if defined(STBI_ONLY_JPEG) || defined(STBI_ONLY_PNG) || defined(STBI_ONLY_BMP) \
   || defined(STBI_ONLY_TGA) || defined(STBI_ONLY_GIF) || defined(STBI_ONLY_PSD) \
@@ -568,12 +727,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -613,6 +774,20 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32) == 4 ? 1 : -1];
 #define STBI_REALLOC_SIZED(p,oldsz,newsz) STBI_REALLOC(p,newsz)
 #endif
 
+#ifndef STBI_THREAD_LOCAL
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define STBI_THREAD_LOCAL       thread_local
+#elif defined(_MSC_VER)
+#define STBI_THREAD_LOCAL       __declspec(thread)
+#elif defined(__GNUC__)
+#define STBI_THREAD_LOCAL       __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define STBI_THREAD_LOCAL       _Thread_local
+#else
+#define STBI_THREAD_LOCAL       // no TLS: arenas and failure reasons are then shared by all threads
+#endif
+#endif
+
 // x86/x64 detection
 #if defined(__x86_64__) || defined(_M_X64)
 #define STBI__X64_TARGET
@@ -675,7 +850,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if !(defined(STBI_NO_JPEG) && defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
 	int info3 = stbi__cpuid3();
@@ -686,7 +861,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if !(defined(STBI_NO_JPEG) && defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
 	// If we're even attempting to compile this on GCC/Clang, that means
@@ -699,6 +874,38 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 kernels for the JPEG and PNG decoders. Unlike SSE2 these are always picked at
+// run time: on GCC/Clang the AVX2 functions get a per-function target
+// attribute, so the rest of the library still builds without -mavx2.
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && !(defined(STBI_NO_JPEG) && defined(STBI_NO_PNG)) && \
+	((defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+static int stbi__avx2_available(void)
+{
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return 0;
+	__cpuid(info, 1);
+	// the OS has to save the ymm registers too (OSXSAVE + XCR0 bits 1,2)
+	if (((info[2] >> 27) & 1) == 0 || ((info[2] >> 28) & 1) == 0) return 0;
+	if ((_xgetbv(0) & 6) != 6) return 0;
+	__cpuidex(info, 7, 0);
+	return ((info[1] >> 5) & 1) != 0;
+}
+#else
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+static int stbi__avx2_available(void)
+{
+	// also checks that the OS saves the ymm registers
+	return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -718,6 +925,11 @@ static int stbi__sse2_available(void)
 //
 //  stbi__context struct and start_xxx functions
 
+// process-wide load settings; every context starts out with a copy of them
+static int stbi__vertically_flip_on_load = 0;
+static int stbi__unpremultiply_on_load = 0;
+static int stbi__de_iphone_flag = 0;
+
 // stbi__context structure is our basic context used by all images, so it
 // contains all the IO context, plus some basic image information
 typedef struct
@@ -725,6 +937,12 @@ typedef struct
 	stbi__uint32 img_x, img_y;
 	int img_n, img_out_n;
 
+	// load settings for this image; the *_opts loaders override the globals
+	int flip_vertically, unpremultiply, de_iphone;
+	int jpeg_threads;
+	stbi_parallel_for *parallel_for;
+	void *parallel_user;
+
 	stbi_io_callbacks io;
 	void *io_user_data;
 
@@ -739,9 +957,20 @@ typedef struct
 
 static void stbi__refill_buffer(stbi__context *s);
 
+static void stbi__start_options(stbi__context *s)
+{
+	s->flip_vertically = stbi__vertically_flip_on_load != 0;
+	s->unpremultiply = stbi__unpremultiply_on_load;
+	s->de_iphone = stbi__de_iphone_flag;
+	s->jpeg_threads = 1;
+	s->parallel_for = NULL;
+	s->parallel_user = NULL;
+}
+
 // initialize a memory-decode context
 static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
 {
+	stbi__start_options(s);
 	s->io.read = NULL;
 	s->read_from_callbacks = 0;
 	s->img_buffer = s->img_buffer_original = (stbi_uc *)buffer;
@@ -751,6 +980,7 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
 // initialize a callback-based context
 static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *user)
 {
+	stbi__start_options(s);
 	s->io = *c;
 	s->io_user_data = user;
 	s->buflen = sizeof(s->buffer_start);
@@ -813,6 +1043,7 @@ typedef struct
 	int bits_per_channel;
 	int num_channels;
 	int channel_order;
+	int flipped; // the loader already wrote the rows bottom-up, skip stbi__vertical_flip
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -872,8 +1103,8 @@ static void    *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
-// this is not threadsafe
-static const char *stbi__g_failure_reason;
+// per thread, so loads running on several threads each see their own reason
+static STBI_THREAD_LOCAL const char *stbi__g_failure_reason;
 
 STBIDEF const char *stbi_failure_reason(void)
 {
@@ -886,11 +1117,176 @@ static int stbi__err(const char *str)
 	return 0;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// scratch arena
+//
+// every allocation carries a 16-byte header holding its size, so realloc
+// knows how much to move; freeing or growing the most recent allocation
+// works in place, anything else just waits for the reset
+
+#define STBI__ARENA_ALIGN  16
+#define STBI__ARENA_ROUND(n)  (((n) + STBI__ARENA_ALIGN - 1) & ~(size_t)(STBI__ARENA_ALIGN - 1))
+
+typedef struct stbi__arena_block
+{
+	struct stbi__arena_block *prev;
+	size_t size, used;
+} stbi__arena_block;
+
+struct stbi_arena
+{
+	stbi__arena_block *block; // current block, older ones are linked through prev
+	size_t total;             // sum of all block sizes
+};
+
+#define stbi__arena_data(b)   ((stbi_uc *)(b) + STBI__ARENA_ROUND(sizeof(stbi__arena_block)))
+#define stbi__arena_size(p)   (*(size_t *)((stbi_uc *)(p) - STBI__ARENA_ALIGN))
+
+static STBI_THREAD_LOCAL stbi_arena *stbi__thread_arena; // set by stbi_set_thread_arena
+static STBI_THREAD_LOCAL stbi_arena *stbi__active_arena; // non-NULL only inside a load
+static STBI_THREAD_LOCAL int stbi__result_n, stbi__result_bits; // what that load returns, 0 channels for the file's own
+
+static int stbi__arena_add_block(stbi_arena *a, size_t size)
+{
+	stbi__arena_block *b = (stbi__arena_block *)STBI_MALLOC(STBI__ARENA_ROUND(sizeof(stbi__arena_block)) + size);
+	if (!b) return 0;
+	b->prev = a->block;
+	b->size = size;
+	b->used = 0;
+	a->block = b;
+	a->total += size;
+	return 1;
+}
+
+static void stbi__arena_free_blocks(stbi_arena *a)
+{
+	while (a->block) {
+		stbi__arena_block *prev = a->block->prev;
+		STBI_FREE(a->block);
+		a->block = prev;
+	}
+	a->total = 0;
+}
+
+STBIDEF stbi_arena *stbi_arena_create(size_t initial_size)
+{
+	stbi_arena *a = (stbi_arena *)STBI_MALLOC(sizeof(stbi_arena));
+	if (!a) return NULL;
+	a->block = NULL;
+	a->total = 0;
+	if (initial_size && !stbi__arena_add_block(a, initial_size)) {
+		STBI_FREE(a);
+		return NULL;
+	}
+	return a;
+}
+
+STBIDEF void stbi_arena_destroy(stbi_arena *arena)
+{
+	if (!arena) return;
+	stbi__arena_free_blocks(arena);
+	STBI_FREE(arena);
+}
+
+STBIDEF void stbi_set_thread_arena(stbi_arena *arena)
+{
+	stbi__thread_arena = arena;
+}
+
+static void *stbi__arena_alloc(stbi_arena *a, size_t size)
+{
+	size_t n = STBI__ARENA_ROUND(size) + STBI__ARENA_ALIGN;
+	stbi__arena_block *b = a->block;
+	stbi_uc *p;
+	if (n < size) return NULL; // overflow
+	if (!b || b->size - b->used < n) {
+		size_t grow = b ? b->size * 2 : 65536;
+		if (!stbi__arena_add_block(a, grow > n ? grow : n)) return NULL;
+		b = a->block;
+	}
+	p = stbi__arena_data(b) + b->used + STBI__ARENA_ALIGN;
+	b->used += n;
+	stbi__arena_size(p) = size;
+	return p;
+}
+
+static int stbi__arena_owns(stbi_arena *a, void *p)
+{
+	stbi__arena_block *b;
+	for (b = a->block; b; b = b->prev)
+		if ((stbi_uc *)p > stbi__arena_data(b) && (stbi_uc *)p < stbi__arena_data(b) + b->size)
+			return 1;
+	return 0;
+}
+
+// offset of p's header if p is the last allocation in the current block, else -1
+static ptrdiff_t stbi__arena_top(stbi_arena *a, void *p)
+{
+	stbi__arena_block *b = a->block;
+	stbi_uc *h = (stbi_uc *)p - STBI__ARENA_ALIGN;
+	if (h < stbi__arena_data(b) || h >= stbi__arena_data(b) + b->used) return -1;
+	if (h + STBI__ARENA_ROUND(stbi__arena_size(p)) + STBI__ARENA_ALIGN != stbi__arena_data(b) + b->used) return -1;
+	return h - stbi__arena_data(b);
+}
+
+// drop everything; if the arena had to grow, merge it into one block so the
+// next image of the same size fits without touching the allocator
+static void stbi__arena_reset(stbi_arena *a)
+{
+	if (a->block && a->block->prev) {
+		size_t total = a->total;
+		stbi__arena_free_blocks(a);
+		stbi__arena_add_block(a, total);
+	}
+	else if (a->block) {
+		a->block->used = 0;
+	}
+}
+
 static void *stbi__malloc(size_t size)
 {
+	if (stbi__active_arena) return stbi__arena_alloc(stbi__active_arena, size);
 	return STBI_MALLOC(size);
 }
 
+static void stbi__free(void *p)
+{
+	stbi_arena *a = stbi__active_arena;
+	if (p && a && stbi__arena_owns(a, p)) {
+		ptrdiff_t at = stbi__arena_top(a, p);
+		if (at >= 0) a->block->used = (size_t)at;
+		return;
+	}
+	STBI_FREE(p);
+}
+
+static void *stbi__realloc_sized(void *p, size_t oldsz, size_t newsz)
+{
+	stbi_arena *a = stbi__active_arena;
+	void *q;
+	if (!a) {
+		STBI_NOTUSED(oldsz);
+		return STBI_REALLOC_SIZED(p, oldsz, newsz);
+	}
+	if (!p) return stbi__arena_alloc(a, newsz);
+	if (stbi__arena_owns(a, p)) {
+		ptrdiff_t at = stbi__arena_top(a, p);
+		size_t n = STBI__ARENA_ROUND(newsz) + STBI__ARENA_ALIGN;
+		if (at >= 0 && n >= newsz && a->block->size - (size_t)at >= n) {
+			a->block->used = (size_t)at + n;
+			stbi__arena_size(p) = newsz;
+			return p;
+		}
+		oldsz = stbi__arena_size(p);
+	}
+	q = stbi__arena_alloc(a, newsz);
+	if (!q) return NULL;
+	memcpy(q, p, oldsz < newsz ? oldsz : newsz);
+	stbi__free(p);
+	return q;
+}
+
 // stb_image uses ints pervasively, including for offset calculations.
 // therefore the largest decoded image size we can support with the
 // current code, even on 64-bit targets, is INT_MAX. this is not a
@@ -966,6 +1362,23 @@ static void *stbi__malloc_mad4(int a, int b, int c, int d, int add)
 }
 #endif
 
+// a pixel buffer already in the channel count and bit depth the load returns
+// is the result, so it skips the arena and is handed back without a copy; one
+// that still has to be converted is scratch like anything else
+static void *stbi__malloc_pixels(int channels, int bits, size_t size)
+{
+	stbi_arena *a = stbi__active_arena;
+	if (a && ((stbi__result_n && stbi__result_n != channels) || bits != stbi__result_bits))
+		return stbi__arena_alloc(a, size);
+	return STBI_MALLOC(size);
+}
+
+static void *stbi__malloc_pixels_mad3(int channels, int bits, int a, int b, int c, int add)
+{
+	if (!stbi__mad3sizes_valid(a, b, c, add)) return NULL;
+	return stbi__malloc_pixels(channels, bits, a*b*c + add);
+}
+
 // stbi__err - error
 // stbi__errpf - error returning pointer to float
 // stbi__errpuc - error returning pointer to unsigned char
@@ -981,6 +1394,26 @@ static void *stbi__malloc_mad4(int a, int b, int c, int d, int add)
 #define stbi__errpf(x,y)   ((float *)(size_t) (stbi__err(x,y)?NULL:NULL))
 #define stbi__errpuc(x,y)  ((unsigned char *)(size_t) (stbi__err(x,y)?NULL:NULL))
 
+// start a load on this thread's arena; returns 0 if there is none or a load is already running
+static int stbi__arena_begin(int req_comp, int bits)
+{
+	if (!stbi__thread_arena || stbi__active_arena) return 0;
+	stbi__active_arena = stbi__thread_arena;
+	stbi__result_n = req_comp;
+	stbi__result_bits = bits;
+	return 1;
+}
+
+// reset the arena once the load is done; the result came from stbi__malloc_pixels
+static void *stbi__arena_end(void *result)
+{
+	stbi_arena *a = stbi__active_arena;
+	STBI_ASSERT(!result || !stbi__arena_owns(a, result));
+	stbi__arena_reset(a);
+	stbi__active_arena = NULL;
+	return result;
+}
+
 STBIDEF void stbi_image_free(void *retval_from_stbi_load)
 {
 	STBI_FREE(retval_from_stbi_load);
@@ -994,8 +1427,6 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp);
 #endif
 
-static int stbi__vertically_flip_on_load = 0;
-
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
 {
 	stbi__vertically_flip_on_load = flag_true_if_should_flip;
@@ -1052,13 +1483,13 @@ static stbi_uc *stbi__convert_16_to_8(stbi__uint16 *orig, int w, int h, int chan
 	int img_len = w * h * channels;
 	stbi_uc *reduced;
 
-	reduced = (stbi_uc *)stbi__malloc(img_len);
+	reduced = (stbi_uc *)stbi__malloc_pixels(channels, 8, img_len);
 	if (reduced == NULL) return stbi__errpuc("outofmem", "Out of memory");
 
 	for (i = 0; i < img_len; ++i)
 		reduced[i] = (stbi_uc)((orig[i] >> 8) & 0xFF); // top half of each byte is sufficient approx of 16->8 bit scaling
 
-	STBI_FREE(orig);
+	stbi__free(orig);
 	return reduced;
 }
 
@@ -1068,13 +1499,13 @@ static stbi__uint16 *stbi__convert_8_to_16(stbi_uc *orig, int w, int h, int chan
 	int img_len = w * h * channels;
 	stbi__uint16 *enlarged;
 
-	enlarged = (stbi__uint16 *)stbi__malloc(img_len * 2);
+	enlarged = (stbi__uint16 *)stbi__malloc_pixels(channels, 16, img_len * 2);
 	if (enlarged == NULL) return (stbi__uint16 *)stbi__errpuc("outofmem", "Out of memory");
 
 	for (i = 0; i < img_len; ++i)
 		enlarged[i] = (stbi__uint16)((orig[i] << 8) + orig[i]); // replicate to high and low byte, maps 0->0, 255->0xffff
 
-	STBI_FREE(orig);
+	stbi__free(orig);
 	return enlarged;
 }
 
@@ -1119,10 +1550,13 @@ static void stbi__vertical_flip_slices(void *image, int w, int h, int z, int byt
 static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
 	stbi__result_info ri;
+	int arena = stbi__arena_begin(req_comp, 8);
 	void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
 
-	if (result == NULL)
+	if (result == NULL) {
+		if (arena) stbi__arena_end(NULL);
 		return NULL;
+	}
 
 	if (ri.bits_per_channel != 8) {
 		STBI_ASSERT(ri.bits_per_channel == 16);
@@ -1132,21 +1566,25 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 
 	// @TODO: move stbi__convert_format to here
 
-	if (stbi__vertically_flip_on_load) {
+	if (s->flip_vertically && !ri.flipped) {
 		int channels = req_comp ? req_comp : *comp;
 		stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
 	}
 
+	if (arena) result = stbi__arena_end(result);
 	return (unsigned char *)result;
 }
 
 static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
 	stbi__result_info ri;
+	int arena = stbi__arena_begin(req_comp, 16);
 	void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 16);
 
-	if (result == NULL)
+	if (result == NULL) {
+		if (arena) stbi__arena_end(NULL);
 		return NULL;
+	}
 
 	if (ri.bits_per_channel != 16) {
 		STBI_ASSERT(ri.bits_per_channel == 8);
@@ -1157,18 +1595,19 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
 	// @TODO: move stbi__convert_format16 to here
 	// @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-	if (stbi__vertically_flip_on_load) {
+	if (s->flip_vertically && !ri.flipped) {
 		int channels = req_comp ? req_comp : *comp;
 		stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
 	}
 
+	if (arena) result = stbi__arena_end(result);
 	return (stbi__uint16 *)result;
 }
 
 #if !defined(STBI_NO_HDR) && !defined(STBI_NO_LINEAR)
-static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, int req_comp)
+static void stbi__float_postprocess(stbi__context *s, float *result, int *x, int *y, int *comp, int req_comp)
 {
-	if (stbi__vertically_flip_on_load && result != NULL) {
+	if (s->flip_vertically && result != NULL) {
 		int channels = req_comp ? req_comp : *comp;
 		stbi__vertical_flip(result, *x, *y, channels * sizeof(float));
 	}
@@ -1228,6 +1667,103 @@ STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *comp, int
 	return result;
 }
 
+#if !defined(STBI_NO_MMAP) && (defined(_WIN32) || defined(__unix__) || defined(__APPLE__))
+#define STBI__MMAP
+
+#ifdef _WIN32
+struct _SECURITY_ATTRIBUTES;
+#ifdef _WIN64
+typedef unsigned __int64 stbi__win32_size_t;
+#else
+typedef unsigned long stbi__win32_size_t;
+#endif
+STBI_EXTERN __declspec(dllimport) void * __stdcall CreateFileA(const char *name, unsigned long access, unsigned long share, struct _SECURITY_ATTRIBUTES *sa, unsigned long disposition, unsigned long flags, void *templ);
+STBI_EXTERN __declspec(dllimport) void * __stdcall CreateFileW(const wchar_t *name, unsigned long access, unsigned long share, struct _SECURITY_ATTRIBUTES *sa, unsigned long disposition, unsigned long flags, void *templ);
+STBI_EXTERN __declspec(dllimport) unsigned long __stdcall GetFileSize(void *file, unsigned long *size_high);
+STBI_EXTERN __declspec(dllimport) void * __stdcall CreateFileMappingA(void *file, struct _SECURITY_ATTRIBUTES *sa, unsigned long protect, unsigned long size_high, unsigned long size_low, const char *name);
+STBI_EXTERN __declspec(dllimport) void * __stdcall MapViewOfFile(void *mapping, unsigned long access, unsigned long offset_high, unsigned long offset_low, stbi__win32_size_t size);
+STBI_EXTERN __declspec(dllimport) int __stdcall UnmapViewOfFile(const void *base);
+STBI_EXTERN __declspec(dllimport) int __stdcall CloseHandle(void *handle);
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// maps all of 'filename' read-only; returns 0 if that isn't possible
+// (missing file, empty file, too big for the int-sized memory context)
+static int stbi__mmap_open(char const *filename, void **data, size_t *len)
+{
+#ifdef _WIN32
+	void *file, *mapping;
+	unsigned long size_low, size_high;
+#if defined(_MSC_VER) && defined(STBI_WINDOWS_UTF8)
+	wchar_t wFilename[1024];
+	if (0 == MultiByteToWideChar(65001 /* UTF8 */, 0, filename, -1, wFilename, sizeof(wFilename) / sizeof(*wFilename)))
+		return 0;
+	file = CreateFileW(wFilename, 0x80000000 /* GENERIC_READ */, 1 /* FILE_SHARE_READ */, NULL, 3 /* OPEN_EXISTING */, 0x08000000 /* FILE_FLAG_SEQUENTIAL_SCAN */, NULL);
+#else
+	file = CreateFileA(filename, 0x80000000 /* GENERIC_READ */, 1 /* FILE_SHARE_READ */, NULL, 3 /* OPEN_EXISTING */, 0x08000000 /* FILE_FLAG_SEQUENTIAL_SCAN */, NULL);
+#endif
+	if (file == (void *)(stbi__win32_size_t)-1 /* INVALID_HANDLE_VALUE */) return 0;
+	size_low = GetFileSize(file, &size_high);
+	if (size_high != 0 || size_low == 0 || size_low > INT_MAX) {
+		CloseHandle(file);
+		return 0;
+	}
+	mapping = CreateFileMappingA(file, NULL, 2 /* PAGE_READONLY */, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping) return 0;
+	*data = MapViewOfFile(mapping, 4 /* FILE_MAP_READ */, 0, 0, 0);
+	CloseHandle(mapping); // the view keeps the mapping alive
+	if (!*data) return 0;
+	*len = size_low;
+	return 1;
+#else
+	struct stat st;
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return 0;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > INT_MAX) {
+		close(fd);
+		return 0;
+	}
+	*data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file alive
+	if (*data == MAP_FAILED) return 0;
+	*len = (size_t)st.st_size;
+	return 1;
+#endif
+}
+
+static void stbi__mmap_close(void *data, size_t len)
+{
+#ifdef _WIN32
+	STBI_NOTUSED(len);
+	UnmapViewOfFile(data);
+#else
+	munmap(data, len);
+#endif
+}
+#endif // STBI__MMAP
+
+STBIDEF stbi_uc *stbi_load_mmap(char const *filename, int *x, int *y, int *comp, int req_comp)
+{
+#ifdef STBI__MMAP
+	void *data;
+	size_t len;
+	if (stbi__mmap_open(filename, &data, &len)) {
+		unsigned char *result;
+		stbi__context s;
+		stbi__start_mem(&s, (stbi_uc *)data, (int)len);
+		result = stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+		stbi__mmap_close(data, len);
+		return result;
+	}
+#endif
+	return stbi_load(filename, x, y, comp, req_comp);
+}
+
 STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
 {
 	unsigned char *result;
@@ -1295,6 +1831,112 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
 	return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
 }
 
+STBIDEF void stbi_load_options_init(stbi_load_options *opts)
+{
+	opts->desired_channels = 0;
+	opts->flip_vertically = stbi__vertically_flip_on_load;
+	opts->unpremultiply = stbi__unpremultiply_on_load;
+	opts->convert_iphone = stbi__de_iphone_flag;
+	opts->jpeg_threads = 1;
+	opts->parallel_for = NULL;
+	opts->parallel_user = NULL;
+}
+
+// copy per-call settings into a freshly started context; returns req_comp
+static int stbi__apply_options(stbi__context *s, stbi_load_options const *opts)
+{
+	if (opts == NULL) return 0;
+	s->flip_vertically = opts->flip_vertically != 0;
+	s->unpremultiply = opts->unpremultiply;
+	s->de_iphone = opts->convert_iphone;
+	s->jpeg_threads = opts->jpeg_threads;
+	s->parallel_for = opts->parallel_for;
+	s->parallel_user = opts->parallel_user;
+	return opts->desired_channels;
+}
+
+STBIDEF stbi_uc *stbi_load_from_memory_opts(stbi_uc const *buffer, int len, int *x, int *y, int *comp, stbi_load_options const *opts)
+{
+	stbi__context s;
+	int req_comp;
+	stbi__start_mem(&s, buffer, len);
+	req_comp = stbi__apply_options(&s, opts);
+	return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_from_callbacks_opts(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, stbi_load_options const *opts)
+{
+	stbi__context s;
+	int req_comp;
+	stbi__start_callbacks(&s, (stbi_io_callbacks *)clbk, user);
+	req_comp = stbi__apply_options(&s, opts);
+	return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+}
+
+STBIDEF stbi_us *stbi_load_16_from_memory_opts(stbi_uc const *buffer, int len, int *x, int *y, int *comp, stbi_load_options const *opts)
+{
+	stbi__context s;
+	int req_comp;
+	stbi__start_mem(&s, buffer, len);
+	req_comp = stbi__apply_options(&s, opts);
+	return stbi__load_and_postprocess_16bit(&s, x, y, comp, req_comp);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_from_file_opts(FILE *f, int *x, int *y, int *comp, stbi_load_options const *opts)
+{
+	unsigned char *result;
+	stbi__context s;
+	int req_comp;
+	stbi__start_file(&s, f);
+	req_comp = stbi__apply_options(&s, opts);
+	result = stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+	if (result) {
+		// need to 'unget' all the characters in the IO buffer
+		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+	}
+	return result;
+}
+
+STBIDEF stbi_uc *stbi_load_opts(char const *filename, int *x, int *y, int *comp, stbi_load_options const *opts)
+{
+	FILE *f = stbi__fopen(filename, "rb");
+	unsigned char *result;
+	if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+	result = stbi_load_from_file_opts(f, x, y, comp, opts);
+	fclose(f);
+	return result;
+}
+
+STBIDEF stbi_uc *stbi_load_mmap_opts(char const *filename, int *x, int *y, int *comp, stbi_load_options const *opts)
+{
+#ifdef STBI__MMAP
+	void *data;
+	size_t len;
+	if (stbi__mmap_open(filename, &data, &len)) {
+		unsigned char *result = stbi_load_from_memory_opts((stbi_uc *)data, (int)len, x, y, comp, opts);
+		stbi__mmap_close(data, len);
+		return result;
+	}
+#endif
+	return stbi_load_opts(filename, x, y, comp, opts);
+}
+
+STBIDEF stbi_us *stbi_load_16_opts(char const *filename, int *x, int *y, int *comp, stbi_load_options const *opts)
+{
+	FILE *f = stbi__fopen(filename, "rb");
+	stbi__uint16 *result;
+	stbi__context s;
+	int req_comp;
+	if (!f) return (stbi_us *)stbi__errpuc("can't fopen", "Unable to open file");
+	stbi__start_file(&s, f);
+	req_comp = stbi__apply_options(&s, opts);
+	result = stbi__load_and_postprocess_16bit(&s, x, y, comp, req_comp);
+	fclose(f);
+	return result;
+}
+#endif // !STBI_NO_STDIO
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -1303,7 +1945,7 @@ STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int *
 	stbi__start_mem(&s, buffer, len);
 
 	result = (unsigned char*)stbi__load_gif_main(&s, delays, x, y, z, comp, req_comp);
-	if (stbi__vertically_flip_on_load) {
+	if (s.flip_vertically) {
 		stbi__vertical_flip_slices(result, *x, *y, *z, *comp);
 	}
 
@@ -1320,7 +1962,7 @@ static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int
 		stbi__result_info ri;
 		float *hdr_data = stbi__hdr_load(s, x, y, comp, req_comp, &ri);
 		if (hdr_data)
-			stbi__float_postprocess(hdr_data, x, y, comp, req_comp);
+			stbi__float_postprocess(s, hdr_data, x, y, comp, req_comp);
 		return hdr_data;
 	}
 #endif
@@ -1580,23 +2222,14 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 	return (stbi_uc)(((r * 77) + (g * 150) + (29 * b)) >> 8);
 }
 
-static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+// convert x*y pixels from img_n to req_comp components; the two buffers must not overlap
+static void stbi__convert_pixels(unsigned char *src_rows, int img_n, unsigned char *dest_rows, int req_comp, unsigned int x, unsigned int y)
 {
 	int i, j;
-	unsigned char *good;
-
-	if (req_comp == img_n) return data;
-	STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
-
-	good = (unsigned char *)stbi__malloc_mad3(req_comp, x, y, 0);
-	if (good == NULL) {
-		STBI_FREE(data);
-		return stbi__errpuc("outofmem", "Out of memory");
-	}
 
 	for (j = 0; j < (int)y; ++j) {
-		unsigned char *src = data + j * x * img_n;
-		unsigned char *dest = good + j * x * req_comp;
+		unsigned char *src = src_rows + j * x * img_n;
+		unsigned char *dest = dest_rows + j * x * req_comp;
 
 #define STBI__COMBO(a,b)  ((a)*8+(b))
 #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
@@ -1619,8 +2252,23 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
 		}
 #undef STBI__CASE
 	}
+}
+
+static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+	unsigned char *good;
+
+	if (req_comp == img_n) return data;
+	STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
 
-	STBI_FREE(data);
+	good = (unsigned char *)stbi__malloc_pixels_mad3(req_comp, 8, req_comp, x, y, 0);
+	if (good == NULL) {
+		stbi__free(data);
+		return stbi__errpuc("outofmem", "Out of memory");
+	}
+
+	stbi__convert_pixels(data, img_n, good, req_comp, x, y);
+	stbi__free(data);
 	return good;
 }
 
@@ -1629,23 +2277,14 @@ static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
 	return (stbi__uint16)(((r * 77) + (g * 150) + (29 * b)) >> 8);
 }
 
-static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+// convert x*y pixels from img_n to req_comp components; the two buffers must not overlap
+static void stbi__convert_pixels16(stbi__uint16 *src_rows, int img_n, stbi__uint16 *dest_rows, int req_comp, unsigned int x, unsigned int y)
 {
 	int i, j;
-	stbi__uint16 *good;
-
-	if (req_comp == img_n) return data;
-	STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
-
-	good = (stbi__uint16 *)stbi__malloc(req_comp * x * y * 2);
-	if (good == NULL) {
-		STBI_FREE(data);
-		return (stbi__uint16 *)stbi__errpuc("outofmem", "Out of memory");
-	}
 
 	for (j = 0; j < (int)y; ++j) {
-		stbi__uint16 *src = data + j * x * img_n;
-		stbi__uint16 *dest = good + j * x * req_comp;
+		stbi__uint16 *src = src_rows + j * x * img_n;
+		stbi__uint16 *dest = dest_rows + j * x * req_comp;
 
 #define STBI__COMBO(a,b)  ((a)*8+(b))
 #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
@@ -1668,8 +2307,23 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
 		}
 #undef STBI__CASE
 	}
+}
+
+static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+	stbi__uint16 *good;
+
+	if (req_comp == img_n) return data;
+	STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
+
+	good = (stbi__uint16 *)stbi__malloc_pixels(req_comp, 16, req_comp * x * y * 2);
+	if (good == NULL) {
+		stbi__free(data);
+		return (stbi__uint16 *)stbi__errpuc("outofmem", "Out of memory");
+	}
 
-	STBI_FREE(data);
+	stbi__convert_pixels16(data, img_n, good, req_comp, x, y);
+	stbi__free(data);
 	return good;
 }
 
@@ -1680,7 +2334,7 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 	float *output;
 	if (!data) return NULL;
 	output = (float *)stbi__malloc_mad4(x, y, comp, sizeof(float), 0);
-	if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
+	if (output == NULL) { stbi__free(data); return stbi__errpf("outofmem", "Out of memory"); }
 	// compute number of non-alpha components
 	if (comp & 1) n = comp; else n = comp - 1;
 	for (i = 0; i < x*y; ++i) {
@@ -1693,7 +2347,7 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 			output[i*comp + n] = data[i*comp + n] / 255.0f;
 		}
 	}
-	STBI_FREE(data);
+	stbi__free(data);
 	return output;
 }
 #endif
@@ -1705,8 +2359,8 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 	int i, k, n;
 	stbi_uc *output;
 	if (!data) return NULL;
-	output = (stbi_uc *)stbi__malloc_mad3(x, y, comp, 0);
-	if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
+	output = (stbi_uc *)stbi__malloc_pixels_mad3(comp, 8, x, y, comp, 0);
+	if (output == NULL) { stbi__free(data); return stbi__errpuc("outofmem", "Out of memory"); }
 	// compute number of non-alpha components
 	if (comp & 1) n = comp; else n = comp - 1;
 	for (i = 0; i < x*y; ++i) {
@@ -1723,7 +2377,7 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 			output[i*comp + k] = (stbi_uc)stbi__float2int(z);
 		}
 	}
-	STBI_FREE(data);
+	stbi__free(data);
 	return output;
 }
 #endif
@@ -1813,8 +2467,11 @@ typedef struct
 	int scan_n, order[4];
 	int restart_interval, todo;
 
+	stbi_uc *scan_buffer; // entropy-coded data read ahead from callbacks for threaded decode
+
 	// kernels
 	void(*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
+	void(*idct_block2_kernel)(stbi_uc *out_a, int stride_a, short *data_a, stbi_uc *out_b, int stride_b, short *data_b); // NULL if unavailable
 	void(*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
 	stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
 } stbi__jpeg;
@@ -2520,6 +3177,190 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 integer IDCT of two blocks at once. this is the sse2 version with
+// block a in the low 128-bit lane and block b in the high lane; every op it
+// uses works within lanes, so it is bit-identical to the sse2 and C versions.
+STBI__AVX2_TARGET
+static void stbi__idct2_avx2(stbi_uc *out_a, int stride_a, short *data_a, stbi_uc *out_b, int stride_b, short *data_b)
+{
+	__m256i row0, row1, row2, row3, row4, row5, row6, row7;
+	__m256i tmp;
+
+#define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+#define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+#define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+#define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+#define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+#define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+#define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+#define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+#define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+	// row r of block a in the low lane, row r of block b in the high lane
+#define dct_load(r) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128((const __m128i *) (data_a + (r) * 8))), \
+                              _mm_load_si128((const __m128i *) (data_b + (r) * 8)), 1)
+
+	// two output rows are packed in each lane, low half first
+#define dct_store(p) \
+      { \
+         __m128i pa = _mm256_castsi256_si128(p); \
+         __m128i pb = _mm256_extracti128_si256(p, 1); \
+         _mm_storel_epi64((__m128i *) out_a, pa); out_a += stride_a; \
+         _mm_storel_epi64((__m128i *) out_a, _mm_shuffle_epi32(pa, 0x4e)); out_a += stride_a; \
+         _mm_storel_epi64((__m128i *) out_b, pb); out_b += stride_b; \
+         _mm_storel_epi64((__m128i *) out_b, _mm_shuffle_epi32(pb, 0x4e)); out_b += stride_b; \
+      }
+
+	__m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+	__m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f(0.765366865f), stbi__f2f(0.5411961f));
+	__m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+	__m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+	__m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f(0.298631336f), stbi__f2f(-1.961570560f));
+	__m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f(3.072711026f));
+	__m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f(2.053119869f), stbi__f2f(-0.390180644f));
+	__m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f(1.501321110f));
+
+	// rounding biases in column/row passes, see stbi__idct_block for explanation.
+	__m256i bias_0 = _mm256_set1_epi32(512);
+	__m256i bias_1 = _mm256_set1_epi32(65536 + (128 << 17));
+
+	// load
+	row0 = dct_load(0);
+	row1 = dct_load(1);
+	row2 = dct_load(2);
+	row3 = dct_load(3);
+	row4 = dct_load(4);
+	row5 = dct_load(5);
+	row6 = dct_load(6);
+	row7 = dct_load(7);
+
+	// column pass
+	dct_pass(bias_0, 10);
+
+	{
+		// 16bit 8x8 transpose, per lane
+		dct_interleave16(row0, row4);
+		dct_interleave16(row1, row5);
+		dct_interleave16(row2, row6);
+		dct_interleave16(row3, row7);
+
+		dct_interleave16(row0, row2);
+		dct_interleave16(row1, row3);
+		dct_interleave16(row4, row6);
+		dct_interleave16(row5, row7);
+
+		dct_interleave16(row0, row1);
+		dct_interleave16(row2, row3);
+		dct_interleave16(row4, row5);
+		dct_interleave16(row6, row7);
+	}
+
+	// row pass
+	dct_pass(bias_1, 17);
+
+	{
+		// pack
+		__m256i p0 = _mm256_packus_epi16(row0, row1);
+		__m256i p1 = _mm256_packus_epi16(row2, row3);
+		__m256i p2 = _mm256_packus_epi16(row4, row5);
+		__m256i p3 = _mm256_packus_epi16(row6, row7);
+
+		// 8bit 8x8 transpose, per lane
+		dct_interleave8(p0, p2);
+		dct_interleave8(p1, p3);
+
+		dct_interleave8(p0, p1);
+		dct_interleave8(p2, p3);
+
+		dct_interleave8(p0, p2);
+		dct_interleave8(p1, p3);
+
+		// store
+		dct_store(p0);
+		dct_store(p2);
+		dct_store(p1);
+		dct_store(p3);
+	}
+
+	_mm256_zeroupper();
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+#undef dct_store
+}
+
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2762,68 +3603,249 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
 	// since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+// decoded blocks waiting for the IDCT. when there is a kernel that does two
+// blocks at once, the first block of each pair is held back until the second
+// one has been decoded
+typedef struct
 {
-	stbi__jpeg_reset(z);
-	if (!z->progressive) {
+	STBI_SIMD_ALIGN(short, data[2][64]);
+	short *next;     // where to decode the next block
+	stbi_uc *held;   // output for the held block, NULL if none
+	int held_stride;
+} stbi__jpeg_idct_queue;
+
+static void stbi__jpeg_idct_push(stbi__jpeg *z, stbi__jpeg_idct_queue *q, stbi_uc *out, int out_stride)
+{
+	if (!z->idct_block2_kernel) {
+		z->idct_block_kernel(out, out_stride, q->next);
+	}
+	else if (q->held) {
+		z->idct_block2_kernel(q->held, q->held_stride, q->data[0], out, out_stride, q->data[1]);
+		q->held = NULL;
+		q->next = q->data[0];
+	}
+	else {
+		q->held = out;
+		q->held_stride = out_stride;
+		q->next = q->data[1];
+	}
+}
+
+static void stbi__jpeg_idct_flush(stbi__jpeg *z, stbi__jpeg_idct_queue *q)
+{
+	if (q->held) {
+		z->idct_block_kernel(q->held, q->held_stride, q->data[0]);
+		q->held = NULL;
+		q->next = q->data[0];
+	}
+}
+
+// decode baseline MCUs [mcu, mcu_end) of the current scan in scanline order;
+// for non-interleaved scans every block is an MCU
+static int stbi__jpeg_decode_baseline(stbi__jpeg *z, int mcu, int mcu_end)
+{
+	stbi__jpeg_idct_queue q;
+	int n = z->order[0];
+	int w = z->scan_n == 1 ? (z->img_comp[n].x + 7) >> 3 : z->img_mcu_x;
+	int i = mcu % w, j = mcu / w;
+	q.next = q.data[0];
+	q.held = NULL;
+	for (; mcu < mcu_end; ++mcu) {
 		if (z->scan_n == 1) {
-			int i, j;
-			STBI_SIMD_ALIGN(short, data[64]);
-			int n = z->order[0];
-			// non-interleaved data, we just need to process one block at a time,
-			// in trivial scanline order
-			// number of blocks to do just depends on how many actual "pixels" this
-			// component has, independent of interleaved MCU blocking and such
-			int w = (z->img_comp[n].x + 7) >> 3;
-			int h = (z->img_comp[n].y + 7) >> 3;
-			for (j = 0; j < h; ++j) {
-				for (i = 0; i < w; ++i) {
-					int ha = z->img_comp[n].ha;
-					if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-					z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2, data);
-					// every data block is an MCU, so countdown the restart interval
-					if (--z->todo <= 0) {
-						if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-						// if it's NOT a restart, then just bail, so we get corrupt data
-						// rather than no data
-						if (!STBI__RESTART(z->marker)) return 1;
-						stbi__jpeg_reset(z);
-					}
-				}
-			}
-			return 1;
+			int ha = z->img_comp[n].ha;
+			if (!stbi__jpeg_decode_block(z, q.next, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+			stbi__jpeg_idct_push(z, &q, z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2);
 		}
 		else { // interleaved
-			int i, j, k, x, y;
-			STBI_SIMD_ALIGN(short, data[64]);
-			for (j = 0; j < z->img_mcu_y; ++j) {
-				for (i = 0; i < z->img_mcu_x; ++i) {
-					// scan an interleaved mcu... process scan_n components in order
-					for (k = 0; k < z->scan_n; ++k) {
-						int n = z->order[k];
-						// scan out an mcu's worth of this component; that's just determined
-						// by the basic H and V specified for the component
-						for (y = 0; y < z->img_comp[n].v; ++y) {
-							for (x = 0; x < z->img_comp[n].h; ++x) {
-								int x2 = (i*z->img_comp[n].h + x) * 8;
-								int y2 = (j*z->img_comp[n].v + y) * 8;
-								int ha = z->img_comp[n].ha;
-								if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-								z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*y2 + x2, z->img_comp[n].w2, data);
-							}
-						}
-					}
-					// after all interleaved components, that's an interleaved MCU,
-					// so now count down the restart interval
-					if (--z->todo <= 0) {
-						if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-						if (!STBI__RESTART(z->marker)) return 1;
-						stbi__jpeg_reset(z);
+			int k, x, y;
+			// scan an interleaved mcu... process scan_n components in order
+			for (k = 0; k < z->scan_n; ++k) {
+				int c = z->order[k];
+				// scan out an mcu's worth of this component; that's just determined
+				// by the basic H and V specified for the component
+				for (y = 0; y < z->img_comp[c].v; ++y) {
+					for (x = 0; x < z->img_comp[c].h; ++x) {
+						int x2 = (i*z->img_comp[c].h + x) * 8;
+						int y2 = (j*z->img_comp[c].v + y) * 8;
+						int ha = z->img_comp[c].ha;
+						if (!stbi__jpeg_decode_block(z, q.next, z->huff_dc + z->img_comp[c].hd, z->huff_ac + ha, z->fast_ac[ha], c, z->dequant[z->img_comp[c].tq])) return 0;
+						stbi__jpeg_idct_push(z, &q, z->img_comp[c].data + z->img_comp[c].w2*y2 + x2, z->img_comp[c].w2);
 					}
 				}
 			}
-			return 1;
 		}
+		// count down the restart interval
+		if (--z->todo <= 0) {
+			if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+			// if it's NOT a restart, then just bail, so we get corrupt data
+			// rather than no data
+			if (!STBI__RESTART(z->marker)) break;
+			stbi__jpeg_reset(z);
+		}
+		if (++i == w) { i = 0; ++j; }
+	}
+	stbi__jpeg_idct_flush(z, &q);
+	return 1;
+}
+
+#ifndef STBI_NO_THREADS
+// Restart intervals are independent: each one starts from a reset decoder at
+// the byte after an RST marker. So we find the RST markers up front, give each
+// task a private copy of the decoder with a memory context over its
+// intervals, run the tasks through the caller's parallel_for, and decode the
+// last interval in place on the real stream so the decoder and stream end up
+// exactly where the serial loop would leave them.
+
+#define STBI__JPEG_PARALLEL_MIN_MCUS  256 // below this, handing out tasks costs more than it saves
+#define STBI__JPEG_MAX_TASKS          64
+
+typedef struct
+{
+	stbi__jpeg *z;
+	stbi_uc *base;
+	int *seg;        // interval k is base[seg[k] .. seg[k+1]), ending just past its RST marker
+	int first, last; // intervals [first,last) decoded by this worker
+	int ok;
+} stbi__jpeg_worker;
+
+static void stbi__jpeg_decode_intervals(stbi__jpeg_worker *w)
+{
+	stbi__context s;
+	// straight from the heap: without TLS the arena would be shared between tasks
+	stbi__jpeg *j = (stbi__jpeg *)STBI_MALLOC(sizeof(stbi__jpeg));
+	int k, ri = w->z->restart_interval;
+	w->ok = 0;
+	if (!j) return;
+	memcpy(j, w->z, sizeof(*j));
+	j->s = &s;
+	for (k = w->first; k < w->last; ++k) {
+		stbi__start_mem(&s, w->base + w->seg[k], w->seg[k + 1] - w->seg[k]);
+		stbi__jpeg_reset(j);
+		if (!stbi__jpeg_decode_baseline(j, k * ri, (k + 1) * ri)) break;
+		// a well-formed interval ends on its RST marker, which resets the decoder
+		if (j->todo <= 0) break;
+	}
+	w->ok = (k == w->last);
+	STBI_FREE(j);
+}
+
+static void stbi__jpeg_task(void *arg, int index)
+{
+	stbi__jpeg_decode_intervals((stbi__jpeg_worker *)arg + index);
+}
+
+// scan buf[*pos..len) for RST markers, storing the offset just past each one
+// in seg[1..count]. returns 1 once all are found, 0 if some other marker comes
+// first, and -1 if it needs more data (resume from *pos)
+static int stbi__jpeg_find_restarts(stbi_uc const *buf, int len, int *pos, int *seg, int *found, int count)
+{
+	int i = *pos;
+	while (*found < count) {
+		stbi_uc const *p = (stbi_uc const *)memchr(buf + i, 0xff, len - i);
+		int m;
+		if (!p) { *pos = len; return -1; }
+		i = (int)(p - buf);
+		m = i + 1;
+		while (m < len && buf[m] == 0xff) ++m; // fill bytes
+		if (m >= len) { *pos = i; return -1; }
+		if (buf[m] == 0) { i = m + 1; continue; } // stuffed 0xff
+		if (!STBI__RESTART(buf[m])) return 0;
+		seg[++*found] = i = m + 1;
+	}
+	*pos = i;
+	return 1;
+}
+
+// returns -1 if the scan should be decoded serially instead
+static int stbi__jpeg_decode_baseline_threaded(stbi__jpeg *z, int total)
+{
+	stbi__context *s = z->s;
+	stbi__jpeg_worker workers[STBI__JPEG_MAX_TASKS];
+	int intervals = (total + z->restart_interval - 1) / z->restart_interval;
+	int ntasks = s->jpeg_threads, found = 0, pos = 0, r, t, len;
+	stbi_uc *base = s->img_buffer;
+	int *seg;
+
+	if (ntasks > STBI__JPEG_MAX_TASKS) ntasks = STBI__JPEG_MAX_TASKS;
+	if (ntasks > intervals - 1) ntasks = intervals - 1;
+	if (ntasks < 2 || !s->parallel_for || total < STBI__JPEG_PARALLEL_MIN_MCUS) return -1;
+	if ((size_t)intervals > INT_MAX / sizeof(int)) return -1;
+	seg = (int *)stbi__malloc(sizeof(int) * intervals);
+	if (!seg) return -1;
+	seg[0] = 0;
+
+	len = (int)(s->img_buffer_end - s->img_buffer);
+	if (s->read_from_callbacks) {
+		// read the scan into memory and push it back in front of the stream,
+		// so a serial fallback sees exactly the same bytes
+		int cap = len > 65536 ? len : 65536;
+		stbi_uc *buf = (stbi_uc *)stbi__malloc(cap);
+		if (!buf) { stbi__free(seg); return -1; }
+		memcpy(buf, s->img_buffer, len);
+		while ((r = stbi__jpeg_find_restarts(buf, len, &pos, seg, &found, intervals - 1)) < 0) {
+			int n;
+			if (len == cap) {
+				stbi_uc *grown = cap <= INT_MAX / 2 ? (stbi_uc *)stbi__realloc_sized(buf, cap, cap * 2) : NULL;
+				if (!grown) break;
+				buf = grown;
+				cap *= 2;
+			}
+			n = (s->io.read)(s->io_user_data, (char *)buf + len, cap - len);
+			if (n <= 0) break;
+			len += n;
+		}
+		if (z->scan_buffer) stbi__free(z->scan_buffer);
+		z->scan_buffer = base = buf;
+		s->img_buffer = buf;
+		s->img_buffer_end = buf + len;
+	}
+	else {
+		r = stbi__jpeg_find_restarts(base, len, &pos, seg, &found, intervals - 1);
+	}
+	if (r != 1) { stbi__free(seg); return -1; }
+
+	// split intervals [0, intervals-1) evenly between the tasks
+	for (t = 0; t < ntasks; ++t) {
+		workers[t].z = z;
+		workers[t].base = base;
+		workers[t].seg = seg;
+		workers[t].first = (intervals - 1) * t / ntasks;
+		workers[t].last = (intervals - 1) * (t + 1) / ntasks;
+		workers[t].ok = 0;
+	}
+	s->parallel_for(s->parallel_user, stbi__jpeg_task, workers, ntasks);
+	for (t = 0; t < ntasks; ++t)
+		if (!workers[t].ok) break;
+
+	if (t < ntasks) {
+		// something didn't line up with the markers; rewind and let the serial path deal with it
+		s->img_buffer = base;
+		r = -1;
+	}
+	else {
+		s->img_buffer = base + seg[intervals - 1];
+		stbi__jpeg_reset(z);
+		r = stbi__jpeg_decode_baseline(z, (intervals - 1) * z->restart_interval, total);
+	}
+	stbi__free(seg);
+	return r;
+}
+#endif // !STBI_NO_THREADS
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+{
+	stbi__jpeg_reset(z);
+	if (!z->progressive) {
+		int n = z->order[0];
+		int total = z->scan_n == 1 ? ((z->img_comp[n].x + 7) >> 3) * ((z->img_comp[n].y + 7) >> 3) : z->img_mcu_x * z->img_mcu_y;
+#ifndef STBI_NO_THREADS
+		if (z->restart_interval && z->s->jpeg_threads > 1 && z->s->parallel_for) {
+			int r = stbi__jpeg_decode_baseline_threaded(z, total);
+			if (r >= 0) return r;
+			stbi__jpeg_reset(z);
+		}
+#endif
+		return stbi__jpeg_decode_baseline(z, 0, total);
 	}
 	else {
 		if (z->scan_n == 1) {
@@ -2908,8 +3930,16 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
 			for (j = 0; j < h; ++j) {
 				for (i = 0; i < w; ++i) {
 					short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+					stbi_uc *out = z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8;
 					stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-					z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2, data);
+					if (z->idct_block2_kernel && i + 1 < w) {
+						// neighbouring blocks are adjacent in the coefficient buffer
+						stbi__jpeg_dequantize(data + 64, z->dequant[z->img_comp[n].tq]);
+						z->idct_block2_kernel(out, z->img_comp[n].w2, data, out + 8, z->img_comp[n].w2, data + 64);
+						++i;
+					}
+					else
+						z->idct_block_kernel(out, z->img_comp[n].w2, data);
 				}
 			}
 		}
@@ -3066,17 +4096,17 @@ static int stbi__free_jpeg_components(stbi__jpeg *z, int ncomp, int why)
 	int i;
 	for (i = 0; i < ncomp; ++i) {
 		if (z->img_comp[i].raw_data) {
-			STBI_FREE(z->img_comp[i].raw_data);
+			stbi__free(z->img_comp[i].raw_data);
 			z->img_comp[i].raw_data = NULL;
 			z->img_comp[i].data = NULL;
 		}
 		if (z->img_comp[i].raw_coeff) {
-			STBI_FREE(z->img_comp[i].raw_coeff);
+			stbi__free(z->img_comp[i].raw_coeff);
 			z->img_comp[i].raw_coeff = 0;
 			z->img_comp[i].coeff = 0;
 		}
 		if (z->img_comp[i].linebuf) {
-			STBI_FREE(z->img_comp[i].linebuf);
+			stbi__free(z->img_comp[i].linebuf);
 			z->img_comp[i].linebuf = NULL;
 		}
 	}
@@ -3439,6 +4469,78 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// same filter as stbi__resample_row_hv_2_simd, 16 input pixels at a time
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+	int i = 0, t0, t1;
+
+	if (w == 1) {
+		out[0] = out[1] = stbi__div4(3 * in_near[0] + in_far[0] + 2);
+		return out;
+	}
+
+	t1 = 3 * in_near[0] + in_far[0];
+	for (; i < ((w - 1) & ~15); i += 16) {
+		// vertical pass, 3*x + y = 4*x + (y - x)
+		__m256i farw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+		__m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+		__m256i diff = _mm256_sub_epi16(farw, nearw);
+		__m256i nears = _mm256_slli_epi16(nearw, 2);
+		__m256i curr = _mm256_add_epi16(nears, diff); // current row
+
+		// "prev" is curr shifted right by one pixel with t1 shifted in, "next"
+		// is curr shifted left by one pixel with the first pixel of the next
+		// block shifted in. alignr works per lane, so build the carry vectors
+		// that feed each lane first.
+		__m256i prv_carry = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_insert_epi16(_mm_setzero_si128(), t1, 7)), _mm256_castsi256_si128(curr), 1);
+		__m256i nxt_carry = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_extracti128_si256(curr, 1)), _mm_cvtsi32_si128(3 * in_near[i + 16] + in_far[i + 16]), 1);
+		__m256i prev = _mm256_alignr_epi8(curr, prv_carry, 14);
+		__m256i next = _mm256_alignr_epi8(nxt_carry, curr, 2);
+
+		// horizontal filter, polyphase:
+		// even pixels = 3*cur + prev = cur*4 + (prev - cur)
+		// odd  pixels = 3*cur + next = cur*4 + (next - cur)
+		__m256i bias = _mm256_set1_epi16(8);
+		__m256i curs = _mm256_slli_epi16(curr, 2);
+		__m256i prvd = _mm256_sub_epi16(prev, curr);
+		__m256i nxtd = _mm256_sub_epi16(next, curr);
+		__m256i curb = _mm256_add_epi16(curs, bias);
+		__m256i even = _mm256_add_epi16(prvd, curb);
+		__m256i odd = _mm256_add_epi16(nxtd, curb);
+
+		// interleave even and odd pixels, then undo scaling. each lane packs
+		// its own 8 input pixels, so the 32 output bytes come out in order.
+		__m256i int0 = _mm256_unpacklo_epi16(even, odd);
+		__m256i int1 = _mm256_unpackhi_epi16(even, odd);
+		__m256i de0 = _mm256_srli_epi16(int0, 4);
+		__m256i de1 = _mm256_srli_epi16(int1, 4);
+		_mm256_storeu_si256((__m256i *) (out + i * 2), _mm256_packus_epi16(de0, de1));
+
+		// "previous" value for next iter
+		t1 = 3 * in_near[i + 15] + in_far[i + 15];
+	}
+	_mm256_zeroupper();
+
+	t0 = t1;
+	t1 = 3 * in_near[i] + in_far[i];
+	out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+
+	for (++i; i < w; ++i) {
+		t0 = t1;
+		t1 = 3 * in_near[i] + in_far[i];
+		out[i * 2 - 1] = stbi__div16(3 * t0 + t1 + 8);
+		out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+	}
+	out[w * 2 - 1] = stbi__div4(t1 + 2);
+
+	STBI_NOTUSED(hs);
+
+	return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
 	// resample with nearest-neighbor
@@ -3613,10 +4715,79 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// same math as the sse2 path of stbi__YCbCr_to_RGB_simd, 16 pixels at a time
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+	int i = 0;
+
+	if (step == 4) {
+		__m128i signflip = _mm_set1_epi8(-0x80);
+		__m256i cr_const0 = _mm256_set1_epi16((short)(1.40200f*4096.0f + 0.5f));
+		__m256i cr_const1 = _mm256_set1_epi16(-(short)(0.71414f*4096.0f + 0.5f));
+		__m256i cb_const0 = _mm256_set1_epi16(-(short)(0.34414f*4096.0f + 0.5f));
+		__m256i cb_const1 = _mm256_set1_epi16((short)(1.77200f*4096.0f + 0.5f));
+		__m256i y_bias = _mm256_set1_epi16(128);
+		__m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+		for (; i + 15 < count; i += 16) {
+			// load
+			__m128i y_bytes = _mm_loadu_si128((__m128i *) (y + i));
+			__m128i cr_bytes = _mm_loadu_si128((__m128i *) (pcr + i));
+			__m128i cb_bytes = _mm_loadu_si128((__m128i *) (pcb + i));
+			__m128i cr_biased = _mm_xor_si128(cr_bytes, signflip); // -128
+			__m128i cb_biased = _mm_xor_si128(cb_bytes, signflip); // -128
+
+			// widen to short: y in the high byte over a 128 bias, cr/cb left-shifted by 8
+			__m256i yw = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+			__m256i crw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cr_biased), 8);
+			__m256i cbw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cb_biased), 8);
+
+			// color transform
+			__m256i yws = _mm256_srli_epi16(yw, 4);
+			__m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+			__m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+			__m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+			__m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+			__m256i rws = _mm256_add_epi16(cr0, yws);
+			__m256i gwt = _mm256_add_epi16(cb0, yws);
+			__m256i bws = _mm256_add_epi16(yws, cb1);
+			__m256i gws = _mm256_add_epi16(gwt, cr1);
+
+			// descale
+			__m256i rw = _mm256_srai_epi16(rws, 4);
+			__m256i bw = _mm256_srai_epi16(bws, 4);
+			__m256i gw = _mm256_srai_epi16(gws, 4);
+
+			// back to byte, set up for transpose
+			__m256i brb = _mm256_packus_epi16(rw, bw);
+			__m256i gxb = _mm256_packus_epi16(gw, xw);
+
+			// transpose to interleave channels; lane 0 holds pixels 0-7 and
+			// lane 1 pixels 8-15, so swap the middle quarters on the way out
+			__m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+			__m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+			__m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+			__m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+			// store
+			_mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+			_mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+			out += 64;
+		}
+		_mm256_zeroupper();
+	}
+
+	stbi__YCbCr_to_RGB_simd(out, y + i, pcb + i, pcr + i, count - i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
 	j->idct_block_kernel = stbi__idct_block;
+	j->idct_block2_kernel = NULL;
 	j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
 	j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
@@ -3625,6 +4796,13 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
 		j->idct_block_kernel = stbi__idct_simd;
 		j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
 		j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+#ifdef STBI_AVX2
+		if (stbi__avx2_available()) {
+			j->idct_block2_kernel = stbi__idct2_avx2;
+			j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+			j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+		}
+#endif
 	}
 #endif
 
@@ -3683,6 +4861,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 	{
 		int k;
 		unsigned int i, j;
+		int flip = z->s->flip_vertically;
 		stbi_uc *output;
 		stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
 
@@ -3711,12 +4890,16 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 		}
 
 		// can't error after this so, this is safe
-		output = (stbi_uc *)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+		output = (stbi_uc *)stbi__malloc_pixels_mad3(n, 8, n, z->s->img_x, z->s->img_y, 1);
 		if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-		// now go ahead and resample
+		// now go ahead and resample, writing each row straight to its flipped position
 		for (j = 0; j < z->s->img_y; ++j) {
-			stbi_uc *out = output + n * z->s->img_x * j;
+			stbi_uc *out = output + n * z->s->img_x * (flip ? z->s->img_y - 1 - j : j);
+			// the n==3 converters store a 4th byte just past the row; when flipping,
+			// the row after this one has already been written, so put that byte back
+			stbi_uc *next = (flip && j > 0) ? out + n * z->s->img_x : NULL;
+			stbi_uc keep = next ? *next : 0;
 			for (k = 0; k < decode_n; ++k) {
 				stbi__resample *r = &res_comp[k];
 				int y_bot = r->ystep >= (r->vs >> 1);
@@ -3817,6 +5000,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 						for (i = 0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
 				}
 			}
+			if (next) *next = keep;
 		}
 		stbi__cleanup_jpeg(z);
 		*out_x = z->s->img_x;
@@ -3830,11 +5014,13 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
 {
 	unsigned char* result;
 	stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
-	STBI_NOTUSED(ri);
 	j->s = s;
+	j->scan_buffer = NULL;
 	stbi__setup_jpeg(j);
 	result = load_jpeg_image(j, x, y, comp, req_comp);
-	STBI_FREE(j);
+	ri->flipped = s->flip_vertically;
+	if (j->scan_buffer) stbi__free(j->scan_buffer);
+	stbi__free(j);
 	return result;
 }
 
@@ -3846,7 +5032,7 @@ static int stbi__jpeg_test(stbi__context *s)
 	stbi__setup_jpeg(j);
 	r = stbi__decode_jpeg_header(j, STBI__SCAN_type);
 	stbi__rewind(s);
-	STBI_FREE(j);
+	stbi__free(j);
 	return r;
 }
 
@@ -3868,7 +5054,7 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 	stbi__jpeg* j = (stbi__jpeg*)(stbi__malloc(sizeof(stbi__jpeg)));
 	j->s = s;
 	result = stbi__jpeg_info_raw(j, x, y, comp);
-	STBI_FREE(j);
+	stbi__free(j);
 	return result;
 }
 #endif
@@ -3879,6 +5065,9 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
 //      - fast huffman
+//      - away from the ends of the buffers, a 64-bit bit buffer, a combined
+//        literal/length table that returns two literals at once, and
+//        8-byte match copies
 
 #ifndef STBI_NO_ZLIB
 
@@ -3886,6 +5075,12 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
+// literal/length table used by the fast inner loop; see stbi__zbuild_fastlit
+#define STBI__ZLIT_BITS   10
+#define STBI__ZLIT_MASK   ((1 << STBI__ZLIT_BITS) - 1)
+#define STBI__ZLIT_LITERAL  0x20 // entry holds one literal in bits 8..15
+#define STBI__ZLIT_PAIR     0x40 // ...and a second one in bits 16..23
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -3968,7 +5163,7 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
 //    we require PNG read all the IDATs and combine them into a single
 //    memory buffer
 
-typedef struct
+typedef struct stbi__zbuf
 {
 	stbi_uc *zbuffer, *zbuffer_end;
 	int num_bits;
@@ -3979,7 +5174,13 @@ typedef struct
 	char *zout_end;
 	int   z_expandable;
 
+	// if set, called instead of growing zout when it is full; it may consume
+	// and discard output, but must keep the last 32k for back-references
+	int(*zflush)(struct stbi__zbuf *z, int n);
+	void *zflush_user;
+
 	stbi__zhuffman z_length, z_distance;
+	stbi__uint32 zfast_lit[1 << STBI__ZLIT_BITS];
 } stbi__zbuf;
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
@@ -4007,12 +5208,14 @@ stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
 	return k;
 }
 
-static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+// decode the symbol at the bottom of 'bits' without consuming it; returns
+// the symbol and its code size in *size, or -1 for an invalid code
+static int stbi__zhuffman_peek_slow(stbi__zhuffman *z, unsigned int bits, int *size)
 {
 	int b, s, k;
 	// not resolved by fast table, so compute it the slow way
 	// use jpeg approach, which requires MSbits at top
-	k = stbi__bit_reverse(a->code_buffer, 16);
+	k = stbi__bit_reverse(bits & 0xffff, 16);
 	for (s = STBI__ZFAST_BITS + 1; ; ++s)
 		if (k < z->maxcode[s])
 			break;
@@ -4020,9 +5223,17 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
 	// code size is s, so:
 	b = (k >> (16 - s)) - z->firstcode[s] + z->firstsymbol[s];
 	STBI_ASSERT(z->size[b] == s);
+	*size = s;
+	return z->value[b];
+}
+
+static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+{
+	int s, v = stbi__zhuffman_peek_slow(z, a->code_buffer, &s);
+	if (v < 0) return -1;
 	a->code_buffer >>= s;
 	a->num_bits -= s;
-	return z->value[b];
+	return v;
 }
 
 stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
@@ -4044,12 +5255,13 @@ static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room
 	char *q;
 	int cur, limit, old_limit;
 	z->zout = zout;
+	if (z->zflush) return z->zflush(z, n);
 	if (!z->z_expandable) return stbi__err("output buffer limit", "Corrupt PNG");
 	cur = (int)(z->zout - z->zout_start);
 	limit = old_limit = (int)(z->zout_end - z->zout_start);
 	while (cur + n > limit)
 		limit *= 2;
-	q = (char *)STBI_REALLOC_SIZED(z->zout_start, old_limit, limit);
+	q = (char *)stbi__realloc_sized(z->zout_start, old_limit, limit);
 	STBI_NOTUSED(old_limit);
 	if (q == NULL) return stbi__err("outofmem", "Out of memory");
 	z->zout_start = q;
@@ -4072,11 +5284,175 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
 
+#ifndef STBI_NO_ZLIB_FAST
+// fill the literal/length table from z_length: every STBI__ZLIT_BITS-bit
+// input maps to the code size and symbol of the code it starts with, and
+// if that is a literal that leaves room for a second literal code, to both
+// literals. codes longer than STBI__ZLIT_BITS (and invalid codes) get 0
+static void stbi__zbuild_fastlit(stbi__zbuf *a)
+{
+	stbi__zhuffman *z = &a->z_length;
+	int i;
+	for (i = 0; i < (1 << STBI__ZLIT_BITS); ++i) {
+		int s, v, s2, v2;
+		int f = z->fast[i & STBI__ZFAST_MASK];
+		if (f) {
+			s = f >> 9;
+			v = f & 511;
+		}
+		else {
+			v = stbi__zhuffman_peek_slow(z, i, &s);
+			if (v < 0 || s > STBI__ZLIT_BITS) {
+				a->zfast_lit[i] = 0;
+				continue;
+			}
+		}
+		if (v >= 256) {
+			a->zfast_lit[i] = (stbi__uint32)(s | (v << 16));
+			continue;
+		}
+		a->zfast_lit[i] = (stbi__uint32)(s | STBI__ZLIT_LITERAL | (v << 8));
+		f = z->fast[(i >> s) & STBI__ZFAST_MASK];
+		if (f) {
+			s2 = f >> 9;
+			v2 = f & 511;
+			if (s + s2 <= STBI__ZLIT_BITS && v2 < 256)
+				a->zfast_lit[i] = (stbi__uint32)((s + s2) | STBI__ZLIT_LITERAL | STBI__ZLIT_PAIR | (v << 8) | (v2 << 16));
+		}
+	}
+}
+
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+#if defined(STBI__X64_TARGET) || defined(STBI__X86_TARGET) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	stbi__uint64 v;
+	memcpy(&v, p, 8);
+	return v;
+#else
+	return (stbi__uint64)p[0] | ((stbi__uint64)p[1] << 8) | ((stbi__uint64)p[2] << 16) | ((stbi__uint64)p[3] << 24)
+		| ((stbi__uint64)p[4] << 32) | ((stbi__uint64)p[5] << 40) | ((stbi__uint64)p[6] << 48) | ((stbi__uint64)p[7] << 56);
+#endif
+}
+
+#define STBI__ZFAST_IN   8         // bytes read by one refill
+#define STBI__ZFAST_OUT  (258 + 8) // longest match, plus overrun of the 8-byte copy
+
+// inner loop for the bulk of a huffman block. it stops as soon as a refill
+// could read past the input or a match could run past the output, and
+// returns -1 so the byte-at-a-time loop can take over; otherwise it returns
+// 1 at the end of the block, 0 on error.
+// all bits above num_bits in 'bits' are either 0 or the following stream
+// bits, so refilling can OR a whole 8-byte word in at any time
+static int stbi__parse_huffman_fast(stbi__zbuf *a)
+{
+	stbi__uint64 bits = a->code_buffer;
+	int nbits = a->num_bits, result = -1;
+	stbi_uc *in = a->zbuffer;
+	char *zout = a->zout;
+	while (a->zbuffer_end - in >= STBI__ZFAST_IN && a->zout_end - zout >= STBI__ZFAST_OUT) {
+		stbi__uint32 e;
+		int z, s, len, dist;
+		stbi_uc *p;
+
+		bits |= stbi__zload64(in) << nbits;
+		in += (63 - nbits) >> 3;
+		nbits |= 56; // 56..63 bits available, enough for one length/distance pair
+
+		e = a->zfast_lit[bits & STBI__ZLIT_MASK];
+		if (e & STBI__ZLIT_LITERAL) {
+			s = e & 31;
+			bits >>= s;
+			nbits -= s;
+			zout[0] = (char)(e >> 8);
+			zout[1] = (char)(e >> 16);
+			zout += (e & STBI__ZLIT_PAIR) ? 2 : 1;
+			continue;
+		}
+		if (e) {
+			s = e & 31;
+			z = (int)(e >> 16);
+		}
+		else {
+			z = stbi__zhuffman_peek_slow(&a->z_length, (unsigned int)bits, &s);
+			if (z < 0) { result = stbi__err("bad huffman code", "Corrupt PNG"); break; }
+		}
+		bits >>= s;
+		nbits -= s;
+		if (z < 256) {
+			*zout++ = (char)z;
+			continue;
+		}
+		if (z == 256) {
+			result = 1;
+			break;
+		}
+		// per DEFLATE, length codes 286 and 287 must not appear in compressed data
+		if (z >= 286) { result = stbi__err("bad huffman code", "Corrupt PNG"); break; }
+		z -= 257;
+		len = stbi__zlength_base[z] + (int)(bits & ((1 << stbi__zlength_extra[z]) - 1));
+		bits >>= stbi__zlength_extra[z];
+		nbits -= stbi__zlength_extra[z];
+
+		z = a->z_distance.fast[bits & STBI__ZFAST_MASK];
+		if (z) {
+			s = z >> 9;
+			z &= 511;
+		}
+		else {
+			z = stbi__zhuffman_peek_slow(&a->z_distance, (unsigned int)bits, &s);
+		}
+		// nor can distance codes 30 and 31
+		if (z < 0 || z >= 30) { result = stbi__err("bad huffman code", "Corrupt PNG"); break; }
+		bits >>= s;
+		nbits -= s;
+		dist = stbi__zdist_base[z] + (int)(bits & ((1 << stbi__zdist_extra[z]) - 1));
+		bits >>= stbi__zdist_extra[z];
+		nbits -= stbi__zdist_extra[z];
+		if (zout - a->zout_start < dist) { result = stbi__err("bad dist", "Corrupt PNG"); break; }
+
+		p = (stbi_uc *)(zout - dist);
+		if (dist >= 8) {
+			// may write up to 7 bytes past the match; STBI__ZFAST_OUT leaves room
+			char *end = zout + len;
+			do {
+				memcpy(zout, p, 8);
+				zout += 8;
+				p += 8;
+			} while (zout < end);
+			zout = end;
+		}
+		else if (dist == 1) { // run of one byte; common in images.
+			memset(zout, *p, len);
+			zout += len;
+		}
+		else {
+			if (len) { do *zout++ = *p++; while (--len); }
+		}
+	}
+
+	// give back the whole bytes that were read ahead
+	a->zbuffer = in - (nbits >> 3);
+	a->code_buffer = (stbi__uint32)bits & ((1u << (nbits & 7)) - 1);
+	a->num_bits = nbits & 7;
+	a->zout = zout;
+	return result;
+}
+#endif // !STBI_NO_ZLIB_FAST
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
 	char *zout = a->zout;
 	for (;;) {
-		int z = stbi__zhuffman_decode(a, &a->z_length);
+		int z;
+#ifndef STBI_NO_ZLIB_FAST
+		if (a->zbuffer_end - a->zbuffer >= STBI__ZFAST_IN && a->zout_end - zout >= STBI__ZFAST_OUT) {
+			a->zout = zout;
+			z = stbi__parse_huffman_fast(a);
+			if (z >= 0) return z;
+			zout = a->zout;
+		}
+#endif
+		z = stbi__zhuffman_decode(a, &a->z_length);
 		if (z < 256) {
 			if (z < 0) return stbi__err("bad huffman code", "Corrupt PNG"); // error in huffman codes
 			if (zout >= a->zout_end) {
@@ -4092,11 +5468,12 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
 				a->zout = zout;
 				return 1;
 			}
+			if (z >= 286) return stbi__err("bad huffman code", "Corrupt PNG"); // per DEFLATE, length codes 286 and 287 must not appear in compressed data
 			z -= 257;
 			len = stbi__zlength_base[z];
 			if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
 			z = stbi__zhuffman_decode(a, &a->z_distance);
-			if (z < 0) return stbi__err("bad huffman code", "Corrupt PNG");
+			if (z < 0 || z >= 30) return stbi__err("bad huffman code", "Corrupt PNG"); // per DEFLATE, distance codes 30 and 31 must not appear in compressed data
 			dist = stbi__zdist_base[z];
 			if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
 			if (zout - a->zout_start < dist) return stbi__err("bad dist", "Corrupt PNG");
@@ -4262,6 +5639,9 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
 			else {
 				if (!stbi__compute_huffman_codes(a)) return 0;
 			}
+#ifndef STBI_NO_ZLIB_FAST
+			stbi__zbuild_fastlit(a);
+#endif
 			if (!stbi__parse_huffman_block(a)) return 0;
 		}
 	} while (!final);
@@ -4274,6 +5654,7 @@ static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse
 	a->zout = obuf;
 	a->zout_end = obuf + olen;
 	a->z_expandable = exp;
+	a->zflush = NULL;
 
 	return stbi__parse_zlib(a, parse_header);
 }
@@ -4290,7 +5671,7 @@ STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int
 		return a.zout_start;
 	}
 	else {
-		STBI_FREE(a.zout_start);
+		stbi__free(a.zout_start);
 		return NULL;
 	}
 }
@@ -4312,7 +5693,7 @@ STBIDEF char *stbi_zlib_decode_malloc_guesssize_headerflag(const char *buffer, i
 		return a.zout_start;
 	}
 	else {
-		STBI_FREE(a.zout_start);
+		stbi__free(a.zout_start);
 		return NULL;
 	}
 }
@@ -4340,7 +5721,7 @@ STBIDEF char *stbi_zlib_decode_noheader_malloc(char const *buffer, int len, int
 		return a.zout_start;
 	}
 	else {
-		STBI_FREE(a.zout_start);
+		stbi__free(a.zout_start);
 		return NULL;
 	}
 }
@@ -4391,11 +5772,25 @@ static int stbi__check_png_header(stbi__context *s)
 	return 1;
 }
 
+// where the streaming entry points deliver rows: a callback, or a
+// caller-owned buffer when cb is NULL
+typedef struct
+{
+	stbi_png_rows_callback *cb;
+	void *user;
+	stbi_uc *out;
+	size_t out_size;
+	int out_stride;
+	int flip;
+	int bits;
+} stbi__png_sink;
+
 typedef struct
 {
 	stbi__context *s;
 	stbi_uc *idata, *expanded, *out;
 	int depth;
+	stbi__png_sink *sink; // non-NULL for streaming loads
 } stbi__png;
 
 
@@ -4430,25 +5825,194 @@ static int stbi__paeth(int a, int b, int c)
 	return c;
 }
 
+#ifdef STBI_SSE2
+// n is 3 or 4; rows aren't padded, so 3-byte pixels are moved bytewise
+stbi_inline static __m128i stbi__png_load_px(const stbi_uc *p, int n)
+{
+	int v;
+	if (n == 4) memcpy(&v, p, 4);
+	else v = p[0] | (p[1] << 8) | (p[2] << 16);
+	return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__png_store_px(stbi_uc *p, __m128i v, int n)
+{
+	int t = _mm_cvtsi128_si32(v);
+	if (n == 4) memcpy(p, &t, 4);
+	else {
+		p[0] = (stbi_uc)t;
+		p[1] = (stbi_uc)(t >> 8);
+		p[2] = (stbi_uc)(t >> 16);
+	}
+}
+
+// paeth predictor on 16-bit lanes; same tie-breaking as stbi__paeth
+stbi_inline static __m128i stbi__paeth_sse2(__m128i a, __m128i b, __m128i c)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i bc = _mm_sub_epi16(b, c);
+	__m128i ac = _mm_sub_epi16(a, c);
+	__m128i abc = _mm_add_epi16(bc, ac);
+	__m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+	__m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+	__m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+	__m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+	__m128i not_b = _mm_cmpgt_epi16(pb, pc);
+	__m128i bc_pick = _mm_or_si128(_mm_andnot_si128(not_b, b), _mm_and_si128(not_b, c));
+	return _mm_or_si128(_mm_andnot_si128(not_a, a), _mm_and_si128(not_a, bc_pick));
+}
+
+// one pass of 'filter' over w pixels with IN bytes per pixel in raw and ON in
+// cur/prior. a macro so the per-pixel loads and stores get a constant size
+#define STBI__PNG_UNFILTER_SSE2(IN, ON) \
+	a = stbi__png_load_px(cur - ON, ON); \
+	switch (filter) { \
+	case STBI__F_none: \
+		for (; i < w; ++i, raw += IN, cur += ON) \
+			stbi__png_store_px(cur, _mm_or_si128(stbi__png_load_px(raw, IN), alpha), ON); \
+		break; \
+	case STBI__F_up: \
+		for (; i < w; ++i, raw += IN, cur += ON, prior += ON) { \
+			x = _mm_add_epi8(stbi__png_load_px(raw, IN), stbi__png_load_px(prior, ON)); \
+			stbi__png_store_px(cur, _mm_or_si128(x, alpha), ON); \
+		} \
+		break; \
+	case STBI__F_sub: \
+	case STBI__F_paeth_first: /* paeth(a,0,0) == a */ \
+		for (; i < w; ++i, raw += IN, cur += ON) { \
+			a = _mm_or_si128(_mm_add_epi8(stbi__png_load_px(raw, IN), a), alpha); \
+			stbi__png_store_px(cur, a, ON); \
+		} \
+		break; \
+	case STBI__F_avg: \
+		for (; i < w; ++i, raw += IN, cur += ON, prior += ON) { \
+			/* _mm_avg_epu8 rounds up; take the carry back out to get (a+b)>>1 */ \
+			b = stbi__png_load_px(prior, ON); \
+			x = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one)); \
+			a = _mm_or_si128(_mm_add_epi8(stbi__png_load_px(raw, IN), x), alpha); \
+			stbi__png_store_px(cur, a, ON); \
+		} \
+		break; \
+	case STBI__F_avg_first: \
+		for (; i < w; ++i, raw += IN, cur += ON) { \
+			x = _mm_sub_epi8(_mm_avg_epu8(a, zero), _mm_and_si128(a, one)); \
+			a = _mm_or_si128(_mm_add_epi8(stbi__png_load_px(raw, IN), x), alpha); \
+			stbi__png_store_px(cur, a, ON); \
+		} \
+		break; \
+	case STBI__F_paeth: \
+		a = _mm_unpacklo_epi8(a, zero); \
+		c = _mm_unpacklo_epi8(stbi__png_load_px(prior - ON, ON), zero); \
+		for (; i < w; ++i, raw += IN, cur += ON, prior += ON) { \
+			b = _mm_unpacklo_epi8(stbi__png_load_px(prior, ON), zero); \
+			x = _mm_packus_epi16(stbi__paeth_sse2(a, b, c), zero); \
+			x = _mm_or_si128(_mm_add_epi8(stbi__png_load_px(raw, IN), x), alpha); \
+			stbi__png_store_px(cur, x, ON); \
+			a = _mm_unpacklo_epi8(x, zero); \
+			c = b; \
+		} \
+		break; \
+	}
+
+// undo 'filter' for pixels 1..w of an 8-bit row with 3 or 4 channels. cur
+// and prior point at pixel 1 and have out_n bytes per pixel, raw has img_n;
+// when out_n > img_n the added alpha is set to 255. Sub, Avg and Paeth
+// depend on the pixel to the left, so those run one pixel per step in the
+// low four lanes.
+static void stbi__png_unfilter_row_sse2(int filter, stbi_uc *cur, stbi_uc *raw, stbi_uc *prior, int w, int img_n, int out_n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i one = _mm_set1_epi8(1);
+	__m128i alpha = _mm_cvtsi32_si128(out_n > img_n ? (int)0xff000000 : 0);
+	__m128i a, b, c, x;
+	int i = 0;
+
+	if (img_n == out_n && (filter == STBI__F_none || filter == STBI__F_up)) {
+		int n = w * img_n;
+		if (filter == STBI__F_none) {
+			memcpy(cur, raw, n);
+			return;
+		}
+		for (; i + 16 <= n; i += 16) {
+			x = _mm_add_epi8(_mm_loadu_si128((__m128i *) (raw + i)), _mm_loadu_si128((__m128i *) (prior + i)));
+			_mm_storeu_si128((__m128i *) (cur + i), x);
+		}
+		for (; i < n; ++i)
+			cur[i] = STBI__BYTECAST(raw[i] + prior[i]);
+		return;
+	}
+
+	if (img_n == 4) {
+		STBI__PNG_UNFILTER_SSE2(4, 4)
+	}
+	else if (out_n == 4) {
+		STBI__PNG_UNFILTER_SSE2(3, 4)
+	}
+	else {
+		STBI__PNG_UNFILTER_SSE2(3, 3)
+	}
+}
+#undef STBI__PNG_UNFILTER_SSE2
+#endif
+
+#ifdef STBI_AVX2
+// Up is the only filter without a dependency along the row, so it is the
+// only one that gets wider; everything else goes to the sse2 version
+STBI__AVX2_TARGET
+static void stbi__png_unfilter_row_avx2(int filter, stbi_uc *cur, stbi_uc *raw, stbi_uc *prior, int w, int img_n, int out_n)
+{
+	int i, n;
+	if (filter != STBI__F_up || img_n != out_n) {
+		stbi__png_unfilter_row_sse2(filter, cur, raw, prior, w, img_n, out_n);
+		return;
+	}
+	n = w * img_n;
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_add_epi8(_mm256_loadu_si256((__m256i *) (raw + i)), _mm256_loadu_si256((__m256i *) (prior + i)));
+		_mm256_storeu_si256((__m256i *) (cur + i), x);
+	}
+	for (; i < n; ++i)
+		cur[i] = STBI__BYTECAST(raw[i] + prior[i]);
+}
+#endif
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
-// create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// create the png data from post-deflated data. 'out' has room for y rows of
+// x*out_n samples; if has_prior, the row just before 'out' holds the previous
+// scanline as left by this function (for depth < 8, before bit expansion),
+// and is overwritten with the last row of this batch in the same state
+// with flip set, row j of the input is written to row y-1-j of out, so the
+// caller doesn't need a separate vertical flip pass afterwards
+static int stbi__png_unfilter_rows(stbi__png *a, stbi_uc *out, int has_prior, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, int flip)
 {
 	int bytes = (depth == 16 ? 2 : 1);
 	stbi__context *s = a->s;
 	stbi__uint32 i, j, stride = x * out_n*bytes;
 	stbi__uint32 img_len, img_width_bytes;
+	stbi_uc *row = flip ? out + (size_t)stride * (y - 1) : out;
+	ptrdiff_t row_step = flip ? -(ptrdiff_t)stride : (ptrdiff_t)stride;
 	int k;
 	int img_n = s->img_n; // copy it into a local for later
 
 	int output_bytes = out_n * bytes;
 	int filter_bytes = img_n * bytes;
 	int width = x;
+#ifdef STBI_SSE2
+	void(*unfilter)(int filter, stbi_uc *cur, stbi_uc *raw, stbi_uc *prior, int w, int img_n, int out_n) = NULL;
+#endif
 
 	STBI_ASSERT(out_n == s->img_n || out_n == s->img_n + 1);
-	a->out = (stbi_uc *)stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
-	if (!a->out) return stbi__err("outofmem", "Out of memory");
+
+#ifdef STBI_SSE2
+	if (depth == 8 && (img_n == 3 || img_n == 4) && stbi__sse2_available()) {
+		unfilter = stbi__png_unfilter_row_sse2;
+#ifdef STBI_AVX2
+		if (stbi__avx2_available())
+			unfilter = stbi__png_unfilter_row_avx2;
+#endif
+	}
+#endif
 
 	if (!stbi__mad3sizes_valid(img_n, x, depth, 7)) return stbi__err("too large", "Corrupt PNG");
 	img_width_bytes = (((img_n * x * depth) + 7) >> 3);
@@ -4459,8 +6023,8 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 	// so just check for raw_len < img_len always.
 	if (raw_len < img_len) return stbi__err("not enough pixels", "Corrupt PNG");
 
-	for (j = 0; j < y; ++j) {
-		stbi_uc *cur = a->out + stride * j;
+	for (j = 0; j < y; ++j, row += row_step) {
+		stbi_uc *cur = row;
 		stbi_uc *prior;
 		int filter = *raw++;
 
@@ -4473,10 +6037,10 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 			filter_bytes = 1;
 			width = img_width_bytes;
 		}
-		prior = cur - stride; // bugfix: need to compute this after 'cur +=' computation above
+		prior = cur - row_step; // bugfix: need to compute this after 'cur +=' computation above
 
 		// if first row, use special filter that doesn't sample previous row
-		if (j == 0) filter = first_row_filter[filter];
+		if (j == 0 && !has_prior) filter = first_row_filter[filter];
 
 		// handle first byte explicitly
 		for (k = 0; k < filter_bytes; ++k) {
@@ -4513,6 +6077,14 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 			prior += 1;
 		}
 
+#ifdef STBI_SSE2
+		if (unfilter) {
+			unfilter(filter, cur, raw, prior, x - 1, img_n, out_n);
+			raw += (x - 1) * img_n;
+			continue;
+		}
+#endif
+
 		// this is a little gross, so that we don't switch per-pixel or per-component
 		if (depth < 8 || img_n == out_n) {
 			int nk = (width - 1)*filter_bytes;
@@ -4552,7 +6124,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 			// the loop above sets the high byte of the pixels' alpha, but for
 			// 16 bit png files we also need the low byte set. we'll do that here.
 			if (depth == 16) {
-				cur = a->out + stride * j; // start at the beginning of the row again
+				cur = row; // start at the beginning of the row again
 				for (i = 0; i < x; ++i, cur += output_bytes) {
 					cur[filter_bytes + 1] = 255;
 				}
@@ -4560,13 +6132,16 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 		}
 	}
 
+	if (has_prior)
+		memcpy(out - stride, out + stride * (y - 1), stride);
+
 	// we make a separate pass to expand bits to pixels; for performance,
 	// this could run two scanlines behind the above code, so it won't
 	// intefere with filtering but will still be in the cache.
 	if (depth < 8) {
 		for (j = 0; j < y; ++j) {
-			stbi_uc *cur = a->out + stride * j;
-			stbi_uc *in = a->out + stride * j + x * out_n - img_width_bytes;
+			stbi_uc *cur = out + stride * j;
+			stbi_uc *in = out + stride * j + x * out_n - img_width_bytes;
 			// unpack 1/2/4-bit into a 8-bit buffer. allows us to keep the common 8-bit path optimal at minimal cost for 1/2/4-bit
 			// png guarante byte alignment, if width is not multiple of 8/4/2 we'll decode dummy trailing data that will be skipped in the later loop
 			stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
@@ -4617,7 +6192,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 			if (img_n != out_n) {
 				int q;
 				// insert alpha = 255
-				cur = a->out + stride * j;
+				cur = out + stride * j;
 				if (img_n == 1) {
 					for (q = x - 1; q >= 0; --q) {
 						cur[q * 2 + 1] = 255;
@@ -4641,7 +6216,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 		// this is done in a separate pass due to the decoding relying
 		// on the data being untouched, but could probably be done
 		// per-line during decode if care is taken.
-		stbi_uc *cur = a->out;
+		stbi_uc *cur = out;
 		stbi__uint16 *cur16 = (stbi__uint16*)cur;
 
 		for (i = 0; i < x*y*out_n; ++i, cur16++, cur += 2) {
@@ -4652,17 +6227,31 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 	return 1;
 }
 
+static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+{
+	int bytes = (depth == 16 ? 2 : 1);
+	a->out = (stbi_uc *)stbi__malloc_mad3(x, y, out_n * bytes, 0); // extra bytes to write off the end into
+	if (!a->out) return stbi__err("outofmem", "Out of memory");
+	return stbi__png_unfilter_rows(a, a->out, 0, raw, raw_len, out_n, x, y, depth, color, 0);
+}
+
 static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
 {
 	int bytes = (depth == 16 ? 2 : 1);
 	int out_bytes = out_n * bytes;
 	stbi_uc *final;
 	int p;
-	if (!interlaced)
-		return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+	// paletted images are expanded into another buffer afterwards
+	if (!interlaced) {
+		a->out = color == 3 ? (stbi_uc *)stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0)
+			: (stbi_uc *)stbi__malloc_pixels_mad3(out_n, bytes * 8, a->s->img_x, a->s->img_y, out_bytes, 0);
+		if (!a->out) return stbi__err("outofmem", "Out of memory");
+		return stbi__png_unfilter_rows(a, a->out, 0, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color, a->s->flip_vertically);
+	}
 
 	// de-interlacing
-	final = (stbi_uc *)stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
+	final = color == 3 ? (stbi_uc *)stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0)
+		: (stbi_uc *)stbi__malloc_pixels_mad3(out_n, bytes * 8, a->s->img_x, a->s->img_y, out_bytes, 0);
 	for (p = 0; p < 7; ++p) {
 		int xorig[] = { 0,4,0,2,0,1,0 };
 		int yorig[] = { 0,0,4,0,2,0,1 };
@@ -4675,18 +6264,20 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
 		if (x && y) {
 			stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
 			if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
-				STBI_FREE(final);
+				stbi__free(final);
 				return 0;
 			}
 			for (j = 0; j < y; ++j) {
 				for (i = 0; i < x; ++i) {
 					int out_y = j * yspc[p] + yorig[p];
 					int out_x = i * xspc[p] + xorig[p];
+					if (a->s->flip_vertically)
+						out_y = a->s->img_y - 1 - out_y;
 					memcpy(final + out_y * a->s->img_x*out_bytes + out_x * out_bytes,
 						a->out + (j*x + i)*out_bytes, out_bytes);
 				}
 			}
-			STBI_FREE(a->out);
+			stbi__free(a->out);
 			image_data += img_len;
 			image_data_len -= img_len;
 		}
@@ -4696,11 +6287,9 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
 	return 1;
 }
 
-static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
+static int stbi__compute_transparency(stbi_uc *p, stbi__uint32 pixel_count, stbi_uc tc[3], int out_n)
 {
-	stbi__context *s = z->s;
-	stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-	stbi_uc *p = z->out;
+	stbi__uint32 i;
 
 	// compute color-based transparency, assuming we've
 	// already got 255 as the alpha value in the output
@@ -4722,11 +6311,9 @@ static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
 	return 1;
 }
 
-static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int out_n)
+static int stbi__compute_transparency16(stbi__uint16 *p, stbi__uint32 pixel_count, stbi__uint16 tc[3], int out_n)
 {
-	stbi__context *s = z->s;
-	stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-	stbi__uint16 *p = (stbi__uint16*)z->out;
+	stbi__uint32 i;
 
 	// compute color-based transparency, assuming we've
 	// already got 65535 as the alpha value in the output
@@ -4748,17 +6335,9 @@ static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int ou
 	return 1;
 }
 
-static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
+static void stbi__png_palette_lookup(stbi_uc *p, const stbi_uc *orig, stbi__uint32 pixel_count, const stbi_uc *palette, int pal_img_n)
 {
-	stbi__uint32 i, pixel_count = a->s->img_x * a->s->img_y;
-	stbi_uc *p, *temp_out, *orig = a->out;
-
-	p = (stbi_uc *)stbi__malloc_mad2(pixel_count, pal_img_n, 0);
-	if (p == NULL) return stbi__err("outofmem", "Out of memory");
-
-	// between here and free(out) below, exitting would leak
-	temp_out = p;
-
+	stbi__uint32 i;
 	if (pal_img_n == 3) {
 		for (i = 0; i < pixel_count; ++i) {
 			int n = orig[i] * 4;
@@ -4778,17 +6357,25 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
 			p += 4;
 		}
 	}
-	STBI_FREE(a->out);
-	a->out = temp_out;
+}
+
+static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
+{
+	stbi__uint32 pixel_count = a->s->img_x * a->s->img_y;
+	stbi_uc *p;
+
+	p = (stbi_uc *)stbi__malloc_pixels_mad3(pal_img_n, 8, pixel_count, pal_img_n, 1, 0);
+	if (p == NULL) return stbi__err("outofmem", "Out of memory");
+
+	stbi__png_palette_lookup(p, a->out, pixel_count, palette, pal_img_n);
+	stbi__free(a->out);
+	a->out = p;
 
 	STBI_NOTUSED(len);
 
 	return 1;
 }
 
-static int stbi__unpremultiply_on_load = 0;
-static int stbi__de_iphone_flag = 0;
-
 STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultiply)
 {
 	stbi__unpremultiply_on_load = flag_true_if_should_unpremultiply;
@@ -4799,13 +6386,11 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert)
 	stbi__de_iphone_flag = flag_true_if_should_convert;
 }
 
-static void stbi__de_iphone(stbi__png *z)
+static void stbi__de_iphone(stbi_uc *p, stbi__uint32 pixel_count, int out_n, int unpremultiply)
 {
-	stbi__context *s = z->s;
-	stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-	stbi_uc *p = z->out;
+	stbi__uint32 i;
 
-	if (s->img_out_n == 3) {  // convert bgr to rgb
+	if (out_n == 3) {  // convert bgr to rgb
 		for (i = 0; i < pixel_count; ++i) {
 			stbi_uc t = p[0];
 			p[0] = p[2];
@@ -4814,8 +6399,8 @@ static void stbi__de_iphone(stbi__png *z)
 		}
 	}
 	else {
-		STBI_ASSERT(s->img_out_n == 4);
-		if (stbi__unpremultiply_on_load) {
+		STBI_ASSERT(out_n == 4);
+		if (unpremultiply) {
 			// convert bgr to rgb and unpremultiply
 			for (i = 0; i < pixel_count; ++i) {
 				stbi_uc a = p[3];
@@ -4845,6 +6430,190 @@ static void stbi__de_iphone(stbi__png *z)
 	}
 }
 
+// streaming decode: the IDAT stream is inflated into a sliding window whose
+// complete scanlines are unfiltered a band at a time, post-processed the same
+// way stbi__parse_png_file and stbi__do_png treat the whole image, and handed
+// to the sink. the previous band's last row is kept in front of the band
+// buffer for the Up/Avg/Paeth filters; it starts out zeroed, which makes them
+// behave like the first-row filters.
+typedef struct
+{
+	stbi__png *png;
+	int color, has_trans, is_iphone, pal_img_n, req_comp;
+	stbi_uc *tc, *palette;
+	stbi__uint16 *tc16;
+
+	stbi__uint32 raw_row;   // bytes per filtered scanline, including the filter byte
+	stbi__uint32 stride;    // bytes per unfiltered scanline
+	stbi__uint32 band_rows;
+	stbi__uint32 y;         // rows delivered so far
+	stbi__uint32 done;      // bytes at the start of the window already unfiltered
+	stbi_uc *band;          // band_rows+1 rows; the first is the previous scanline
+	stbi_uc *conv[2];       // ping-pong buffers for format conversion
+} stbi__png_stream;
+
+static int stbi__png_sink_rows(stbi__png_sink *k, stbi__uint32 h, stbi__uint32 y, stbi__uint32 rows, stbi_uc *pixels, stbi__uint32 row_bytes)
+{
+	size_t stride;
+	stbi__uint32 j;
+	if (k->cb) {
+		if (!k->cb(k->user, (int)y, (int)rows, pixels, (int)row_bytes))
+			return stbi__err("cancelled", "Decode cancelled by callback");
+		return 1;
+	}
+	stride = k->out_stride ? (size_t)k->out_stride : row_bytes;
+	if (k->out_stride < 0 || stride < row_bytes || (h - 1) * stride + row_bytes > k->out_size)
+		return stbi__err("buffer too small", "Output buffer too small");
+	for (j = 0; j < rows; ++j) {
+		stbi__uint32 out_y = k->flip ? h - 1 - (y + j) : y + j;
+		memcpy(k->out + out_y * stride, pixels + (size_t)j * row_bytes, row_bytes);
+	}
+	return 1;
+}
+
+static int stbi__png_stream_band(stbi__png_stream *st, stbi_uc *raw, stbi__uint32 rows)
+{
+	stbi__png *z = st->png;
+	stbi__context *s = z->s;
+	stbi__uint32 n = s->img_x * rows, i;
+	int bytes = (z->depth == 16 ? 2 : 1), bits = st->png->sink->bits;
+	int comp = s->img_out_n;
+	stbi_uc *cur = st->band + st->stride;
+
+	if (!stbi__png_unfilter_rows(z, cur, 1, raw, rows * st->raw_row, comp, s->img_x, rows, z->depth, st->color, 0))
+		return 0;
+	if (st->has_trans) {
+		if (z->depth == 16)
+			stbi__compute_transparency16((stbi__uint16 *)cur, n, st->tc16, comp);
+		else
+			stbi__compute_transparency(cur, n, st->tc, comp);
+	}
+	if (st->is_iphone && s->de_iphone && comp > 2)
+		stbi__de_iphone(cur, n, comp, s->unpremultiply);
+	if (st->pal_img_n) {
+		int pal_n = st->req_comp >= 3 ? st->req_comp : st->pal_img_n;
+		stbi__png_palette_lookup(st->conv[0], cur, n, st->palette, pal_n);
+		cur = st->conv[0];
+		comp = pal_n;
+	}
+	if (st->req_comp && st->req_comp != comp) {
+		stbi_uc *to = (cur == st->conv[0]) ? st->conv[1] : st->conv[0];
+		if (bytes == 2)
+			stbi__convert_pixels16((stbi__uint16 *)cur, comp, (stbi__uint16 *)to, st->req_comp, s->img_x, rows);
+		else
+			stbi__convert_pixels(cur, comp, to, st->req_comp, s->img_x, rows);
+		cur = to;
+		comp = st->req_comp;
+	}
+	if (bits != bytes * 8) {
+		stbi_uc *to = (cur == st->conv[0]) ? st->conv[1] : st->conv[0];
+		if (bytes == 2) {
+			stbi__uint16 *src = (stbi__uint16 *)cur;
+			for (i = 0; i < n * comp; ++i)
+				to[i] = (stbi_uc)((src[i] >> 8) & 0xFF); // same as stbi__convert_16_to_8
+		}
+		else {
+			stbi__uint16 *dst = (stbi__uint16 *)to;
+			for (i = 0; i < n * comp; ++i)
+				dst[i] = (stbi__uint16)((cur[i] << 8) + cur[i]); // same as stbi__convert_8_to_16
+		}
+		cur = to;
+	}
+	if (!stbi__png_sink_rows(z->sink, s->img_y, st->y, rows, cur, s->img_x * comp * (bits / 8)))
+		return 0;
+	st->y += rows;
+	return 1;
+}
+
+// zflush hook: unfilter every complete scanline in the window, then slide it
+// down and make room for n more bytes
+static int stbi__png_stream_flush(stbi__zbuf *a, int n)
+{
+	stbi__png_stream *st = (stbi__png_stream *)a->zflush_user;
+	stbi__uint32 img_y = st->png->s->img_y;
+	stbi__uint32 avail = (stbi__uint32)(a->zout - a->zout_start);
+	stbi__uint32 limit = (stbi__uint32)(a->zout_end - a->zout_start);
+	stbi__uint32 drop = 0;
+
+	while (st->y < img_y && avail - st->done >= st->raw_row) {
+		stbi__uint32 rows = (avail - st->done) / st->raw_row;
+		if (rows > st->band_rows) rows = st->band_rows;
+		if (rows > img_y - st->y) rows = img_y - st->y;
+		if (!stbi__png_stream_band(st, (stbi_uc *)a->zout_start + st->done, rows)) return 0;
+		st->done += rows * st->raw_row;
+	}
+	if (st->y == img_y) st->done = avail; // like the whole-image path, ignore any extra data
+
+	// drop unfiltered bytes, keeping the 32k window that matches may reach into
+	if (avail > 32768) {
+		drop = avail - 32768;
+		if (drop > st->done) drop = st->done;
+	}
+	if (drop) {
+		memmove(a->zout_start, a->zout_start + drop, avail - drop);
+		avail -= drop;
+		st->done -= drop;
+		a->zout = a->zout_start + avail;
+	}
+	if (avail + n > limit) {
+		stbi__uint32 old_limit = limit;
+		char *q;
+		while (avail + n > limit)
+			limit *= 2;
+		q = (char *)stbi__realloc_sized(a->zout_start, old_limit, limit);
+		STBI_NOTUSED(old_limit);
+		if (q == NULL) return stbi__err("outofmem", "Out of memory");
+		a->zout_start = q;
+		a->zout = q + avail;
+		a->zout_end = q + limit;
+	}
+	return 1;
+}
+
+static int stbi__png_stream_image(stbi__png *z, stbi__png_stream *st, stbi__uint32 ioff, int parse_header)
+{
+	stbi__context *s = z->s;
+	stbi__uint32 bytes = (z->depth == 16 ? 2 : 1), limit;
+	stbi__zbuf a;
+	int r;
+
+	if (!stbi__mad3sizes_valid(s->img_n, s->img_x, z->depth, 7)) return stbi__err("too large", "Corrupt PNG");
+	st->png = z;
+	st->raw_row = ((s->img_n * s->img_x * z->depth + 7) >> 3) + 1;
+	st->stride = s->img_x * s->img_out_n * bytes;
+	st->band_rows = 65536 / st->stride;
+	if (st->band_rows == 0) st->band_rows = 1;
+	if (st->band_rows > s->img_y) st->band_rows = s->img_y;
+	st->y = 0;
+	st->done = 0;
+	// room for the 32k history plus about two bands of filtered data
+	limit = 32768 + 2 * st->band_rows * st->raw_row;
+
+	st->band = (stbi_uc *)stbi__malloc_mad2(st->band_rows + 1, st->stride, 0);
+	st->conv[0] = (stbi_uc *)stbi__malloc_mad3(s->img_x, st->band_rows, 8, 0);
+	st->conv[1] = (stbi_uc *)stbi__malloc_mad3(s->img_x, st->band_rows, 8, 0);
+	a.zout_start = (char *)stbi__malloc(limit);
+	if (st->band && st->conv[0] && st->conv[1] && a.zout_start) {
+		memset(st->band, 0, st->stride);
+		a.zbuffer = z->idata;
+		a.zbuffer_end = z->idata + ioff;
+		a.zout = a.zout_start;
+		a.zout_end = a.zout_start + limit;
+		a.z_expandable = 1;
+		a.zflush = stbi__png_stream_flush;
+		a.zflush_user = st;
+		r = stbi__parse_zlib(&a, parse_header) && stbi__png_stream_flush(&a, 0);
+		if (r && st->y < s->img_y) r = stbi__err("not enough pixels", "Corrupt PNG");
+	}
+	else
+		r = stbi__err("outofmem", "Out of memory");
+	stbi__free(a.zout_start);
+	stbi__free(st->conv[1]);
+	stbi__free(st->conv[0]);
+	stbi__free(st->band);
+	return r;
+}
+
 #define STBI__PNG_TYPE(a,b,c,d)  (((unsigned) (a) << 24) + ((unsigned) (b) << 16) + ((unsigned) (c) << 8) + (unsigned) (d))
 
 static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
@@ -4952,7 +6721,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 				while (ioff + c.length > idata_limit)
 					idata_limit *= 2;
 				STBI_NOTUSED(idata_limit_old);
-				p = (stbi_uc *)STBI_REALLOC_SIZED(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
+				p = (stbi_uc *)stbi__realloc_sized(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
 				z->idata = p;
 			}
 			if (!stbi__getn(s, z->idata + ioff, c.length)) return stbi__err("outofdata", "Corrupt PNG");
@@ -4965,27 +6734,44 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 			if (first) return stbi__err("first not IHDR", "Corrupt PNG");
 			if (scan != STBI__SCAN_load) return 1;
 			if (z->idata == NULL) return stbi__err("no IDAT", "Corrupt PNG");
+			if ((req_comp == s->img_n + 1 && req_comp != 3 && !pal_img_n) || has_trans)
+				s->img_out_n = s->img_n + 1;
+			else
+				s->img_out_n = s->img_n;
+			if (z->sink && !interlace) {
+				stbi__png_stream st;
+				st.color = color;
+				st.has_trans = has_trans;
+				st.tc = tc;
+				st.tc16 = tc16;
+				st.is_iphone = is_iphone;
+				st.pal_img_n = pal_img_n;
+				st.palette = palette;
+				st.req_comp = req_comp;
+				if (!stbi__png_stream_image(z, &st, ioff, !is_iphone)) return 0;
+				if (pal_img_n)
+					s->img_n = pal_img_n;
+				else if (has_trans)
+					++s->img_n;
+				return 1;
+			}
 			// initial guess for decoded data size to avoid unnecessary reallocs
 			bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
 			raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
 			z->expanded = (stbi_uc *)stbi_zlib_decode_malloc_guesssize_headerflag((char *)z->idata, ioff, raw_len, (int *)&raw_len, !is_iphone);
 			if (z->expanded == NULL) return 0; // zlib should set error
-			STBI_FREE(z->idata); z->idata = NULL;
-			if ((req_comp == s->img_n + 1 && req_comp != 3 && !pal_img_n) || has_trans)
-				s->img_out_n = s->img_n + 1;
-			else
-				s->img_out_n = s->img_n;
+			stbi__free(z->idata); z->idata = NULL;
 			if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
 			if (has_trans) {
 				if (z->depth == 16) {
-					if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
+					if (!stbi__compute_transparency16((stbi__uint16 *)z->out, s->img_x * s->img_y, tc16, s->img_out_n)) return 0;
 				}
 				else {
-					if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
+					if (!stbi__compute_transparency(z->out, s->img_x * s->img_y, tc, s->img_out_n)) return 0;
 				}
 			}
-			if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
-				stbi__de_iphone(z);
+			if (is_iphone && s->de_iphone && s->img_out_n > 2)
+				stbi__de_iphone(z->out, s->img_x * s->img_y, s->img_out_n, s->unpremultiply);
 			if (pal_img_n) {
 				// pal_img_n == 3 or 4
 				s->img_n = pal_img_n; // record the actual colors we had
@@ -4998,7 +6784,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 				// non-paletted image with tRNS -> source image has (constant) alpha
 				++s->img_n;
 			}
-			STBI_FREE(z->expanded); z->expanded = NULL;
+			stbi__free(z->expanded); z->expanded = NULL;
 			return 1;
 		}
 
@@ -5046,10 +6832,11 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
 		*x = p->s->img_x;
 		*y = p->s->img_y;
 		if (n) *n = p->s->img_n;
+		ri->flipped = p->s->flip_vertically;
 	}
-	STBI_FREE(p->out);      p->out = NULL;
-	STBI_FREE(p->expanded); p->expanded = NULL;
-	STBI_FREE(p->idata);    p->idata = NULL;
+	stbi__free(p->out);      p->out = NULL;
+	stbi__free(p->expanded); p->expanded = NULL;
+	stbi__free(p->idata);    p->idata = NULL;
 
 	return result;
 }
@@ -5058,9 +6845,128 @@ static void *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req
 {
 	stbi__png p;
 	p.s = s;
+	p.sink = NULL;
 	return stbi__do_png(&p, x, y, comp, req_comp, ri);
 }
 
+// interlaced images can't be streamed; stbi__parse_png_file decoded them
+// whole, so convert the result and deliver it as a single band
+static int stbi__png_stream_whole(stbi__png *p, int req_comp)
+{
+	stbi__context *s = p->s;
+	int bits = p->sink->bits, native = (p->depth == 16 ? 16 : 8), r;
+	void *result = p->out;
+	p->out = NULL;
+	if (req_comp && req_comp != s->img_out_n) {
+		if (native == 8)
+			result = stbi__convert_format((unsigned char *)result, s->img_out_n, req_comp, s->img_x, s->img_y);
+		else
+			result = stbi__convert_format16((stbi__uint16 *)result, s->img_out_n, req_comp, s->img_x, s->img_y);
+		s->img_out_n = req_comp;
+		if (result == NULL) return 0;
+	}
+	if (bits != native) {
+		if (native == 16)
+			result = stbi__convert_16_to_8((stbi__uint16 *)result, s->img_x, s->img_y, s->img_out_n);
+		else
+			result = stbi__convert_8_to_16((stbi_uc *)result, s->img_x, s->img_y, s->img_out_n);
+		if (result == NULL) return 0;
+	}
+	r = stbi__png_sink_rows(p->sink, s->img_y, 0, s->img_y, (stbi_uc *)result, s->img_x * s->img_out_n * (bits / 8));
+	stbi__free(result);
+	return r;
+}
+
+static int stbi__png_stream_main(stbi__context *s, stbi__png_sink *sink, int *x, int *y, int *comp, int req_comp)
+{
+	stbi__png p;
+	int r = 0;
+	if (req_comp < 0 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+	if (sink->bits != 8 && sink->bits != 16) return stbi__err("bad bits_per_channel", "Internal error");
+	p.s = s;
+	p.sink = sink;
+	s->flip_vertically = 0; // the sink does any flipping, including for the interlaced fallback
+	if (stbi__parse_png_file(&p, STBI__SCAN_load, req_comp)) {
+		r = p.out ? stbi__png_stream_whole(&p, req_comp) : 1;
+		if (r) {
+			if (x) *x = s->img_x;
+			if (y) *y = s->img_y;
+			if (comp) *comp = s->img_n;
+		}
+	}
+	stbi__free(p.out);
+	stbi__free(p.expanded);
+	stbi__free(p.idata);
+	return r;
+}
+
+STBIDEF int stbi_png_load_rows_from_memory(stbi_uc const *buffer, int len, stbi_png_rows_callback *cb, void *user, int *x, int *y, int *comp, int req_comp, int bits_per_channel)
+{
+	stbi__context s;
+	stbi__png_sink sink;
+	memset(&sink, 0, sizeof(sink));
+	sink.cb = cb;
+	sink.user = user;
+	sink.bits = bits_per_channel;
+	if (cb == NULL) return stbi__err("no callback", "Internal error");
+	stbi__start_mem(&s, buffer, len);
+	return stbi__png_stream_main(&s, &sink, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_png_load_into_from_memory(stbi_uc const *buffer, int len, void *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp, int bits_per_channel)
+{
+	stbi__context s;
+	stbi__png_sink sink;
+	memset(&sink, 0, sizeof(sink));
+	sink.out = (stbi_uc *)out;
+	sink.out_size = out_size;
+	sink.out_stride = out_stride;
+	sink.bits = bits_per_channel;
+	stbi__start_mem(&s, buffer, len);
+	sink.flip = s.flip_vertically;
+	return stbi__png_stream_main(&s, &sink, x, y, comp, req_comp);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_png_load_rows(char const *filename, stbi_png_rows_callback *cb, void *user, int *x, int *y, int *comp, int req_comp, int bits_per_channel)
+{
+	stbi__context s;
+	stbi__png_sink sink;
+	FILE *f;
+	int r;
+	if (cb == NULL) return stbi__err("no callback", "Internal error");
+	f = stbi__fopen(filename, "rb");
+	if (!f) return stbi__err("can't fopen", "Unable to open file");
+	memset(&sink, 0, sizeof(sink));
+	sink.cb = cb;
+	sink.user = user;
+	sink.bits = bits_per_channel;
+	stbi__start_file(&s, f);
+	r = stbi__png_stream_main(&s, &sink, x, y, comp, req_comp);
+	fclose(f);
+	return r;
+}
+
+STBIDEF int stbi_png_load_into(char const *filename, void *out, size_t out_size, int out_stride, int *x, int *y, int *comp, int req_comp, int bits_per_channel)
+{
+	stbi__context s;
+	stbi__png_sink sink;
+	FILE *f = stbi__fopen(filename, "rb");
+	int r;
+	if (!f) return stbi__err("can't fopen", "Unable to open file");
+	memset(&sink, 0, sizeof(sink));
+	sink.out = (stbi_uc *)out;
+	sink.out_size = out_size;
+	sink.out_stride = out_stride;
+	sink.bits = bits_per_channel;
+	stbi__start_file(&s, f);
+	sink.flip = s.flip_vertically;
+	r = stbi__png_stream_main(&s, &sink, x, y, comp, req_comp);
+	fclose(f);
+	return r;
+}
+#endif
+
 static int stbi__png_test(stbi__context *s)
 {
 	int r;
@@ -5277,13 +7183,14 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 	int psize = 0, i, j, width;
 	int flip_vertically, pad, target;
 	stbi__bmp_data info;
-	STBI_NOTUSED(ri);
 
 	info.all_a = 255;
 	if (stbi__bmp_parse_header(s, &info) == NULL)
 		return NULL; // error code already set
 
-	flip_vertically = ((int)s->img_y) > 0;
+	// bottom-up files are flipped while decoding, unless the caller asked for
+	// bottom-up output, in which case the rows are already in the right order
+	flip_vertically = (((int)s->img_y) > 0) ^ s->flip_vertically;
 	s->img_y = abs((int)s->img_y);
 
 	mr = info.mr;
@@ -5311,11 +7218,11 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 	if (!stbi__mad3sizes_valid(target, s->img_x, s->img_y, 0))
 		return stbi__errpuc("too large", "Corrupt BMP");
 
-	out = (stbi_uc *)stbi__malloc_mad3(target, s->img_x, s->img_y, 0);
+	out = (stbi_uc *)stbi__malloc_pixels_mad3(target, 8, target, s->img_x, s->img_y, 0);
 	if (!out) return stbi__errpuc("outofmem", "Out of memory");
 	if (info.bpp < 16) {
 		int z = 0;
-		if (psize == 0 || psize > 256) { STBI_FREE(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
+		if (psize == 0 || psize > 256) { stbi__free(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
 		for (i = 0; i < psize; ++i) {
 			pal[i][2] = stbi__get8(s);
 			pal[i][1] = stbi__get8(s);
@@ -5327,11 +7234,12 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 		if (info.bpp == 1) width = (s->img_x + 7) >> 3;
 		else if (info.bpp == 4) width = (s->img_x + 1) >> 1;
 		else if (info.bpp == 8) width = s->img_x;
-		else { STBI_FREE(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
+		else { stbi__free(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
 		pad = (-width) & 3;
 		if (info.bpp == 1) {
 			for (j = 0; j < (int)s->img_y; ++j) {
 				int bit_offset = 7, v = stbi__get8(s);
+				z = (flip_vertically ? (int)s->img_y - 1 - j : j) * s->img_x * target;
 				for (i = 0; i < (int)s->img_x; ++i) {
 					int color = (v >> bit_offset) & 0x1;
 					out[z++] = pal[color][0];
@@ -5349,6 +7257,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 		}
 		else {
 			for (j = 0; j < (int)s->img_y; ++j) {
+				z = (flip_vertically ? (int)s->img_y - 1 - j : j) * s->img_x * target;
 				for (i = 0; i < (int)s->img_x; i += 2) {
 					int v = stbi__get8(s), v2 = 0;
 					if (info.bpp == 4) {
@@ -5387,7 +7296,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 				easy = 2;
 		}
 		if (!easy) {
-			if (!mr || !mg || !mb) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+			if (!mr || !mg || !mb) { stbi__free(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
 			// right shift amt to put high bit in position #7
 			rshift = stbi__high_bit(mr) - 7; rcount = stbi__bitcount(mr);
 			gshift = stbi__high_bit(mg) - 7; gcount = stbi__bitcount(mg);
@@ -5395,6 +7304,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 			ashift = stbi__high_bit(ma) - 7; acount = stbi__bitcount(ma);
 		}
 		for (j = 0; j < (int)s->img_y; ++j) {
+			z = (flip_vertically ? (int)s->img_y - 1 - j : j) * s->img_x * target;
 			if (easy) {
 				for (i = 0; i < (int)s->img_x; ++i) {
 					unsigned char a;
@@ -5429,17 +7339,6 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 		for (i = 4 * s->img_x*s->img_y - 1; i >= 0; i -= 4)
 			out[i] = 255;
 
-	if (flip_vertically) {
-		stbi_uc t;
-		for (j = 0; j < (int)s->img_y >> 1; ++j) {
-			stbi_uc *p1 = out + j * s->img_x*target;
-			stbi_uc *p2 = out + (s->img_y - 1 - j)*s->img_x*target;
-			for (i = 0; i < (int)s->img_x*target; ++i) {
-				t = p1[i]; p1[i] = p2[i]; p2[i] = t;
-			}
-		}
-	}
-
 	if (req_comp && req_comp != target) {
 		out = stbi__convert_format(out, target, req_comp, s->img_x, s->img_y);
 		if (out == NULL) return out; // stbi__convert_format frees input on failure
@@ -5448,6 +7347,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 	*x = s->img_x;
 	*y = s->img_y;
 	if (comp) *comp = s->img_n;
+	ri->flipped = s->flip_vertically;
 	return out;
 }
 #endif
@@ -5617,7 +7517,8 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 	int RLE_count = 0;
 	int RLE_repeating = 0;
 	int read_next_pixel = 1;
-	STBI_NOTUSED(ri);
+	unsigned char *tga_dst = NULL;
+	int tga_row_left = 0, tga_row = 0;
 
 	//   do a tiny bit of precessing
 	if (tga_image_type >= 8)
@@ -5626,6 +7527,9 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 		tga_is_RLE = 1;
 	}
 	tga_inverted = 1 - ((tga_inverted >> 5) & 1);
+	// a bottom-up request is folded into the row order used while decoding
+	tga_inverted ^= s->flip_vertically;
+	ri->flipped = s->flip_vertically;
 
 	//   If I'm paletted, then I'll use the number of bits from the palette
 	if (tga_indexed) tga_comp = stbi__tga_get_comp(tga_palette_bits, 0, &tga_rgb16);
@@ -5642,7 +7546,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 	if (!stbi__mad3sizes_valid(tga_width, tga_height, tga_comp, 0))
 		return stbi__errpuc("too large", "Corrupt TGA");
 
-	tga_data = (unsigned char*)stbi__malloc_mad3(tga_width, tga_height, tga_comp, 0);
+	tga_data = (unsigned char*)stbi__malloc_pixels_mad3(tga_comp, 8, tga_width, tga_height, tga_comp, 0);
 	if (!tga_data) return stbi__errpuc("outofmem", "Out of memory");
 
 	// skip to the data's starting position (offset usually = 0)
@@ -5664,7 +7568,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 			//   load the palette
 			tga_palette = (unsigned char*)stbi__malloc_mad2(tga_palette_len, tga_comp, 0);
 			if (!tga_palette) {
-				STBI_FREE(tga_data);
+				stbi__free(tga_data);
 				return stbi__errpuc("outofmem", "Out of memory");
 			}
 			if (tga_rgb16) {
@@ -5676,8 +7580,8 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 				}
 			}
 			else if (!stbi__getn(s, tga_palette, tga_palette_len * tga_comp)) {
-				STBI_FREE(tga_data);
-				STBI_FREE(tga_palette);
+				stbi__free(tga_data);
+				stbi__free(tga_palette);
 				return stbi__errpuc("bad palette", "Corrupt TGA");
 			}
 		}
@@ -5735,34 +7639,25 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 				read_next_pixel = 0;
 			} // end of reading a pixel
 
-			// copy data
+			// copy data, starting a new row at its final (possibly inverted) position
+			if (tga_row_left == 0)
+			{
+				tga_dst = tga_data + (tga_inverted ? tga_height - 1 - tga_row : tga_row) * tga_width * tga_comp;
+				tga_row_left = tga_width;
+				++tga_row;
+			}
 			for (j = 0; j < tga_comp; ++j)
-				tga_data[i*tga_comp + j] = raw_data[j];
+				tga_dst[j] = raw_data[j];
+			tga_dst += tga_comp;
+			--tga_row_left;
 
 			//   in case we're in RLE mode, keep counting down
 			--RLE_count;
 		}
-		//   do I need to invert the image?
-		if (tga_inverted)
-		{
-			for (j = 0; j * 2 < tga_height; ++j)
-			{
-				int index1 = j * tga_width * tga_comp;
-				int index2 = (tga_height - 1 - j) * tga_width * tga_comp;
-				for (i = tga_width * tga_comp; i > 0; --i)
-				{
-					unsigned char temp = tga_data[index1];
-					tga_data[index1] = tga_data[index2];
-					tga_data[index2] = temp;
-					++index1;
-					++index2;
-				}
-			}
-		}
 		//   clear my palette, if I had one
 		if (tga_palette != NULL)
 		{
-			STBI_FREE(tga_palette);
+			stbi__free(tga_palette);
 		}
 	}
 
@@ -5915,11 +7810,11 @@ static void *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int req
 	// Create the destination image.
 
 	if (!compression && bitdepth == 16 && bpc == 16) {
-		out = (stbi_uc *)stbi__malloc_mad3(8, w, h, 0);
+		out = (stbi_uc *)stbi__malloc_pixels_mad3(4, 16, 8, w, h, 0);
 		ri->bits_per_channel = 16;
 	}
 	else
-		out = (stbi_uc *)stbi__malloc(4 * w*h);
+		out = (stbi_uc *)stbi__malloc_pixels(4, 8, 4 * w*h);
 
 	if (!out) return stbi__errpuc("outofmem", "Out of memory");
 	pixelCount = w * h;
@@ -5954,7 +7849,7 @@ static void *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int req
 			else {
 				// Read the RLE data.
 				if (!stbi__psd_decode_rle(s, p, pixelCount)) {
-					STBI_FREE(out);
+					stbi__free(out);
 					return stbi__errpuc("corrupt", "bad RLE data");
 				}
 			}
@@ -6244,11 +8139,11 @@ static void *stbi__pic_load(stbi__context *s, int *px, int *py, int *comp, int r
 	stbi__get16be(s); //skip `pad'
 
 	// intermediate buffer is RGBA
-	result = (stbi_uc *)stbi__malloc_mad3(x, y, 4, 0);
+	result = (stbi_uc *)stbi__malloc_pixels_mad3(4, 8, x, y, 4, 0);
 	memset(result, 0xff, x*y * 4);
 
 	if (!stbi__pic_load_core(s, x, y, comp, result)) {
-		STBI_FREE(result);
+		stbi__free(result);
 		result = 0;
 	}
 	*px = x;
@@ -6358,13 +8253,13 @@ static int stbi__gif_info_raw(stbi__context *s, int *x, int *y, int *comp)
 {
 	stbi__gif* g = (stbi__gif*)stbi__malloc(sizeof(stbi__gif));
 	if (!stbi__gif_header(s, g, comp, 1)) {
-		STBI_FREE(g);
+		stbi__free(g);
 		stbi__rewind(s);
 		return 0;
 	}
 	if (x) *x = g->w;
 	if (y) *y = g->h;
-	STBI_FREE(g);
+	stbi__free(g);
 	return 1;
 }
 
@@ -6512,7 +8407,7 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
 		if (!stbi__mad3sizes_valid(4, g->w, g->h, 0))
 			return stbi__errpuc("too large", "GIF image is too large");
 		pcount = g->w * g->h;
-		g->out = (stbi_uc *)stbi__malloc(4 * pcount);
+		g->out = (stbi_uc *)stbi__malloc_pixels(4, 8, 4 * pcount);
 		g->background = (stbi_uc *)stbi__malloc(4 * pcount);
 		g->history = (stbi_uc *)stbi__malloc(pcount);
 		if (!g->out || !g->background || !g->history)
@@ -6727,9 +8622,9 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
 		} while (u != 0);
 
 		// free temp buffer; 
-		STBI_FREE(g.out);
-		STBI_FREE(g.history);
-		STBI_FREE(g.background);
+		stbi__free(g.out);
+		stbi__free(g.history);
+		stbi__free(g.background);
 
 		// do the final conversion after loading everything; 
 		if (req_comp && req_comp != 4)
@@ -6763,12 +8658,12 @@ static void *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int req
 	}
 	else if (g.out) {
 		// if there was an error and we allocated an image buffer, free it!
-		STBI_FREE(g.out);
+		stbi__free(g.out);
 	}
 
 	// free buffers needed for multiple frame loading; 
-	STBI_FREE(g.history);
-	STBI_FREE(g.background);
+	stbi__free(g.history);
+	stbi__free(g.background);
 
 	return u;
 }
@@ -6940,16 +8835,16 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
 				stbi__hdr_convert(hdr_data, rgbe, req_comp);
 				i = 1;
 				j = 0;
-				STBI_FREE(scanline);
+				stbi__free(scanline);
 				goto main_decode_loop; // yes, this makes no sense
 			}
 			len <<= 8;
 			len |= stbi__get8(s);
-			if (len != width) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
+			if (len != width) { stbi__free(hdr_data); stbi__free(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
 			if (scanline == NULL) {
 				scanline = (stbi_uc *)stbi__malloc_mad2(width, 4, 0);
 				if (!scanline) {
-					STBI_FREE(hdr_data);
+					stbi__free(hdr_data);
 					return stbi__errpf("outofmem", "Out of memory");
 				}
 			}
@@ -6963,13 +8858,13 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
 						// Run
 						value = stbi__get8(s);
 						count -= 128;
-						if (count > nleft) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
+						if (count > nleft) { stbi__free(hdr_data); stbi__free(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
 						for (z = 0; z < count; ++z)
 							scanline[i++ * 4 + k] = value;
 					}
 					else {
 						// Dump
-						if (count > nleft) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
+						if (count > nleft) { stbi__free(hdr_data); stbi__free(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
 						for (z = 0; z < count; ++z)
 							scanline[i++ * 4 + k] = stbi__get8(s);
 					}
@@ -6979,7 +8874,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
 				stbi__hdr_convert(hdr_data + (j*width + i)*req_comp, scanline + i * 4, req_comp);
 		}
 		if (scanline)
-			STBI_FREE(scanline);
+			stbi__free(scanline);
 	}
 
 	return hdr_data;
@@ -7212,7 +9107,7 @@ static void *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int req
 	if (!stbi__mad3sizes_valid(s->img_n, s->img_x, s->img_y, 0))
 		return stbi__errpuc("too large", "PNM too large");
 
-	out = (stbi_uc *)stbi__malloc_mad3(s->img_n, s->img_x, s->img_y, 0);
+	out = (stbi_uc *)stbi__malloc_pixels_mad3(s->img_n, 8, s->img_n, s->img_x, s->img_y, 0);
 	if (!out) return stbi__errpuc("outofmem", "Out of memory");
 	stbi__getn(s, out, s->img_n * s->img_x * s->img_y);
 
@@ -5,11 +5,17 @@ layout (location = 1) in vec2 aTexCoord;
 out vec2 TexCoord;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// camera matrices shared by every program, filled in once per frame - see PerFrame.h
+layout (std140) uniform PerFrame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+};
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
 	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
 }
\ No newline at end of file
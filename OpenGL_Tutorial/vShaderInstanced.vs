@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+// per-instance model matrix - a mat4 attribute takes up locations 2 to 5
+layout (location = 2) in mat4 aModel;
+
+out vec2 TexCoord;
+
+// camera matrices shared by every program, filled in once per frame - see PerFrame.h
+layout (std140) uniform PerFrame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+};
+
+void main()
+{
+    gl_Position = viewProjection * aModel * vec4(aPos, 1.0);
+	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#version 330 core
+// one packed corner - see VoxelVertex in ChunkMesher.h for the layout
+layout (location = 0) in uint aVertex;
+
+flat out uint Layer;
+out float Light;
+
+// camera matrices shared by every program, filled in once per frame - see PerFrame.h
+layout (std140) uniform PerFrame
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+};
+
+// world position of the chunk's corner
+uniform vec3 chunkOrigin;
+
+// fixed brightness per face direction: +x -x +y -y +z -z
+const float faceLight[6] = float[6](0.8, 0.8, 1.0, 0.5, 0.65, 0.65);
+// brightness per ambient occlusion level, boxed in to open
+const float occlusionLight[4] = float[4](0.4, 0.6, 0.8, 1.0);
+
+void main()
+{
+	vec3 position = vec3(aVertex & 63u, (aVertex >> 6) & 63u, (aVertex >> 12) & 63u);
+	uint face = (aVertex >> 18) & 7u;
+	uint occlusion = (aVertex >> 21) & 3u;
+    gl_Position = viewProjection * vec4(chunkOrigin + position, 1.0);
+	Layer = aVertex >> 23;
+	Light = faceLight[face] * occlusionLight[occlusion];
+}